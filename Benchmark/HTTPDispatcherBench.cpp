@@ -0,0 +1,117 @@
+/*
+    File:       HTTPDispatcherBench.cpp
+
+    Contains:   Times HTTPDispatcher::Dispatch on a REST style route table
+                of a few dozen routes, per kind of path: exact, with one or
+                two {name} parameters, under a wildcard, by extension and
+                unrouted. The handlers do nothing, what is left is the
+                lookup and handing the parameters to the request.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <CF/CF.h>
+#include <CF/Net/Http/HTTPDispatcher.h>
+
+using namespace CF;
+using namespace CF::Net;
+
+// the framework's main isn't used here
+CF_Error CFInit(int argc, char **argv) { return CF_NoErr; }
+CF_Error CFExit(CF_Error exitCode) { return exitCode; }
+
+static CF_Error nopCGI(HTTPPacket &request, HTTPPacket &response) {
+  return CF_NoErr;
+}
+
+static HTTPMapping sMapping[] = {
+    {(char *) "/", (CF_CGIFunction) nopCGI},
+    {(char *) "/index.html", (CF_CGIFunction) nopCGI},
+    {(char *) "/health", (CF_CGIFunction) nopCGI},
+    {(char *) "/metrics", (CF_CGIFunction) nopCGI},
+    {(char *) "/login", (CF_CGIFunction) nopCGI},
+    {(char *) "/logout", (CF_CGIFunction) nopCGI},
+    {(char *) "/static/*", (CF_CGIFunction) nopCGI},
+    {(char *) "/assets/*", (CF_CGIFunction) nopCGI},
+    {(char *) "*.html", (CF_CGIFunction) nopCGI},
+    {(char *) "*.png", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/status", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users", (CF_CGIFunction) nopCGI},
+    {(char *) "POST /api/v1/users", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users/me", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users/{id}", (CF_CGIFunction) nopCGI},
+    {(char *) "PUT /api/v1/users/{id}", (CF_CGIFunction) nopCGI},
+    {(char *) "DELETE /api/v1/users/{id}", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users/{id}/orders", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users/{id}/orders/{order}", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/users/{id}/files/*", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/orders", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/orders/{order}", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/orders/{order}/items", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/products", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/products/{sku}", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/products/{sku}/reviews", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v1/search", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v2/status", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v2/users/{id}", (CF_CGIFunction) nopCGI},
+    {(char *) "GET /api/v2/users/{id}/orders/{order}", (CF_CGIFunction) nopCGI},
+    {(char *) "/admin/*", (CF_CGIFunction) nopCGI},
+    {(char *) "/admin/users", (CF_CGIFunction) nopCGI},
+    {(char *) "/admin/users/{id}", (CF_CGIFunction) nopCGI},
+    {NULL, NULL}
+};
+
+struct Case {
+  char const *fName;
+  char const *fRequestLine;
+};
+
+static Case sCases[] = {
+    {"exact", "GET /api/v1/status HTTP/1.1"},
+    {"exact, deep", "GET /api/v1/users/me HTTP/1.1"},
+    {"1 param", "GET /api/v1/users/42 HTTP/1.1"},
+    {"2 params", "GET /api/v1/users/42/orders/1001 HTTP/1.1"},
+    {"wildcard", "GET /static/css/site.css HTTP/1.1"},
+    {"wildcard, param", "GET /api/v1/users/42/files/a/b.txt HTTP/1.1"},
+    {"extension", "GET /docs/guide.html HTTP/1.1"},
+    {"default", "GET /nothing/here HTTP/1.1"},
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point inStart, UInt32 inNumRuns) {
+  std::chrono::duration<double, std::nano> theTime = Clock::now() - inStart;
+  return theTime.count() / inNumRuns;
+}
+
+int main(int argc, char **argv) {
+  HTTPDispatcher theDispatcher(sMapping);
+
+  static const UInt32 kNumRuns = 1000000;
+  ::printf("%u routes, %u runs per path\n",
+           (UInt32) (sizeof(sMapping) / sizeof(sMapping[0]) - 1), kNumRuns);
+  ::printf("%-16s %7s %10s\n", "", "params", "Dispatch");
+
+  for (size_t i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++) {
+    std::string theRaw = std::string(sCases[i].fRequestLine) + "\r\nHost: bench\r\n\r\n";
+    StrPtrLen thePacket(&theRaw[0], (UInt32) theRaw.size());
+    HTTPPacket theRequest(&thePacket);
+    HTTPPacket theResponse(httpResponseType);
+    if (theRequest.Parse() != CF_NoErr
+        || theDispatcher.Dispatch(theRequest, theResponse) != CF_NoErr) {
+      ::fprintf(stderr, "%s isn't routed\n", sCases[i].fRequestLine);
+      return EXIT_FAILURE;
+    }
+
+    Clock::time_point theStart = Clock::now();
+    for (UInt32 j = 0; j < kNumRuns; j++)
+      theDispatcher.Dispatch(theRequest, theResponse);
+    double theTime = nsSince(theStart, kNumRuns);
+
+    ::printf("%-16s %7u %7.1f ns\n", sCases[i].fName,
+             theRequest.GetNumPathParams(), theTime);
+  }
+  return EXIT_SUCCESS;
+}
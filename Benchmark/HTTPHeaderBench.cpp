@@ -0,0 +1,142 @@
+/*
+    File:       HTTPHeaderBench.cpp
+
+    Contains:   Times HTTPProtocol::GetHeader, the perfect hash, against the
+                lookup it replaced: a guess from the first character, then
+                a compare with every remaining name. The names are those of
+                the header fields of a few captured requests, with the case
+                they came in, unknown ones included.
+*/
+
+#include <stdio.h>
+#include <chrono>
+#include <CF/CF.h>
+#include <CF/Net/Http/HTTPProtocol.h>
+
+using namespace CF;
+using namespace CF::Net;
+
+// the framework's main isn't used here
+CF_Error CFInit(int argc, char **argv) { return CF_NoErr; }
+CF_Error CFExit(CF_Error exitCode) { return exitCode; }
+
+static StrPtrLen sNames[] = {
+    // Chrome
+    StrPtrLen("Host"), StrPtrLen("Connection"), StrPtrLen("Cache-Control"),
+    StrPtrLen("sec-ch-ua"), StrPtrLen("sec-ch-ua-mobile"),
+    StrPtrLen("sec-ch-ua-platform"), StrPtrLen("Upgrade-Insecure-Requests"),
+    StrPtrLen("User-Agent"), StrPtrLen("Accept"), StrPtrLen("Sec-Fetch-Site"),
+    StrPtrLen("Sec-Fetch-Mode"), StrPtrLen("Sec-Fetch-User"),
+    StrPtrLen("Sec-Fetch-Dest"), StrPtrLen("Accept-Encoding"),
+    StrPtrLen("Accept-Language"), StrPtrLen("Cookie"),
+    StrPtrLen("If-Modified-Since"),
+    // curl
+    StrPtrLen("Host"), StrPtrLen("User-Agent"), StrPtrLen("Accept"),
+    // API client
+    StrPtrLen("Host"), StrPtrLen("Authorization"), StrPtrLen("Content-Type"),
+    StrPtrLen("Content-Length"), StrPtrLen("Accept"),
+    StrPtrLen("X-Request-Id"), StrPtrLen("X-Forwarded-For"),
+    StrPtrLen("X-Forwarded-Proto"), StrPtrLen("connection"),
+};
+
+static const UInt32 kNumNames = sizeof(sNames) / sizeof(sNames[0]);
+
+// HTTPProtocol::GetHeader before the perfect hash
+static HTTPHeader getHeaderByScan(const StrPtrLen *inHeaderStr) {
+  if (inHeaderStr->Len == 0)
+    return httpIllegalHeader;
+
+  HTTPHeader theHeader = httpIllegalHeader;
+  switch ((inHeaderStr->Ptr)[0]) {
+    case 'C':
+    case 'c': theHeader = httpConnectionHeader;
+      break;
+    case 'S':
+    case 's': theHeader = httpServerHeader;
+      break;
+    case 'D':
+    case 'd': theHeader = httpDateHeader;
+      break;
+    case 'A':
+    case 'a': theHeader = httpAuthorizationHeader;
+      break;
+    case 'W':
+    case 'w': theHeader = httpWWWAuthenticateHeader;
+      break;
+    case 'I':
+    case 'i': theHeader = httpIfModifiedSinceHeader;
+      break;
+    case 'E':
+    case 'e': theHeader = httpExpiresHeader;
+      break;
+    case 'L':
+    case 'l': theHeader = httpLastModifiedHeader;
+      break;
+    case 'X':
+    case 'x': theHeader = httpSessionCookieHeader;
+      break;
+    default: break;
+  }
+
+  if (theHeader != httpIllegalHeader) {
+    StrPtrLen const &theName = HTTPProtocol::GetHeaderString(theHeader);
+    if (inHeaderStr->EqualIgnoreCase(theName.Ptr, theName.Len))
+      return theHeader;
+  }
+
+  for (SInt32 x = httpNumVIPHeaders; x < httpNumHeaders; x++) {
+    StrPtrLen const &theName = HTTPProtocol::GetHeaderString((HTTPHeader) x);
+    if (inHeaderStr->EqualIgnoreCase(theName.Ptr, theName.Len))
+      return (HTTPHeader) x;
+  }
+  return httpIllegalHeader;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point inStart, UInt32 inNumRuns) {
+  std::chrono::duration<double, std::nano> theTime = Clock::now() - inStart;
+  return theTime.count() / inNumRuns;
+}
+
+int main(int argc, char **argv) {
+  // both agree on every known name and on the corpus
+  for (SInt32 x = 0; x < httpNumHeaders; x++) {
+    StrPtrLen theName = HTTPProtocol::GetHeaderString((HTTPHeader) x);
+    if (HTTPProtocol::GetHeader(&theName) != getHeaderByScan(&theName)) {
+      ::fprintf(stderr, "lookups disagree on %s\n", theName.Ptr);
+      return EXIT_FAILURE;
+    }
+  }
+  UInt32 theNumKnown = 0;
+  for (UInt32 i = 0; i < kNumNames; i++) {
+    HTTPHeader theHeader = HTTPProtocol::GetHeader(&sNames[i]);
+    if (theHeader != getHeaderByScan(&sNames[i])) {
+      ::fprintf(stderr, "lookups disagree on %s\n", sNames[i].Ptr);
+      return EXIT_FAILURE;
+    }
+    if (theHeader != httpIllegalHeader)
+      theNumKnown++;
+  }
+
+  static const UInt32 kNumRuns = 200000;
+  UInt32 theSink = 0;
+
+  Clock::time_point theStart = Clock::now();
+  for (UInt32 j = 0; j < kNumRuns; j++)
+    for (UInt32 i = 0; i < kNumNames; i++)
+      theSink += getHeaderByScan(&sNames[i]);
+  double theScanTime = nsSince(theStart, kNumRuns * kNumNames);
+
+  theStart = Clock::now();
+  for (UInt32 j = 0; j < kNumRuns; j++)
+    for (UInt32 i = 0; i < kNumNames; i++)
+      theSink += HTTPProtocol::GetHeader(&sNames[i]);
+  double theHashTime = nsSince(theStart, kNumRuns * kNumNames);
+
+  ::printf("%u names, %u of them known\n", kNumNames, theNumKnown);
+  ::printf("scan          %6.1f ns per lookup\n", theScanTime);
+  ::printf("perfect hash  %6.1f ns per lookup\n", theHashTime);
+
+  return theSink == 0xFFFFFFFF ? EXIT_FAILURE : EXIT_SUCCESS;
+}
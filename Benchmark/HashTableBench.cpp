@@ -0,0 +1,203 @@
+/*
+    File:       HashTableBench.cpp
+
+    Contains:   Times OpenHashTable against HashTable, at the 1193 buckets
+                RefTable gives it, and std::unordered_map, from a few
+                hundred entries up to a million: Add, Map of present keys,
+                Map of absent keys and Remove, per operation. GetHashKey is
+                the id itself, as weak as most in the tree; the ids are
+                sequential, which suits the tables that use the key as is,
+                or scattered. OpenHashTable's misses are also timed half
+                way through a rehash, when they probe both tables.
+*/
+
+#include <stdio.h>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <CF/CF.h>
+#include <CF/HashTable.h>
+#include <CF/OpenHashTable.h>
+
+using namespace CF;
+
+// the framework's main isn't used here
+CF_Error CFInit(int argc, char **argv) { return CF_NoErr; }
+CF_Error CFExit(CF_Error exitCode) { return exitCode; }
+
+class Entry;
+
+class EntryKey {
+ public:
+  explicit EntryKey(UInt32 inID) : fID(inID) {}
+  explicit EntryKey(Entry *inEntry);
+
+  UInt32 GetHashKey() { return fID; }
+
+  bool operator==(const EntryKey &key) const { return fID == key.fID; }
+
+ private:
+  UInt32 fID;
+};
+
+class Entry {
+ public:
+  UInt32 fID;
+  Entry *fNextHashEntry;   // HashTable's chain
+};
+
+EntryKey::EntryKey(Entry *inEntry) : fID(inEntry->fID) {}
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsSince(Clock::time_point inStart, UInt32 inNumOps) {
+  std::chrono::duration<double, std::nano> theTime = Clock::now() - inStart;
+  return theTime.count() / inNumOps;
+}
+
+struct Times {
+  double fAdd;
+  double fHit;
+  double fMiss;
+  double fRemove;
+};
+
+static UInt32 sSink = 0;
+
+// ids of the entries, then as many absent ones
+static UInt32 getID(UInt32 inIndex, bool isScattered) {
+  return isScattered ? inIndex * 2654435761U : inIndex;
+}
+
+template<class Table>
+static Times timeTable(Table *inTable, std::vector<Entry> &inEntries,
+                       bool isScattered) {
+  UInt32 theNum = (UInt32) inEntries.size();
+  Times theTimes;
+
+  Clock::time_point theStart = Clock::now();
+  for (UInt32 i = 0; i < theNum; i++)
+    inTable->Add(&inEntries[i]);
+  theTimes.fAdd = nsSince(theStart, theNum);
+
+  theStart = Clock::now();
+  for (UInt32 i = 0; i < theNum; i++) {
+    EntryKey theKey(inEntries[i].fID);
+    sSink += inTable->Map(&theKey) != nullptr;
+  }
+  theTimes.fHit = nsSince(theStart, theNum);
+
+  theStart = Clock::now();
+  for (UInt32 i = 0; i < theNum; i++) {
+    EntryKey theKey(getID(theNum + i, isScattered));
+    sSink += inTable->Map(&theKey) != nullptr;
+  }
+  theTimes.fMiss = nsSince(theStart, theNum);
+
+  theStart = Clock::now();
+  for (UInt32 i = 0; i < theNum; i++)
+    inTable->Remove(&inEntries[i]);
+  theTimes.fRemove = nsSince(theStart, theNum);
+
+  return theTimes;
+}
+
+// std::unordered_map behind the same Add / Map / Remove
+class StdTable {
+ public:
+  void Add(Entry *inEntry) { fMap[inEntry->fID] = inEntry; }
+
+  Entry *Map(EntryKey *inKey) {
+    std::unordered_map<UInt32, Entry *>::iterator theIter = fMap.find(inKey->GetHashKey());
+    return theIter != fMap.end() ? theIter->second : nullptr;
+  }
+
+  void Remove(Entry *inEntry) { fMap.erase(inEntry->fID); }
+
+ private:
+  std::unordered_map<UInt32, Entry *> fMap;
+};
+
+// Map of absent keys while half of the old table has moved to the new one
+static double timeRehashMiss(std::vector<Entry> &inEntries, bool isScattered) {
+  UInt32 theNum = (UInt32) inEntries.size();
+
+  // each Add moves kMigrateStep old buckets: the last growth that is
+  // half done by the time all the entries are in
+  UInt32 theLast = 0;
+  {
+    OpenHashTable<Entry, EntryKey> theTable;
+    UInt32 theSize = theTable.GetTableSize();
+    for (UInt32 i = 0; i < theNum; i++) {
+      theTable.Add(&inEntries[i]);
+      if (theTable.GetTableSize() != theSize) {
+        theSize = theTable.GetTableSize();
+        UInt32 theHalf = i + theSize / 4 / OpenHashTable<Entry, EntryKey>::kMigrateStep;
+        if (theHalf < theNum)
+          theLast = theHalf;
+      }
+    }
+    for (UInt32 i = 0; i < theNum; i++)
+      theTable.Remove(&inEntries[i]);
+  }
+
+  OpenHashTable<Entry, EntryKey> theTable;
+  for (UInt32 i = 0; i <= theLast; i++)
+    theTable.Add(&inEntries[i]);
+  if (!theTable.IsRehashing())
+    return 0;
+
+  Clock::time_point theStart = Clock::now();
+  for (UInt32 i = 0; i < theNum; i++) {
+    EntryKey theKey(getID(theNum + i, isScattered));
+    sSink += theTable.Map(&theKey) != nullptr;
+  }
+  double theTime = nsSince(theStart, theNum);
+
+  for (UInt32 i = 0; i <= theLast; i++)
+    theTable.Remove(&inEntries[i]);
+  return theTime;
+}
+
+static void printTimes(char const *inName, Times const &inTimes) {
+  ::printf("  %-14s %8.1f %8.1f %8.1f %8.1f\n", inName,
+           inTimes.fAdd, inTimes.fHit, inTimes.fMiss, inTimes.fRemove);
+}
+
+int main(int argc, char **argv) {
+  static const UInt32 sSizes[] = {500, 10000, 100000, 1000000};
+
+  for (int isScattered = 0; isScattered < 2; isScattered++)
+  for (size_t i = 0; i < sizeof(sSizes) / sizeof(sSizes[0]); i++) {
+    UInt32 theNum = sSizes[i];
+    std::vector<Entry> theEntries(theNum);
+    for (UInt32 j = 0; j < theNum; j++) {
+      theEntries[j].fID = getID(j, isScattered != 0);
+      theEntries[j].fNextHashEntry = nullptr;
+    }
+
+    ::printf("%u %s ids, ns per op:  add      hit     miss   remove\n", theNum,
+             isScattered ? "scattered" : "sequential");
+    {
+      OpenHashTable<Entry, EntryKey> theTable;
+      printTimes("OpenHashTable", timeTable(&theTable, theEntries, isScattered != 0));
+    }
+    ::printf("  %-14s %26.1f\n", "  rehashing", timeRehashMiss(theEntries, isScattered != 0));
+    {
+      // sized up front, Add never grows it
+      OpenHashTable<Entry, EntryKey> theTable(theNum + theNum / 4 + 1);
+      printTimes("  sized", timeTable(&theTable, theEntries, isScattered != 0));
+    }
+    {
+      HashTable<Entry, EntryKey> theTable(1193);
+      printTimes("HashTable", timeTable(&theTable, theEntries, isScattered != 0));
+    }
+    {
+      StdTable theTable;
+      printTimes("unordered_map", timeTable(&theTable, theEntries, isScattered != 0));
+    }
+  }
+
+  // half the Maps hit
+  return sSink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
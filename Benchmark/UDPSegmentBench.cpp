@@ -0,0 +1,152 @@
+/*
+    File:       UDPSegmentBench.cpp
+
+    Contains:   Sends 1200 byte datagrams over loopback one SendTo at a
+                time, with SendBatch and with SendSegmented, and drains them
+                with RecvBatch from a Socket with and without GRO. Every
+                datagram carries its sequence number, the receiver checks
+                none is lost, reordered or cut. Prints the time per datagram
+                of the sends and of the reads, and datagrams per second.
+
+                    UDPSegmentBench [number of datagrams]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <CF/CF.h>
+#include <CF/Net/Socket/UDPSocket.h>
+
+using namespace CF;
+using namespace CF::Net;
+
+// the framework's main isn't used here
+CF_Error CFInit(int argc, char **argv) { return CF_NoErr; }
+CF_Error CFExit(CF_Error exitCode) { return exitCode; }
+
+static const UInt32 kLoopback = 0x7F000001;
+static const UInt32 kDatagramSize = 1200;
+static const UInt32 kNumPerRound = 50;   // one SendSegmented, under 64KB
+
+enum SendMode { kSendTo, kSendBatch, kSendSegmented, kNumSendModes };
+
+static char const *sModeNames[kNumSendModes] = {"SendTo", "SendBatch", "SendSegmented"};
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+  double fSendTime;   // ns
+  double fRecvTime;   // ns
+  UInt32 fNumSent;
+  UInt32 fNumReceived;
+  UInt32 fNumBad;
+};
+
+static void stamp(char *ioDatagram, UInt32 inSeq) {
+  ::memset(ioDatagram, (char) ('a' + inSeq % 26), kDatagramSize);
+  ::memcpy(ioDatagram, &inSeq, sizeof(inSeq));
+}
+
+static Result run(SendMode inMode, bool inGRO, UInt32 inNumDatagrams) {
+  Result theResult = {0, 0, 0, 0, 0};
+
+  UDPSocket theSender(nullptr, Socket::kNonBlockingSocketType);
+  UDPSocket theReceiver(nullptr, Socket::kNonBlockingSocketType);
+  theSender.Open();
+  theReceiver.Open();
+  theSender.Bind(kLoopback, 0);
+  theReceiver.Bind(kLoopback, 0);
+  theReceiver.SetSocketRcvBufSize(8 * 1024 * 1024);
+  if (inGRO && theReceiver.EnableGRO() != OS_NoErr)
+    ::printf("  GRO isn't supported, reading datagram by datagram\n");
+  UInt16 thePort = theReceiver.GetLocalPort();
+
+  std::vector<char> theRound(kNumPerRound * kDatagramSize);
+  UDPPacketBatch theOutBatch(kNumPerRound, kDatagramSize);
+  UDPPacketBatch theInBatch;
+
+  UInt32 theExpected = 0;
+  for (UInt32 theSeq = 0; theSeq < inNumDatagrams; theSeq += kNumPerRound) {
+    UInt32 theNum = inNumDatagrams - theSeq < kNumPerRound ? inNumDatagrams - theSeq : kNumPerRound;
+    for (UInt32 i = 0; i < theNum; i++)
+      stamp(&theRound[i * kDatagramSize], theSeq + i);
+
+    Clock::time_point theStart = Clock::now();
+    OS_Error theErr = OS_NoErr;
+    switch (inMode) {
+      case kSendTo:
+        for (UInt32 i = 0; i < theNum && theErr == OS_NoErr; i++)
+          theErr = theSender.SendTo(kLoopback, thePort, &theRound[i * kDatagramSize], kDatagramSize);
+        break;
+      case kSendBatch: {
+        theOutBatch.Clear();
+        for (UInt32 i = 0; i < theNum; i++)
+          theOutBatch.AddReference(kLoopback, thePort, &theRound[i * kDatagramSize], kDatagramSize);
+        UInt32 theNumSent;
+        theErr = theSender.SendBatch(&theOutBatch, &theNumSent);
+        break;
+      }
+      default:
+        theErr = theSender.SendSegmented(kLoopback, thePort, &theRound[0],
+                                         theNum * kDatagramSize, kDatagramSize);
+        break;
+    }
+    Clock::time_point theSent = Clock::now();
+    if (theErr != OS_NoErr) {
+      ::fprintf(stderr, "%s failed: %s\n", sModeNames[inMode], ::strerror(theErr));
+      break;
+    }
+    theResult.fNumSent += theNum;
+
+    // loopback delivers during the send, whatever isn't queued now was dropped
+    while (theReceiver.RecvBatch(&theInBatch) == OS_NoErr) {
+      for (UInt32 i = 0; i < theInBatch.GetNumPackets(); i++) {
+        UDPPacket *thePacket = theInBatch.GetPacket(i);
+        UInt32 theSeqIn;
+        ::memcpy(&theSeqIn, thePacket->fData, sizeof(theSeqIn));
+        if (thePacket->fLength != kDatagramSize || theSeqIn != theExpected
+            || thePacket->fData[kDatagramSize - 1] != (char) ('a' + theSeqIn % 26))
+          theResult.fNumBad++;
+        theExpected = theSeqIn + 1;
+        theResult.fNumReceived++;
+      }
+    }
+    Clock::time_point theRead = Clock::now();
+
+    theResult.fSendTime += std::chrono::duration<double, std::nano>(theSent - theStart).count();
+    theResult.fRecvTime += std::chrono::duration<double, std::nano>(theRead - theSent).count();
+  }
+  return theResult;
+}
+
+int main(int argc, char **argv) {
+  UInt32 theNumDatagrams = argc > 1 ? (UInt32) ::strtoul(argv[1], nullptr, 10) : 200000;
+  if (theNumDatagrams == 0) {
+    ::fprintf(stderr, "usage: %s [number of datagrams]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  ::printf("%u datagrams of %u bytes over loopback, ns per datagram\n",
+           theNumDatagrams, kDatagramSize);
+  ::printf("%-14s %4s %8s %8s %12s\n", "", "GRO", "send", "read", "datagrams/s");
+
+  bool isOK = true;
+  for (int theMode = 0; theMode < kNumSendModes; theMode++)
+    for (int theGRO = 0; theGRO < 2; theGRO++) {
+      Result theResult = run((SendMode) theMode, theGRO != 0, theNumDatagrams);
+      double theTotal = theResult.fSendTime + theResult.fRecvTime;
+      ::printf("%-14s %4s %8.1f %8.1f %12.0f\n", sModeNames[theMode], theGRO ? "on" : "off",
+               theResult.fSendTime / theNumDatagrams, theResult.fRecvTime / theNumDatagrams,
+               theTotal > 0 ? theResult.fNumReceived * 1e9 / theTotal : 0.0);
+      if (theResult.fNumSent != theNumDatagrams || theResult.fNumReceived != theNumDatagrams
+          || theResult.fNumBad != 0) {
+        ::fprintf(stderr, "  sent %u, received %u, %u bad\n",
+                  theResult.fNumSent, theResult.fNumReceived, theResult.fNumBad);
+        isOK = false;
+      }
+    }
+
+  return isOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
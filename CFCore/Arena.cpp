@@ -0,0 +1,156 @@
+/*
+    File:       Arena.cpp
+
+    Contains:   Implementation of Arena class.
+
+*/
+
+#include <string.h>
+#include <CF/Arena.h>
+
+using namespace CF;
+
+Arena::Arena(UInt32 inBlockSize, UInt32 inMaxRetained)
+    : fPool(nullptr),
+      fBlockSize((inBlockSize + kAlignment - 1) & ~(kAlignment - 1)),
+      fMaxRetained(inMaxRetained),
+      fFirst(nullptr),
+      fCurrent(nullptr),
+      fPos(nullptr),
+      fEnd(nullptr),
+      fLarge(nullptr),
+      fBytesAllocated(0),
+      fNumBlocksAllocated(0) {}
+
+Arena::Arena(BufferPool *inPool)
+    : fPool(inPool),
+      fBlockSize((inPool->GetBufferSize() - kBlockHeaderSize - kAlignment)
+                     & ~(kAlignment - 1)),
+      fMaxRetained(0),
+      fFirst(nullptr),
+      fCurrent(nullptr),
+      fPos(nullptr),
+      fEnd(nullptr),
+      fLarge(nullptr),
+      fBytesAllocated(0),
+      fNumBlocksAllocated(0) {
+  Assert(inPool->GetBufferSize() > 2 * kBlockHeaderSize);
+}
+
+Arena::~Arena() {
+  this->Reset();
+  while (fFirst != nullptr) {
+    Block *theNext = fFirst->fNext;
+    this->putBlock(fFirst);
+    fFirst = theNext;
+  }
+}
+
+Arena::Block *Arena::newBlock(UInt32 inSize) {
+  auto *theBlock = (Block *) new char[kBlockHeaderSize + inSize];
+  theBlock->fNext = nullptr;
+  theBlock->fSize = inSize;
+  return theBlock;
+}
+
+Arena::Block *Arena::getBlock() {
+  fNumBlocksAllocated++;
+  if (fPool == nullptr)
+    return newBlock(fBlockSize);
+
+  auto *theBlock = (Block *) fPool->Get();
+  theBlock->fNext = nullptr;
+  theBlock->fSize = fBlockSize;
+  return theBlock;
+}
+
+void Arena::putBlock(Block *inBlock) {
+  if (fPool != nullptr)
+    fPool->Put(inBlock);
+  else
+    delete[] (char *) inBlock;
+}
+
+void Arena::nextBlock() {
+  if (fCurrent != nullptr && fCurrent->fNext != nullptr) {
+    fCurrent = fCurrent->fNext;
+  } else {
+    Block *theBlock = this->getBlock();
+    if (fCurrent == nullptr)
+      fFirst = theBlock;
+    else
+      fCurrent->fNext = theBlock;
+    fCurrent = theBlock;
+  }
+  fPos = getData(fCurrent);
+  fEnd = fPos + fCurrent->fSize;
+}
+
+void *Arena::Alloc(UInt32 inSize) {
+  if (inSize > kMaxAllocSize)
+    throw std::bad_alloc();
+
+  UInt32 theSize = (inSize + kAlignment - 1) & ~(kAlignment - 1);
+  if (theSize == 0)
+    theSize = kAlignment;
+  fBytesAllocated += theSize;
+
+  if (theSize > fBlockSize / 2) {
+    // would waste most of a block, it gets its own
+    Block *theBlock = newBlock(theSize);
+    fNumBlocksAllocated++;
+    theBlock->fNext = fLarge;
+    fLarge = theBlock;
+    return getData(theBlock);
+  }
+
+  if ((UInt32) (fEnd - fPos) < theSize)
+    this->nextBlock();
+
+  void *theResult = fPos;
+  fPos += theSize;
+  return theResult;
+}
+
+char *Arena::CopyString(char const *inString, UInt32 inLength) {
+  if (inLength >= kMaxAllocSize)
+    throw std::bad_alloc();
+  auto *theCopy = (char *) this->Alloc(inLength + 1);
+  ::memcpy(theCopy, inString, inLength);
+  theCopy[inLength] = '\0';
+  return theCopy;
+}
+
+void Arena::Reset() {
+  while (fLarge != nullptr) {
+    Block *theNext = fLarge->fNext;
+    delete[] (char *) fLarge;
+    fLarge = theNext;
+  }
+
+  if (fPool != nullptr) {
+    while (fFirst != nullptr) {
+      Block *theNext = fFirst->fNext;
+      fPool->Put(fFirst);
+      fFirst = theNext;
+    }
+  }
+
+  // keep what the next requests are likely to need, not a one-off peak
+  UInt32 theRetained = 0;
+  for (Block *theBlock = fFirst; theBlock != nullptr; theBlock = theBlock->fNext) {
+    theRetained += theBlock->fSize;
+    if (theRetained < fMaxRetained)
+      continue;
+    while (theBlock->fNext != nullptr) {
+      Block *theFreed = theBlock->fNext;
+      theBlock->fNext = theFreed->fNext;
+      delete[] (char *) theFreed;
+    }
+  }
+
+  fCurrent = fFirst;
+  fPos = (fFirst != nullptr) ? getData(fFirst) : nullptr;
+  fEnd = (fFirst != nullptr) ? fPos + fFirst->fSize : nullptr;
+  fBytesAllocated = 0;
+}
@@ -36,6 +36,15 @@
 
 using namespace CF;
 
+BufferPool::~BufferPool() {
+  Assert(fQueue.GetLength() == fTotNumBuffers);
+  while (fQueue.GetLength() > 0) {
+    QueueElem *theElem = fQueue.DeQueue();
+    theElem->~QueueElem();
+    delete[] (char *) theElem; // allocated by Get, with the buffer behind it
+  }
+}
+
 void *BufferPool::Get() {
   Core::MutexLocker locker(&fMutex);
   if (fQueue.GetLength() == 0) {
@@ -0,0 +1,186 @@
+/*
+    File:       HandleTable.cpp
+
+    Contains:   Implementation of HandleTable class.
+
+*/
+
+#include <CF/HandleTable.h>
+#include <climits>
+#include <CF/Core/Thread.h>
+
+#if __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace CF;
+
+// spin this many times before sleeping on a contended slot
+static const UInt32 kSpinsBeforeSleep = 64;
+
+static void futexWait(std::atomic<UInt32> *inAddr, UInt32 inExpected) {
+#if __linux__
+  ::syscall(SYS_futex, reinterpret_cast<UInt32 *>(inAddr),
+            FUTEX_WAIT_PRIVATE, inExpected, nullptr, nullptr, 0);
+#else
+  if (inAddr->load() == inExpected)
+    Core::Thread::Sleep(1);
+#endif
+}
+
+static void futexWake(std::atomic<UInt32> *inAddr) {
+#if __linux__
+  ::syscall(SYS_futex, reinterpret_cast<UInt32 *>(inAddr),
+            FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+  (void) inAddr; // the waiter polls
+#endif
+}
+
+HandleTable::HandleTable(UInt32 maxSlots)
+    : fMaxSlots(maxSlots),
+      fNumSlots(0),
+      fNumHandles(0),
+      fFreeHead(kNoSlot),
+      fFreeTail(kNoSlot) {
+  Assert(maxSlots > 0 && maxSlots <= kMaxSlots);
+  if (fMaxSlots == 0 || fMaxSlots > kMaxSlots)
+    fMaxSlots = kMaxSlots;
+
+  for (auto &theChunk : fChunks)
+    theChunk.store(nullptr, std::memory_order_relaxed);
+}
+
+HandleTable::~HandleTable() {
+  for (auto &theChunk : fChunks)
+    delete[] theChunk.load();
+}
+
+HandleTable::Handle HandleTable::Register(void *inObject) {
+  Core::MutexLocker locker(&fMutex);
+
+  UInt32 theIndex = fFreeHead;
+  Slot *theSlot = nullptr;
+  if (theIndex != kNoSlot) {
+    theSlot = getSlot(theIndex);
+    fFreeHead = theSlot->fNextFree;
+    if (fFreeHead == kNoSlot)
+      fFreeTail = kNoSlot;
+  } else {
+    if (fNumSlots >= fMaxSlots)
+      return kInvalidHandle;
+
+    theIndex = fNumSlots;
+    UInt32 theChunkIndex = theIndex >> kChunkBits;
+    if (fChunks[theChunkIndex].load(std::memory_order_relaxed) == nullptr)
+      fChunks[theChunkIndex].store(new Slot[kChunkSize], std::memory_order_release);
+    fNumSlots++;
+    theSlot = getSlot(theIndex);
+  }
+
+  // generation 0 is skipped so that no handle equals kInvalidHandle
+  theSlot->fGeneration = (theSlot->fGeneration + 1) & ((1U << kGenerationBits) - 1);
+  if (theSlot->fGeneration == 0)
+    theSlot->fGeneration = 1;
+  theSlot->fNextFree = kNoSlot;
+
+  Handle theHandle = (theSlot->fGeneration << kIndexBits) | theIndex;
+  theSlot->fObject.store(inObject, std::memory_order_relaxed);
+  theSlot->fHandle.store(theHandle); // publishes fObject
+  fNumHandles++;
+  return theHandle;
+}
+
+void HandleTable::UnRegister(Handle inHandle) {
+  UInt32 theIndex = GetIndex(inHandle);
+  Slot *theSlot = getSlot(theIndex);
+  Assert(theSlot != nullptr);
+  if (theSlot == nullptr) return;
+
+  // once the handle is gone no new Resolve can succeed, wait out the old ones
+  Handle theExpected = inHandle;
+  if (!theSlot->fHandle.compare_exchange_strong(theExpected, kInvalidHandle)) {
+    Assert(0); // not registered, or unregistered twice
+    return;
+  }
+  waitForRelease(theSlot);
+  theSlot->fObject.store(nullptr, std::memory_order_relaxed);
+
+  Core::MutexLocker locker(&fMutex);
+  if (fFreeTail == kNoSlot)
+    fFreeHead = theIndex;
+  else
+    getSlot(fFreeTail)->fNextFree = theIndex;
+  fFreeTail = theIndex;
+  fNumHandles--;
+}
+
+void *HandleTable::Resolve(Handle inHandle) {
+  Slot *theSlot = getSlot(GetIndex(inHandle));
+  if (theSlot == nullptr || inHandle == kInvalidHandle)
+    return nullptr;
+
+  if (theSlot->fHandle.load() != inHandle)
+    return nullptr;
+
+  // pin first, then make sure UnRegister didn't get in between
+  theSlot->fRefCount.fetch_add(1);
+  if (theSlot->fHandle.load() != inHandle) {
+    release(theSlot);
+    return nullptr;
+  }
+  return theSlot->fObject.load(std::memory_order_acquire);
+}
+
+void HandleTable::Release(Handle inHandle) {
+  Slot *theSlot = getSlot(GetIndex(inHandle));
+  Assert(theSlot != nullptr);
+  if (theSlot != nullptr)
+    release(theSlot);
+}
+
+void HandleTable::Swap(Handle inHandle, void *inObject) {
+  Slot *theSlot = getSlot(GetIndex(inHandle));
+  Assert(theSlot != nullptr && theSlot->fHandle.load() == inHandle);
+  if (theSlot != nullptr)
+    theSlot->fObject.store(inObject, std::memory_order_release);
+}
+
+HandleTable::Handle HandleTable::GetHandle(UInt32 inIndex) {
+  Slot *theSlot = getSlot(inIndex);
+  if (theSlot == nullptr)
+    return kInvalidHandle;
+  return theSlot->fHandle.load();
+}
+
+void HandleTable::release(Slot *inSlot) {
+  UInt32 theOldCount = inSlot->fRefCount.fetch_sub(1);
+  Assert((theOldCount & ~kWaiterBit) > 0);
+
+  // the last one out wakes UnRegister
+  if (theOldCount == (kWaiterBit | 1))
+    futexWake(&inSlot->fRefCount);
+}
+
+void HandleTable::waitForRelease(Slot *inSlot) {
+  UInt32 theSpins = 0;
+  UInt32 theCount = inSlot->fRefCount.load();
+  while ((theCount & ~kWaiterBit) != 0) {
+    if (theSpins++ < kSpinsBeforeSleep) {
+      theCount = inSlot->fRefCount.load();
+      continue;
+    }
+
+    // announce that we sleep, Release only pays for the wake when we do
+    if ((theCount & kWaiterBit) == 0) {
+      if (!inSlot->fRefCount.compare_exchange_weak(theCount, theCount | kWaiterBit))
+        continue;
+      theCount |= kWaiterBit;
+    }
+    futexWait(&inSlot->fRefCount, theCount);
+    theCount = inSlot->fRefCount.load();
+  }
+  inSlot->fRefCount.fetch_and(~kWaiterBit);
+}
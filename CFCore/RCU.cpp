@@ -0,0 +1,65 @@
+/*
+    File:       RCU.cpp
+
+    Contains:   Implementation of RCU class.
+
+*/
+
+#include <CF/Core/RCU.h>
+#include <CF/Core/Thread.h>
+
+using namespace CF::Core;
+
+// spin this many times before sleeping in Synchronize
+static const UInt32 kSpinsBeforeSleep = 128;
+
+RCU::RCU() : fEpoch(0) {
+  for (auto &theEpoch : fStripes)
+    for (auto &theStripe : theEpoch)
+      theStripe.fReaders.store(0, std::memory_order_relaxed);
+}
+
+UInt32 RCU::getStripe() {
+  // threads are spread round robin, once each
+  static std::atomic<UInt32> sNextStripe(0);
+  static thread_local UInt32 sStripe = sNextStripe.fetch_add(1) & (kNumStripes - 1);
+  return sStripe;
+}
+
+UInt32 RCU::ReadLock() {
+  UInt32 theStripe = getStripe();
+  while (true) {
+    UInt32 theEpoch = fEpoch.load() & 1;
+    fStripes[theEpoch][theStripe].fReaders.fetch_add(1);
+
+    // if Synchronize flipped the epoch in between it may not have seen us,
+    // count ourselves in the new one instead
+    if ((fEpoch.load() & 1) == theEpoch)
+      return (theEpoch * kNumStripes) + theStripe;
+
+    fStripes[theEpoch][theStripe].fReaders.fetch_sub(1);
+  }
+}
+
+void RCU::ReadUnlock(UInt32 inToken) {
+  Assert(inToken < 2 * kNumStripes);
+  fStripes[inToken / kNumStripes][inToken % kNumStripes].fReaders.fetch_sub(1);
+}
+
+void RCU::Synchronize() {
+  MutexLocker locker(&fSyncMutex);
+
+  // new readers go to the other epoch, the ones in the old epoch started
+  // before the caller's update was published and have to finish
+  UInt32 theOldEpoch = fEpoch.fetch_add(1) & 1;
+
+  for (auto &theStripe : fStripes[theOldEpoch]) {
+    UInt32 theSpins = 0;
+    while (theStripe.fReaders.load() != 0) {
+      if (theSpins++ < kSpinsBeforeSleep)
+        Thread::ThreadYield();
+      else
+        Thread::Sleep(1);
+    }
+  }
+}
@@ -45,10 +45,19 @@ bool ResizeableStringFormatter::BufferIsFull(char *inBuffer,
 
   //if the old buffer was dynamically allocated also, we'd better delete it.
   if (inBuffer != fOriginalBuffer)
-    delete[] inBuffer;
+    this->ReleaseBuffer(inBuffer);
 
   fStartPut = theNewBuffer;
   fCurrentPut = theNewBuffer + inBufferLen;
   fEndPut = theNewBuffer + theNewBufferSize;
   return true;
 }
+
+void ResizeableStringFormatter::ResetToOriginalBuffer() {
+  if (fStartPut != fOriginalBuffer)
+    this->ReleaseBuffer(fStartPut);
+
+  fStartPut = fOriginalBuffer;
+  fCurrentPut = fOriginalBuffer;
+  fEndPut = fOriginalBuffer + fOriginalBufSize;
+}
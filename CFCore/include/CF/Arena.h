@@ -0,0 +1,122 @@
+/*
+    File:       Arena.h
+
+    Contains:   A bump pointer allocator for memory that all goes away at
+                once, such as everything belonging to one HTTP request.
+
+                Alloc hands out the next aligned bytes of the current block
+                and only goes to the heap when the blocks kept so far are
+                used up. Nothing is freed on its own; Reset makes all of it
+                available again in one step. The blocks stay with the arena
+                across Resets, up to inMaxRetained bytes, so a steady load
+                stops allocating after the first few requests. An arena
+                can also take its blocks from a BufferPool and give them all
+                back on Reset, so that an idle one holds none. Allocations
+                bigger than half a block get a block of their own, which
+                Reset frees.
+
+                Objects made with New don't have their destructors run by
+                Reset, whoever made them calls the destructor when it
+                matters. Not thread safe.
+*/
+
+#ifndef __CF_ARENA_H__
+#define __CF_ARENA_H__
+
+#include <new>
+#include <utility>
+#include <CF/Types.h>
+#include <CF/BufferPool.h>
+
+namespace CF {
+
+class Arena {
+ public:
+
+  enum {
+    kDefaultBlockSize = 4096,         // UInt32
+    kDefaultMaxRetained = 64 * 1024,  // UInt32
+    kAlignment = 16                   // UInt32, of everything Alloc returns
+  };
+
+  // No memory is allocated before the first Alloc.
+  explicit Arena(UInt32 inBlockSize = kDefaultBlockSize,
+                 UInt32 inMaxRetained = kDefaultMaxRetained);
+
+  // The blocks are inPool's buffers, Reset puts them all back.
+  explicit Arena(BufferPool *inPool);
+
+  ~Arena();
+
+  // inSize bytes aligned to kAlignment, valid until the next Reset.
+  // Throws std::bad_alloc, as new does, for a size that doesn't fit in a
+  // block header and the alignment.
+  void *Alloc(UInt32 inSize);
+
+  // A NUL terminated copy of inLength bytes of inString.
+  char *CopyString(char const *inString, UInt32 inLength);
+
+  template<typename T, typename... Args>
+  T *New(Args &&... inArgs) {
+    return new(this->Alloc(sizeof(T))) T(std::forward<Args>(inArgs)...);
+  }
+
+  // Everything allocated so far is given up. The blocks are kept for the
+  // next allocations, those past inMaxRetained and the large ones are freed.
+  // With a BufferPool, none are kept.
+  void Reset();
+
+  // Bytes handed out since the last Reset.
+  UInt32 GetBytesAllocated() { return fBytesAllocated; }
+
+  // Heap (or pool) allocations made for blocks, over the arena's lifetime.
+  UInt32 GetNumBlocksAllocated() { return fNumBlocksAllocated; }
+
+ private:
+
+  struct Block {
+    Block *fNext;
+    UInt32 fSize;   // of the data, which follows the (aligned) header
+  };
+
+  enum {
+    kBlockHeaderSize = (sizeof(Block) + kAlignment - 1) & ~(kAlignment - 1)
+  };
+
+  // rounding up and adding the header to anything larger wraps a UInt32
+  static const UInt32 kMaxAllocSize = 0xFFFFFFFFU - kAlignment - kBlockHeaderSize;
+
+  static Block *newBlock(UInt32 inSize);
+
+  // a block of fBlockSize, from fPool if there is one
+  Block *getBlock();
+
+  void putBlock(Block *inBlock);
+
+  // a pool's buffers may only be pointer aligned
+  static char *getData(Block *inBlock) {
+    return (char *) (((PointerSizedUInt) inBlock + sizeof(Block) + kAlignment - 1)
+        & ~(PointerSizedUInt) (kAlignment - 1));
+  }
+
+  // moves on to the next kept block, or a new one
+  void nextBlock();
+
+  BufferPool *fPool;
+  UInt32 fBlockSize;
+  UInt32 fMaxRetained;
+
+  Block *fFirst;      // the kept blocks, in the order they are used
+  Block *fCurrent;
+  char *fPos;         // next free byte of fCurrent
+  char *fEnd;
+
+  Block *fLarge;      // single allocations, freed by Reset
+
+  UInt32 fBytesAllocated;
+  UInt32 fNumBlocksAllocated;
+};
+
+} // namespace CF
+
+#endif // __CF_ARENA_H__
@@ -46,14 +46,15 @@ class BufferPool {
       : fBufSize(inBufferSize), fTotNumBuffers(0) {}
 
   //
-  // This object currently *does not* clean up for itself when
-  // you destruct it!
-  ~BufferPool() {}
+  // Frees the buffers that were Put back. Buffers still out at this
+  // point are leaked, Put everything back first.
+  ~BufferPool();
 
   //
   // ACCESSORS
   UInt32 GetTotalNumBuffers() { return fTotNumBuffers; }
   UInt32 GetNumAvailableBuffers() { return fQueue.GetLength(); }
+  UInt32 GetBufferSize() { return fBufSize; }
 
   //
   // All these functions are Thread-safe
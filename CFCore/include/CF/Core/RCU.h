@@ -0,0 +1,84 @@
+/*
+    File:       RCU.h
+
+    Contains:   A small read-copy-update domain.
+
+                Readers bracket their access with ReadLock / ReadUnlock and
+                never block. Writers publish a new version of the data with
+                an atomic store, then call Synchronize, which returns once
+                every reader that might still see the old version is done,
+                so the old version can be freed.
+
+                Readers are counted per epoch in a few cache line sized
+                stripes, so they don't all hit the same line. Synchronize
+                flips the epoch and waits for the old one to drain; it is
+                serialized internally and may sleep.
+*/
+
+#ifndef __CF_RCU_H__
+#define __CF_RCU_H__
+
+#include <atomic>
+#include <CF/Types.h>
+#include <CF/Core/Mutex.h>
+
+namespace CF {
+namespace Core {
+
+class RCU {
+ public:
+
+  RCU();
+
+  ~RCU() = default;
+
+  // returns a token for ReadUnlock, read sections may nest
+  UInt32 ReadLock();
+
+  void ReadUnlock(UInt32 inToken);
+
+  // Must not be called from inside a read section of this domain, it
+  // would wait for itself.
+  void Synchronize();
+
+ private:
+
+  enum {
+    kNumStripes = 16,   // UInt32, power of 2
+    kCacheLineSize = 64 // UInt32
+  };
+
+  // Padded rather than aligned: RCU lives in objects made with plain new,
+  // which doesn't honour more than the default alignment before C++17.
+  // Counters a line apart never share one, wherever the array starts.
+  struct Stripe {
+    std::atomic<UInt32> fReaders;
+    char fPad[kCacheLineSize - sizeof(std::atomic<UInt32>)];
+  };
+
+  static UInt32 getStripe();
+
+  std::atomic<UInt32> fEpoch;   // read by every reader, kept off the stripes
+  char fEpochPad[kCacheLineSize - sizeof(std::atomic<UInt32>)];
+  Stripe fStripes[2][kNumStripes];
+  Mutex fSyncMutex;
+};
+
+class RCUReadLocker {
+ public:
+
+  explicit RCUReadLocker(RCU *inRCU)
+      : fRCU(inRCU), fToken(inRCU->ReadLock()) {}
+
+  ~RCUReadLocker() { fRCU->ReadUnlock(fToken); }
+
+ private:
+
+  RCU *fRCU;
+  UInt32 fToken;
+};
+
+} // namespace Core
+} // namespace CF
+
+#endif // __CF_RCU_H__
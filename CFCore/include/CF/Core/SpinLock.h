@@ -17,7 +17,9 @@ class SpinLock {
 
   void Lock() {
     bool unlatched = false;
-    while(!_lock.compare_exchange_weak(unlatched, true, std::memory_order_acquire));
+    // a failed exchange stores the current value into unlatched, reset it.
+    while (!_lock.compare_exchange_weak(unlatched, true, std::memory_order_acquire))
+      unlatched = false;
   }
 
   void Unlock() {
@@ -25,7 +27,7 @@ class SpinLock {
   }
 
  private:
-  std::atomic_bool _lock;
+  std::atomic_bool _lock{false};
 };
 
 class SpinLocker {
@@ -0,0 +1,172 @@
+/*
+    File:       HandleTable.h
+
+    Contains:   Maps generation-tagged integer handles to object pointers.
+
+                A handle is a slot index plus the generation of that slot, so
+                a handle whose object has gone away never resolves to the
+                object that reuses the slot. Resolve and Release are lock
+                free; only Register and UnRegister take the table Mutex.
+
+                Like RefTable, an object can only be unregistered when no one
+                is using it, UnRegister blocks until every Resolve has been
+                released.
+*/
+
+#ifndef __CF_HANDLE_TABLE_H__
+#define __CF_HANDLE_TABLE_H__
+
+#include <atomic>
+#include <CF/Types.h>
+#include <CF/Core/Mutex.h>
+
+namespace CF {
+
+class HandleTableIter;
+
+/**
+ * @brief 句柄表，句柄 = 代数 + 槽位下标
+ *
+ * @note 维护引用计数，但不管理对象内存
+ */
+class HandleTable {
+ public:
+
+  typedef UInt32 Handle;
+
+  enum {
+    kInvalidHandle = 0,           // never handed out
+
+    kIndexBits = 20,
+    kGenerationBits = 32 - kIndexBits,
+    kMaxSlots = 1U << kIndexBits, // UInt32
+
+    kChunkBits = 10,              // slots are allocated kChunkSize at a Time
+    kChunkSize = 1U << kChunkBits,
+    kMaxChunks = kMaxSlots >> kChunkBits
+  };
+
+  // maxSlots bounds how many objects may be registered at once, and
+  // therefore the largest index a handle can carry.
+  explicit HandleTable(UInt32 maxSlots = kMaxSlots);
+  ~HandleTable();
+
+  // Binds inObject to a fresh handle. Returns kInvalidHandle if the table
+  // is full.
+  Handle Register(void *inObject);
+
+  // Stops the handle from resolving, then blocks until every Resolve of it
+  // has been released, and frees its slot.
+  void UnRegister(Handle inHandle);
+
+  // Returns the object bound to inHandle and pins it until Release, or
+  // nullptr if the handle is stale. Never blocks.
+  void *Resolve(Handle inHandle);
+
+  // Drops a pin taken by a successful Resolve.
+  void Release(Handle inHandle);
+
+  // Points a live handle at another object. Clients that already resolved
+  // the handle keep the old object until they release it.
+  void Swap(Handle inHandle, void *inObject);
+
+  // The handle currently held by the slot at inIndex, kInvalidHandle if the
+  // slot is free. For transports that can only carry the index.
+  Handle GetHandle(UInt32 inIndex);
+
+  static UInt32 GetIndex(Handle inHandle) { return inHandle & (kMaxSlots - 1); }
+
+  UInt32 GetNumHandles() { return fNumHandles; }
+
+ private:
+
+  enum {
+    kWaiterBit = 0x80000000U, // in fRefCount, UnRegister is sleeping
+    kNoSlot = 0xFFFFFFFFU
+  };
+
+  struct Slot {
+    Slot() : fHandle(kInvalidHandle), fRefCount(0), fObject(nullptr),
+             fGeneration(0), fNextFree(kNoSlot) {}
+
+    std::atomic<Handle> fHandle;
+    std::atomic<UInt32> fRefCount;
+    std::atomic<void *> fObject;
+
+    // protected by the table Mutex
+    UInt32 fGeneration;
+    UInt32 fNextFree;
+  };
+
+  Slot *getSlot(UInt32 inIndex) {
+    if (inIndex >= fMaxSlots) return nullptr;
+    Slot *theChunk = fChunks[inIndex >> kChunkBits].load(std::memory_order_acquire);
+    if (theChunk == nullptr) return nullptr;
+    return &theChunk[inIndex & (kChunkSize - 1)];
+  }
+
+  static void release(Slot *inSlot);
+  static void waitForRelease(Slot *inSlot);
+
+  std::atomic<Slot *> fChunks[kMaxChunks];
+  UInt32 fMaxSlots;
+  UInt32 fNumSlots;   // slots carved out of the chunks so far
+  UInt32 fNumHandles;
+
+  // freed slots are reused in FIFO order, so a slot's generation advances
+  // as slowly as possible
+  UInt32 fFreeHead;
+  UInt32 fFreeTail;
+
+  Core::Mutex fMutex;
+
+  friend class HandleTableIter;
+};
+
+/**
+ * @brief 句柄表迭代器
+ *
+ * @note 只在表不会被并发修改时使用，例如停止事件分发之后
+ */
+class HandleTableIter {
+ public:
+
+  explicit HandleTableIter(HandleTable *table) : fTable(table), fIndex(0) {
+    this->skipFree();
+  }
+
+  void First() {
+    fIndex = 0;
+    this->skipFree();
+  }
+
+  void Next() {
+    fIndex++;
+    this->skipFree();
+  }
+
+  bool IsDone() { return fIndex >= fTable->fNumSlots; }
+
+  HandleTable::Handle GetCurrentHandle() {
+    return fTable->getSlot(fIndex)->fHandle.load();
+  }
+
+  void *GetCurrent() {
+    return fTable->getSlot(fIndex)->fObject.load();
+  }
+
+ private:
+
+  void skipFree() {
+    while (fIndex < fTable->fNumSlots &&
+        fTable->getSlot(fIndex)->fHandle.load() == HandleTable::kInvalidHandle)
+      fIndex++;
+  }
+
+  HandleTable *fTable;
+  UInt32 fIndex;
+};
+
+}
+
+#endif //__CF_HANDLE_TABLE_H__
@@ -0,0 +1,298 @@
+/*
+    File:       OpenHashTable.h
+
+    Contains:   Defines a template class for resizable open-addressing hash
+                tables.
+
+                Same contract as HashTable (Add / Remove / Map), but T needs
+                no fNextHashEntry field and the table grows with its content.
+                Buckets are probed linearly, Robin Hood style, so a lookup
+                walks a few adjacent buckets instead of a pointer chain.
+
+                Growth is incremental: the previous table is kept and every
+                Add / Remove moves a few of its buckets over, so no single
+                call pays for a full rehash.
+*/
+
+#ifndef __CF_OPEN_HASH_TABLE_H__
+#define __CF_OPEN_HASH_TABLE_H__
+
+#include <string.h>
+#include "CF/Types.h"
+
+namespace CF {
+
+template<class T, class K>
+class OpenHashTableIter;
+
+/*
+  key(T) must return the key of type K. K must have a method GetHashKey()
+  that returns an UInt32 hash value, which is mixed again here, so a weak
+  hash is acceptable. The table can contain duplicate keys, the Map function
+  will return one of them.
+*/
+
+template<class T, class K>
+/**
+ * @brief 开放寻址哈希表，可扩容，渐进式 rehash
+ *
+ * @note 不管理对象内存
+ */
+class OpenHashTable {
+ public:
+  enum {
+    kMinTableSize = 8,    // UInt32
+    kMigrateStep = 16     // old buckets moved per Add / Remove
+  };
+
+  explicit OpenHashTable(UInt32 size = kMinTableSize)
+      : fOld(), fMigratePos(0), fNumEntries(0) {
+    UInt32 theSize = kMinTableSize;
+    while (theSize < size && theSize < 0x80000000U)
+      theSize <<= 1;
+    fCur.Alloc(theSize);
+  }
+
+  ~OpenHashTable() {
+    fCur.Free();
+    fOld.Free();
+  }
+
+  void Add(T *entry) {
+    // grow at 80% load
+    if ((fNumEntries + 1) * 5 > (UInt64) fCur.Size() * 4)
+      this->grow();
+
+    K key(entry);
+    insert(&fCur, entry, mix(key.GetHashKey()));
+    fNumEntries++;
+    this->migrate(kMigrateStep);
+  }
+
+  // sometimes remove is called 2x ( swap, then un register ), the second
+  // call finds nothing and does nothing.
+  void Remove(T *entry) {
+    K key(entry);
+    UInt32 theHash = mix(key.GetHashKey());
+
+    Bucket *theBucket = find(&fCur, nullptr, entry, theHash, 0);
+    if (theBucket != nullptr) {
+      erase(&fCur, (UInt32) (theBucket - fCur.fBuckets));
+      fNumEntries--;
+    } else if (fOld.fBuckets != nullptr) {
+      theBucket = find(&fOld, nullptr, entry, theHash, fMigratePos);
+      if (theBucket != nullptr) {
+        // the old table only drains, leave a tombstone to keep probes intact
+        theBucket->fEntry = nullptr;
+        fNumEntries--;
+      }
+    }
+
+    this->migrate(kMigrateStep);
+  }
+
+  T *Map(K *key) {
+    UInt32 theHash = mix(key->GetHashKey());
+    Bucket *theBucket = find(&fCur, key, nullptr, theHash, 0);
+    if (theBucket == nullptr && fOld.fBuckets != nullptr)
+      theBucket = find(&fOld, key, nullptr, theHash, fMigratePos);
+    return theBucket != nullptr ? theBucket->fEntry : nullptr;
+  }
+
+  UInt64 GetNumEntries() { return fNumEntries; }
+
+  UInt32 GetTableSize() { return fCur.Size(); }
+
+  bool IsRehashing() { return fOld.fBuckets != nullptr; }
+
+ private:
+
+  struct Bucket {
+    T *fEntry;      // nullptr in an occupied bucket is a tombstone
+    UInt32 fHash;
+    UInt32 fDist;   // probe distance + 1, 0 is an empty bucket
+  };
+
+  struct Table {
+    Bucket *fBuckets;
+    UInt32 fMask;
+
+    Table() : fBuckets(nullptr), fMask(0) {}
+
+    UInt32 Size() { return fBuckets != nullptr ? fMask + 1 : 0; }
+
+    void Alloc(UInt32 size) {
+      fBuckets = new Bucket[size];
+      ::memset(fBuckets, 0, sizeof(Bucket) * size);
+      fMask = size - 1;
+    }
+
+    void Free() {
+      delete[] fBuckets;
+      fBuckets = nullptr;
+      fMask = 0;
+    }
+  };
+
+  // K::GetHashKey is often cheap and poorly distributed, spread it out
+  static UInt32 mix(UInt32 hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+  }
+
+  static void insert(Table *table, T *entry, UInt32 hash) {
+    Bucket theNew = {entry, hash, 1};
+    UInt32 thePos = hash & table->fMask;
+    while (true) {
+      Bucket &theBucket = table->fBuckets[thePos];
+      if (theBucket.fDist == 0) {
+        theBucket = theNew;
+        return;
+      }
+      // take from the rich: whoever is closer to home moves on
+      if (theBucket.fDist < theNew.fDist) {
+        Bucket theTemp = theBucket;
+        theBucket = theNew;
+        theNew = theTemp;
+      }
+      theNew.fDist++;
+      thePos = (thePos + 1) & table->fMask;
+    }
+  }
+
+  // Finds entry by identity when given, by key otherwise. Buckets below
+  // skipBelow have already been migrated, they are empty now: the probe
+  // jumps over them in one go, as if it had walked them.
+  static Bucket *find(Table *table, K *key, T *entry, UInt32 hash,
+                      UInt32 skipBelow) {
+    UInt32 thePos = hash & table->fMask;
+    for (UInt32 theDist = 1;; theDist++, thePos = (thePos + 1) & table->fMask) {
+      if (thePos < skipBelow) {
+        theDist += skipBelow - thePos;
+        thePos = skipBelow;
+      }
+
+      Bucket &theBucket = table->fBuckets[thePos];
+      if (theBucket.fDist < theDist) // empty, or our key would have been here
+        return nullptr;
+
+      if (theBucket.fEntry == nullptr || theBucket.fHash != hash)
+        continue;
+
+      if (entry != nullptr) {
+        if (theBucket.fEntry == entry)
+          return &theBucket;
+      } else {
+        K theKey(theBucket.fEntry);
+        if (theKey == *key)
+          return &theBucket;
+      }
+    }
+  }
+
+  // backward shift deletion, no tombstones in the current table
+  static void erase(Table *table, UInt32 pos) {
+    UInt32 theNext = (pos + 1) & table->fMask;
+    while (table->fBuckets[theNext].fDist > 1) {
+      table->fBuckets[pos] = table->fBuckets[theNext];
+      table->fBuckets[pos].fDist--;
+      pos = theNext;
+      theNext = (theNext + 1) & table->fMask;
+    }
+    ::memset(&table->fBuckets[pos], 0, sizeof(Bucket));
+  }
+
+  void grow() {
+    // a previous growth that hasn't drained yet is finished first
+    if (fOld.fBuckets != nullptr)
+      this->migrate(fOld.Size());
+
+    fOld = fCur;
+    fCur = Table();
+    fCur.Alloc(fOld.Size() << 1);
+    fMigratePos = 0;
+  }
+
+  void migrate(UInt32 numBuckets) {
+    if (fOld.fBuckets == nullptr) return;
+
+    UInt32 theOldSize = fOld.Size();
+    for (UInt32 i = 0; i < numBuckets && fMigratePos < theOldSize; i++) {
+      Bucket &theBucket = fOld.fBuckets[fMigratePos++];
+      if (theBucket.fEntry != nullptr)
+        insert(&fCur, theBucket.fEntry, theBucket.fHash);
+      ::memset(&theBucket, 0, sizeof(Bucket));
+    }
+
+    if (fMigratePos >= theOldSize) {
+      fOld.Free();
+      fMigratePos = 0;
+    }
+  }
+
+  Table fCur;
+  Table fOld;         // draining into fCur while rehashing
+  UInt32 fMigratePos; // buckets of fOld below this are already moved
+  UInt64 fNumEntries;
+
+  friend class OpenHashTableIter<T, K>;
+};
+
+/*
+  The table must not be modified while it's being iterated, removal shifts
+  later entries back and growth moves them to another table.
+*/
+template<class T, class K>
+class OpenHashTableIter {
+ public:
+  OpenHashTableIter(OpenHashTable<T, K> *table) {
+    fHashTable = table;
+    First();
+  }
+
+  void First() {
+    fInOld = (fHashTable->fOld.fBuckets != nullptr);
+    fIndex = fInOld ? fHashTable->fMigratePos : 0;
+    this->seek();
+  }
+
+  void Next() {
+    fIndex++;
+    this->seek();
+  }
+
+  bool IsDone() { return fCurrent == nullptr; }
+
+  T *GetCurrent() { return fCurrent; }
+
+ private:
+
+  void seek() {
+    fCurrent = nullptr;
+    if (fInOld) {
+      for (; fIndex < fHashTable->fOld.Size(); fIndex++) {
+        fCurrent = fHashTable->fOld.fBuckets[fIndex].fEntry;
+        if (fCurrent) return;
+      }
+      fInOld = false;
+      fIndex = 0;
+    }
+    for (; fIndex < fHashTable->fCur.Size(); fIndex++) {
+      fCurrent = fHashTable->fCur.fBuckets[fIndex].fEntry;
+      if (fCurrent) return;
+    }
+  }
+
+  OpenHashTable<T, K> *fHashTable;
+  T *fCurrent;
+  UInt32 fIndex;
+  bool fInOld;
+};
+
+}
+
+#endif // __CF_OPEN_HASH_TABLE_H__
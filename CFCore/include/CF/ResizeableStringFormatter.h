@@ -42,7 +42,8 @@ class ResizeableStringFormatter : public StringFormatter {
  public:
   // Pass in inBuffer=nullptr and inBufSize=0 to dynamically allocate the initial buffer.
   ResizeableStringFormatter(char *inBuffer = nullptr, UInt32 inBufSize = 0)
-      : StringFormatter(inBuffer, inBufSize), fOriginalBuffer(inBuffer) {}
+      : StringFormatter(inBuffer, inBufSize), fOriginalBuffer(inBuffer),
+        fOriginalBufSize(inBufSize) {}
 
   // If we've been forced to increase the buffer size, fStartPut WILL be a
   // dynamically allocated buffer, and it WON'T be equal to fOriginalBuffer (obviously).
@@ -50,14 +51,25 @@ class ResizeableStringFormatter : public StringFormatter {
     if (fStartPut != fOriginalBuffer) delete[] fStartPut;
   }
 
- private:
+ protected:
+
+  // Drops the dynamically allocated buffer, if any, and goes back to the
+  // original one. Unlike Reset, the byte count of StringFormatter is kept.
+  void ResetToOriginalBuffer();
+
+  // Called whenever a dynamically allocated buffer is given up. Subclasses
+  // whose buffers may still be in use elsewhere can hold on to it here.
+  virtual void ReleaseBuffer(char *inBuffer) { delete[] inBuffer; }
 
   // This function will get called by StringFormatter if the current
   // output buffer is full. This object allocates a buffer that's twice
   // as big as the old one.
   bool BufferIsFull(char *inBuffer, UInt32 inBufferLen) override;
 
+ private:
+
   char *fOriginalBuffer;
+  UInt32 fOriginalBufSize;
 
 };
 
@@ -0,0 +1,550 @@
+/*
+    File:       HTTPClientPool.cpp
+
+    Contains:   Implementation of HTTPClientPool and its connections.
+
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include <CF/Core/Time.h>
+#include <CF/Core/Thread.h>
+#include <CF/Net/Http/HTTPClientPool.h>
+
+#if !__Win32__
+#include <sys/socket.h>
+#endif
+
+using namespace CF::Net;
+
+static CF::StrPtrLen sChunkedStr("chunked");
+static CF::StrPtrLen sCloseStr("close");
+static CF::StrPtrLen sKeepAliveStr("keep-alive");
+
+HTTPClientConnection::HTTPClientConnection(HTTPClientHost *inHost,
+                                           bool inPipelining)
+    : fSocket(nullptr, Socket::kNonBlockingSocketType),
+      fHost(inHost),
+      fOutput(nullptr, 0),
+      fOutputSent(0),
+      fBuffer(nullptr),
+      fBufferSize(0),
+      fBufferLength(0),
+      fMaxResponseSize(HTTPClientPool::kDefaultMaxResponseSize),
+      fHeaderLength(0),
+      fResponseLength(0),
+      fBodyLength(0),
+      fDecodePos(0),
+      fResponse(nullptr),
+      fNumOutstanding(0),
+      fNumRequests(0),
+      fKeepAlive(true),
+      fPipelining(inPipelining),
+      fChunked(false),
+      fUntilClose(false),
+      fIdleSince(0),
+      fElem(this) {}
+
+HTTPClientConnection::~HTTPClientConnection() {
+  delete fResponse;
+  delete[] fBuffer;
+}
+
+void HTTPClientConnection::attach(Thread::Task *inTask,
+                                  UInt32 inMaxResponseSize) {
+  fSocket.SetTask(inTask);
+  fMaxResponseSize = inMaxResponseSize;
+}
+
+void HTTPClientConnection::detach() {
+  // level triggered, an idle connection must not keep waking up a task
+  if (fSocket.GetSocketFD() != EventContext::kInvalidFileDesc)
+    fSocket.RequestEvent(EV_RM);
+  fSocket.SetTask(nullptr);
+
+  this->dropResponse();
+  fOutput.Reset();
+  fOutputSent = 0;
+}
+
+bool HTTPClientConnection::isHealthy() {
+  if (!fSocket.IsConnected())
+    return false;
+
+#if __WinSock__
+  return true;
+#else
+  // an idle connection has nothing to read: 0 is the server's FIN, data
+  // would be a response nobody asked for
+  char theByte;
+  ssize_t theLen = ::recv(fSocket.GetSocketFD(), &theByte, 1,
+                          MSG_PEEK | MSG_DONTWAIT);
+  if (theLen >= 0)
+    return false;
+  int theErr = Core::Thread::GetErrno();
+  return (theErr == EAGAIN) || (theErr == EWOULDBLOCK) || (theErr == EINTR);
+#endif
+}
+
+bool HTTPClientConnection::isReusable() {
+  if (!fKeepAlive || !fSocket.IsConnected() || fNumOutstanding > 0)
+    return false;
+
+  // unsent request bytes, or unread bytes past the last response
+  return (fOutputSent == fOutput.GetCurrentOffset())
+      && (fBufferLength == fResponseLength);
+}
+
+OS_Error HTTPClientConnection::SendRequest(char const *inData,
+                                           UInt32 inLength) {
+  if (!fKeepAlive)
+    return (OS_Error) ENOTCONN;
+  if (!fPipelining && fNumOutstanding > 0)
+    return (OS_Error) EPERM;
+
+  fOutput.Put((char *) inData, inLength);
+  fNumOutstanding++;
+  fNumRequests++;
+  return this->Flush();
+}
+
+OS_Error HTTPClientConnection::Flush() {
+  if (fSocket.IsConnecting()) {
+    OS_Error theErr = fSocket.CheckAsyncConnect();
+    if (theErr == EINPROGRESS) {
+      fSocket.RequestEvent(EV_WR);
+      return theErr;
+    }
+    if (theErr != OS_NoErr) {
+      fKeepAlive = false;
+      return theErr;
+    }
+  }
+
+  while (fOutputSent < fOutput.GetCurrentOffset()) {
+    UInt32 theLengthSent = 0;
+    OS_Error theErr = fSocket.Send(fOutput.GetBufPtr() + fOutputSent,
+                                   fOutput.GetCurrentOffset() - fOutputSent,
+                                   &theLengthSent);
+    if (theErr == EAGAIN) {
+      fSocket.RequestEvent(EV_WR);
+      return theErr;
+    }
+    if (theErr != OS_NoErr) {
+      fKeepAlive = false;
+      return theErr;
+    }
+    fOutputSent += theLengthSent;
+  }
+
+  // everything went out, the buffer is used again from its start
+  fOutput.Reset();
+  fOutputSent = 0;
+  return OS_NoErr;
+}
+
+void HTTPClientConnection::dropResponse() {
+  if (fResponse == nullptr)
+    return;
+
+  delete fResponse;
+  fResponse = nullptr;
+  fBody.Set(nullptr, 0);
+  fHeaderLength = 0;
+  fBodyLength = 0;
+  fChunked = false;
+
+  // pipelined responses already read move to the front
+  fBufferLength -= fResponseLength;
+  ::memmove(fBuffer, fBuffer + fResponseLength, fBufferLength);
+  fResponseLength = 0;
+}
+
+void HTTPClientConnection::completeResponse() {
+  fBody.Set(fBuffer + fHeaderLength, fBodyLength);
+  fResponseHeader.Set(fBuffer, fHeaderLength);
+  fResponse = new HTTPPacket(&fResponseHeader);
+  fResponse->Parse();
+  fNumOutstanding--;
+}
+
+OS_Error HTTPClientConnection::ReadResponse() {
+  this->dropResponse();
+
+  // the request may still be going out, keep the write interest then
+  OS_Error theErr = this->Flush();
+  bool isSending = (theErr == EAGAIN);
+  if ((theErr != OS_NoErr) && !isSending)
+    return theErr;
+
+  if (fNumOutstanding == 0)
+    return (OS_Error) EPERM;
+
+  while (true) {
+    theErr = OS_NoErr;
+    if (fBufferLength > 0 && this->parseResponse(&theErr)) {
+      this->completeResponse();
+      return OS_NoErr;
+    }
+    if (theErr != OS_NoErr) {
+      fKeepAlive = false;
+      return theErr;
+    }
+
+    if (fBufferLength == fBufferSize) {
+      // the buffer holds the response, or the start of a pipelined one
+      // after it, so it is full at fMaxResponseSize
+      if (fBufferSize >= fMaxResponseSize) {
+        fKeepAlive = false;
+        return (OS_Error) E2BIG;
+      }
+      UInt32 theNewSize = fBufferSize > 0 ? fBufferSize * 2 : (UInt32) kInitialBufferSize;
+      if (fBufferSize > fMaxResponseSize / 2 || theNewSize > fMaxResponseSize)
+        theNewSize = fMaxResponseSize;
+      auto *theNewBuffer = new char[theNewSize];
+      ::memcpy(theNewBuffer, fBuffer, fBufferLength);
+      delete[] fBuffer;
+      fBuffer = theNewBuffer;
+      fBufferSize = theNewSize;
+    }
+
+    UInt32 theLength = 0;
+    theErr = fSocket.Read(fBuffer + fBufferLength,
+                          fBufferSize - fBufferLength, &theLength);
+    if (theErr == EAGAIN) {
+      fSocket.RequestEvent(isSending ? (EV_RE | EV_WR) : EV_RE);
+      return theErr;
+    }
+
+    if (theErr != OS_NoErr) {
+      fKeepAlive = false;
+      if ((theErr == ENOTCONN) && fUntilClose && (fHeaderLength > 0)) {
+        // the close is the end of the body
+        fBodyLength = fBufferLength - fHeaderLength;
+        fResponseLength = fBufferLength;
+        this->completeResponse();
+        return OS_NoErr;
+      }
+      return theErr;
+    }
+    fBufferLength += theLength;
+  }
+}
+
+bool HTTPClientConnection::parseResponse(OS_Error *outErr) {
+  while (fHeaderLength == 0) {
+    // the header ends with an empty line
+    for (UInt32 i = 3; i < fBufferLength; i++) {
+      if (fBuffer[i] == '\n' && fBuffer[i - 1] == '\r'
+          && fBuffer[i - 2] == '\n' && fBuffer[i - 3] == '\r') {
+        fHeaderLength = i + 1;
+        break;
+      }
+    }
+    if (fHeaderLength == 0) {
+      if (fBufferLength >= kMaxHeaderSize)
+        *outErr = (OS_Error) E2BIG;
+      return false;
+    }
+
+    fResponseHeader.Set(fBuffer, fHeaderLength);
+    HTTPPacket theHeader(&fResponseHeader);
+    if (theHeader.Parse() != CF_NoErr
+        || theHeader.GetHTTPType() != httpResponseType) {
+      *outErr = (OS_Error) EINVAL;
+      return false;
+    }
+
+    // the code itself, HTTPStatusCode doesn't know every one of them
+    StringParser theStatusParser(&fResponseHeader);
+    theStatusParser.ConsumeUntilWhitespace();
+    theStatusParser.ConsumeWhitespace();
+    UInt32 theStatus = theStatusParser.ConsumeInteger(nullptr);
+    if (theStatus >= 100 && theStatus < 200) {
+      // interim response, the real one follows
+      fBufferLength -= fHeaderLength;
+      ::memmove(fBuffer, fBuffer + fHeaderLength, fBufferLength);
+      fHeaderLength = 0;
+      continue;
+    }
+
+    // HTTP/1.0 servers only keep the connection when asked to
+    StrPtrLen *theConnection = theHeader.GetHeaderValue(httpConnectionHeader);
+    if (::memcmp(fBuffer, "HTTP/1.0", 8) == 0)
+      fKeepAlive = fKeepAlive && theConnection->EqualIgnoreCase(sKeepAliveStr);
+    else if (theConnection->EqualIgnoreCase(sCloseStr))
+      fKeepAlive = false;
+
+    StrPtrLen *theEncoding = theHeader.GetHeaderValue(httpTransferEncodingHeader);
+    StrPtrLen *theLength = theHeader.GetHeaderValue(httpContentLengthHeader);
+    fBodyLength = 0;
+    fChunked = false;
+    fUntilClose = false;
+    if (theStatus == 204 || theStatus == 304) {
+      // never a body
+    } else if (theEncoding->Len > 0
+        && theEncoding->FindStringIgnoreCase(&sChunkedStr) != nullptr) {
+      fChunked = true;
+      fDecodePos = fHeaderLength;
+    } else if (theLength->Len > 0) {
+      // ConsumeInteger wraps above 9 digits
+      StringParser theParser(theLength);
+      StrPtrLen theDigits;
+      fBodyLength = theParser.ConsumeInteger(&theDigits);
+      if (theDigits.Len > 9
+          || fBodyLength > fMaxResponseSize - fHeaderLength) {
+        *outErr = (OS_Error) E2BIG;
+        return false;
+      }
+    } else {
+      fUntilClose = true;
+    }
+  }
+
+  if (fUntilClose)
+    return false;
+
+  if (fChunked)
+    return this->parseChunked(outErr);
+
+  if (fBufferLength - fHeaderLength < fBodyLength)
+    return false;
+  fResponseLength = fHeaderLength + fBodyLength;
+  return true;
+}
+
+bool HTTPClientConnection::parseChunked(OS_Error *outErr) {
+  // Complete chunks are copied down to the end of the decoded body,
+  // fDecodePos is the first byte not decoded yet. A chunk that is not all
+  // there is parsed again on the next read.
+  UInt32 thePos = fDecodePos;
+  while (true) {
+    UInt32 theSize = 0;
+    UInt32 theDigits = 0;
+    while (thePos < fBufferLength && ::isxdigit((unsigned char) fBuffer[thePos])) {
+      char c = fBuffer[thePos++];
+      theSize = (theSize << 4)
+          | (UInt32) (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+      if (++theDigits > 7) {
+        *outErr = (OS_Error) EINVAL;
+        return false;
+      }
+    }
+
+    // skip chunk extensions up to the end of the size line
+    while (thePos < fBufferLength && fBuffer[thePos] != '\n')
+      thePos++;
+    if (thePos >= fBufferLength)
+      return false;
+    if (theDigits == 0) {
+      *outErr = (OS_Error) EINVAL;
+      return false;
+    }
+    thePos++;
+
+    if (theSize == 0) {
+      // trailers, up to an empty line
+      while (true) {
+        UInt32 theLineStart = thePos;
+        while (thePos < fBufferLength && fBuffer[thePos] != '\n')
+          thePos++;
+        if (thePos >= fBufferLength)
+          return false;
+        thePos++;
+        if (thePos - theLineStart <= 2)
+          break;
+      }
+      fResponseLength = thePos;
+      return true;
+    }
+
+    if (fBufferLength - thePos < theSize + 2)
+      return false;
+
+    ::memmove(fBuffer + fHeaderLength + fBodyLength, fBuffer + thePos, theSize);
+    fBodyLength += theSize;
+    thePos += theSize + 2;
+    fDecodePos = thePos;
+  }
+}
+
+HTTPClientPool::HTTPClientPool(UInt32 inMaxIdlePerHost, UInt32 inMaxPerHost,
+                               UInt32 inIdleTimeoutInMilSecs,
+                               bool inPipelining)
+    : fMaxIdlePerHost(inMaxIdlePerHost),
+      fMaxPerHost(inMaxPerHost),
+      fIdleTimeoutInMilSecs(inIdleTimeoutInMilSecs),
+      fPipelining(inPipelining),
+      fConnectTimeoutInMilSecs(0),
+      fMaxRequestsPerConnection(0),
+      fMaxResponseSize(kDefaultMaxResponseSize),
+      fNumIdle(0),
+      fNumConnections(0),
+      fNumCreated(0),
+      fNumReused(0) {}
+
+HTTPClientPool::~HTTPClientPool() {
+  Assert(fNumConnections == fNumIdle);
+
+  while (true) {
+    OpenHashTableIter<HTTPClientHost, HTTPClientHostKey> theIter(&fHosts);
+    if (theIter.IsDone())
+      break;
+    HTTPClientHost *theHost = theIter.GetCurrent();
+    if (theHost->fIdle.GetLength() == 0) {
+      fHosts.Remove(theHost);
+      delete theHost;
+      continue;
+    }
+    this->close((HTTPClientConnection *) theHost->fIdle.DeQueue()->GetEnclosingObject());
+  }
+}
+
+bool HTTPClientPool::isExpired(HTTPClientConnection *inConnection,
+                               SInt64 inNow) {
+  return (fIdleTimeoutInMilSecs > 0)
+      && (inNow - inConnection->fIdleSince > fIdleTimeoutInMilSecs);
+}
+
+void HTTPClientPool::close(HTTPClientConnection *inConnection) {
+  HTTPClientHost *theHost = inConnection->fHost;
+  delete inConnection;
+
+  fNumConnections--;
+  if (--theHost->fNumConnections == 0) {
+    fHosts.Remove(theHost);
+    delete theHost;
+  }
+}
+
+OS_Error HTTPClientPool::Acquire(UInt32 inAddr, UInt16 inPort,
+                                 Thread::Task *inTask,
+                                 HTTPClientConnection **outConnection) {
+  Assert(outConnection != nullptr);
+  *outConnection = nullptr;
+
+  HTTPClientConnection *theConnection = nullptr;
+  {
+    Core::MutexLocker locker(&fMutex);
+
+    HTTPClientHostKey theKey(inAddr, inPort);
+    HTTPClientHost *theHost = fHosts.Map(&theKey);
+    if (theHost == nullptr) {
+      theHost = new HTTPClientHost(inAddr, inPort);
+      fHosts.Add(theHost);
+    }
+
+    // the most recently used connection is the least likely to have been
+    // closed by the server, Release puts it at the tail
+    SInt64 theNow = Core::Time::Milliseconds();
+    while (theHost->fIdle.GetLength() > 0) {
+      auto *theIdle = (HTTPClientConnection *) theHost->fIdle.GetTail()->GetEnclosingObject();
+      theHost->fIdle.Remove(&theIdle->fElem);
+      fNumIdle--;
+
+      if (this->isExpired(theIdle, theNow) || !theIdle->isHealthy()) {
+        // keeps theHost, it is still counted in fNumConnections
+        theHost->fNumConnections--;
+        fNumConnections--;
+        delete theIdle;
+        continue;
+      }
+
+      theIdle->attach(inTask, fMaxResponseSize);
+      fNumReused++;
+      *outConnection = theIdle;
+      return OS_NoErr;
+    }
+
+    if (fMaxPerHost > 0 && theHost->fNumConnections >= fMaxPerHost)
+      return (OS_Error) EAGAIN;
+
+    theHost->fNumConnections++;
+    fNumConnections++;
+    fNumCreated++;
+    theConnection = new HTTPClientConnection(theHost, fPipelining);
+  }
+
+  // connect outside the lock
+  theConnection->attach(inTask, fMaxResponseSize);
+  OS_Error theErr = theConnection->fSocket.Open();
+  if (theErr == OS_NoErr) {
+    theConnection->fSocket.NoDelay();
+    theErr = theConnection->fSocket.ConnectAsync(inAddr, inPort,
+                                                 fConnectTimeoutInMilSecs);
+  }
+
+  if ((theErr != OS_NoErr) && (theErr != EINPROGRESS)) {
+    Core::MutexLocker locker(&fMutex);
+    this->close(theConnection);
+    return theErr;
+  }
+
+  *outConnection = theConnection;
+  return theErr;
+}
+
+void HTTPClientPool::SetMaxResponseSize(UInt32 inMaxSize) {
+  if (inMaxSize == 0)
+    inMaxSize = kDefaultMaxResponseSize;
+  if (inMaxSize > kMaxResponseSize)
+    inMaxSize = kMaxResponseSize;
+  fMaxResponseSize = inMaxSize;
+}
+
+void HTTPClientPool::Release(HTTPClientConnection *inConnection) {
+  Assert(inConnection != nullptr);
+
+  bool isReusable = inConnection->isReusable()
+      && ((fMaxRequestsPerConnection == 0)
+          || (inConnection->fNumRequests < fMaxRequestsPerConnection));
+  inConnection->detach();
+
+  Core::MutexLocker locker(&fMutex);
+  HTTPClientHost *theHost = inConnection->fHost;
+  if (!isReusable || fMaxIdlePerHost == 0) {
+    this->close(inConnection);
+    return;
+  }
+
+  // at the limit the oldest idle connection goes, it is the one the server
+  // is the most likely to time out
+  if (theHost->fIdle.GetLength() >= fMaxIdlePerHost) {
+    fNumIdle--;
+    this->close((HTTPClientConnection *) theHost->fIdle.DeQueue()->GetEnclosingObject());
+  }
+
+  inConnection->fIdleSince = Core::Time::Milliseconds();
+  theHost->fIdle.EnQueue(&inConnection->fElem);
+  fNumIdle++;
+}
+
+UInt32 HTTPClientPool::EvictIdle() {
+  Core::MutexLocker locker(&fMutex);
+
+  // hosts are removed with their last connection, collect the victims
+  // before closing them so the iteration stays valid
+  Queue theEvicted;
+  SInt64 theNow = Core::Time::Milliseconds();
+  for (OpenHashTableIter<HTTPClientHost, HTTPClientHostKey> theIter(&fHosts);
+       !theIter.IsDone(); theIter.Next()) {
+    Queue *theIdle = &theIter.GetCurrent()->fIdle;
+    QueueIter theIdleIter(theIdle);
+    while (!theIdleIter.IsDone()) {
+      QueueElem *theElem = theIdleIter.GetCurrent();
+      theIdleIter.Next();
+
+      auto *theConnection = (HTTPClientConnection *) theElem->GetEnclosingObject();
+      if (this->isExpired(theConnection, theNow) || !theConnection->isHealthy()) {
+        theIdle->Remove(theElem);
+        theEvicted.EnQueue(theElem);
+      }
+    }
+  }
+
+  UInt32 theNumEvicted = theEvicted.GetLength();
+  fNumIdle -= theNumEvicted;
+  while (theEvicted.GetLength() > 0)
+    this->close((HTTPClientConnection *) theEvicted.DeQueue()->GetEnclosingObject());
+  return theNumEvicted;
+}
@@ -0,0 +1,60 @@
+/*
+    File:       HTTPCompletion.cpp
+
+    Contains:   Implementation of HTTPCompletion.
+
+*/
+
+#include <CF/Net/Http/HTTPCompletion.h>
+
+using namespace CF::Net;
+
+HTTPCompletion::HTTPCompletion(Thread::Task *inSession, SInt64 inTimeoutInMs)
+    : fMutex(),
+      fSession(inSession),
+      fTimeoutInMs(inTimeoutInMs),
+      fCompleted(false),
+      fResult(CF_NoErr),
+      fRefCount(2) {}
+
+bool HTTPCompletion::Lock() {
+  fMutex.Lock();
+  return (fSession != nullptr) && !fCompleted;
+}
+
+void HTTPCompletion::Complete(CF_Error inResult) {
+  {
+    Core::MutexLocker locker(&fMutex);
+    if (fSession != nullptr && !fCompleted) {
+      fCompleted = true;
+      fResult = inResult;
+      // under fMutex, the session can't detach and go away meanwhile
+      fSession->Signal(Thread::Task::kUpdateEvent);
+    }
+  }
+  this->release();
+}
+
+bool HTTPCompletion::poll(bool inGiveUp, CF_Error *outResult) {
+  Core::MutexLocker locker(&fMutex);
+  if (fCompleted) {
+    *outResult = fResult;
+    return true;
+  }
+  if (inGiveUp)
+    fSession = nullptr;
+  return false;
+}
+
+void HTTPCompletion::detach() {
+  {
+    Core::MutexLocker locker(&fMutex);
+    fSession = nullptr;
+  }
+  this->release();
+}
+
+void HTTPCompletion::release() {
+  if (--fRefCount == 0)
+    delete this;
+}
@@ -2,82 +2,546 @@
 // Created by james on 8/26/17.
 //
 
+#include <string.h>
+#include <CF/Arena.h>
 #include <CF/Net/Http/HTTPDispatcher.h>
 
 namespace CF {
 namespace Net {
 
-StrPtrLen HTTPPathMapper::sAllSuffix("/*", 2);
-StrPtrLen HTTPPathMapper::sTypePrefix("*.", 2);
-StrPtrLen HTTPPathMapper::sRootPath("/", 1);
+namespace {
 
-int cmp_mapper(const void *a, const void *b) {
-  return HTTPPathMapper::ComparePriority(*(HTTPPathMapper **) a,
-                                         *(HTTPPathMapper **) b);
+// 四种类型的路由
+enum {
+  kExactRoute = 0,
+  kWildcardRoute = 1,
+  kExtensionRoute = 2,
+  kDefaultRoute = 3
+};
+
+StrPtrLen sAllSuffix("/*", 2);
+StrPtrLen sTypePrefix("*.", 2);
+StrPtrLen sRootPath("/", 1);
+
+struct RouteHandlers {
+  CF_CGIFunction fAny;
+  CF_CGIFunction fMethods[httpNumMethods];
+};
+
+struct RouteNode {
+  StrPtrLen fLabel;         // the bytes after the parent's, empty for fParam
+  char *fIndices;           // the first byte of each child's label
+  RouteNode **fChildren;
+  UInt32 fNumChildren;
+  UInt32 fMaxChildren;
+  RouteNode *fParam;        // {name} child, it ends at the next '/'
+  StrPtrLen fParamName;
+  RouteHandlers *fExact;    // routes ending here
+  RouteHandlers *fWildcard; // routes whose prefix ends here
+};
+
+struct ExtensionRoute {
+  StrPtrLen fExtension;     // ".html"
+  RouteHandlers fHandlers;
+  ExtensionRoute *fNext;
+};
+
+struct RouteSearch {
+  StrPtrLen fPath;
+  HTTPMethod fMethod;
+
+  StrPtrLen fNames[HTTPPacket::kMaxPathParams];
+  StrPtrLen fValues[HTTPPacket::kMaxPathParams];
+  UInt32 fNumParams;
+
+  // the longest wildcard passed, with the parameters before it. Plain
+  // pairs, not StrPtrLen: nothing to construct on each Dispatch, only the
+  // fNumWildcardParams in use are ever written.
+  CF_CGIFunction fWildcard;
+  UInt32 fWildcardLen;
+  struct {
+    char *fName;
+    UInt32 fNameLen;
+    char *fValue;
+    UInt32 fValueLen;
+  } fWildcardParams[HTTPPacket::kMaxPathParams];
+  UInt32 fNumWildcardParams;
+
+  CF_CGIFunction fExact;
+  bool fWrongMethod;  // some route had the path, but not the method
+};
+
+UInt32 getRouteType(StrPtrLen &inPattern) {
+  if (inPattern.Len >= 2) {
+    StrPtrLen lastTwoLetter(inPattern.Ptr + (inPattern.Len - 2), 2);
+    if (sAllSuffix.Equal(lastTwoLetter)) // 以 /* 结尾，wildcard
+      return kWildcardRoute;
+
+    StrPtrLen firstTwoLetter(inPattern.Ptr, 2);
+    if (sTypePrefix.Equal(firstTwoLetter)) // 以 *. 开头，extension
+      return kExtensionRoute;
+  }
+
+  if (sRootPath.Equal(inPattern)) // 只有 /，default
+    return kDefaultRoute;
+
+  // 其它，exact
+  return kExactRoute;
 }
 
-HTTPDispatcher::HTTPDispatcher(HTTPMapping *mapping) {
-  int count;
-  for (count = 0; true; count++) {
-    if (mapping[count].path == nullptr || mapping[count].func == nullptr) break;
+// Each {name} must be a whole segment, there can't be more than
+// kMaxPathParams of them.
+bool isValidTreePattern(StrPtrLen &inPattern) {
+  UInt32 theNumParams = 0;
+  for (UInt32 i = 0; i < inPattern.Len; i++) {
+    if (inPattern.Ptr[i] == '}')
+      return false;
+    if (inPattern.Ptr[i] != '{')
+      continue;
+    if (i > 0 && inPattern.Ptr[i - 1] != '/')
+      return false;
+    UInt32 theEnd = i + 1;
+    while (theEnd < inPattern.Len && inPattern.Ptr[theEnd] != '}') {
+      if (inPattern.Ptr[theEnd] == '{' || inPattern.Ptr[theEnd] == '/')
+        return false;
+      theEnd++;
+    }
+    if (theEnd == inPattern.Len || theEnd == i + 1)
+      return false;
+    if (theEnd + 1 < inPattern.Len && inPattern.Ptr[theEnd + 1] != '/')
+      return false;
+    if (++theNumParams > HTTPPacket::kMaxPathParams)
+      return false;
+    i = theEnd;
   }
+  return true;
+}
 
-  fMappers = new HTTPPathMapper *[count];
-  Assert(fMappers != nullptr);
+// The one for inMethod, or for any method
+CF_CGIFunction getHandler(RouteHandlers *inHandlers, RouteSearch *ioSearch) {
+  if (inHandlers == nullptr)
+    return nullptr;
+  CF_CGIFunction theFunc = nullptr;
+  if (ioSearch->fMethod < httpNumMethods)
+    theFunc = inHandlers->fMethods[ioSearch->fMethod];
+  if (theFunc == nullptr)
+    theFunc = inHandlers->fAny;
+  if (theFunc == nullptr)
+    ioSearch->fWrongMethod = true;
+  return theFunc;
+}
+
+} // namespace
+
+struct HTTPDispatcher::Table {
+  // all the nodes, labels and handlers, freed with the table
+  Arena fArena;
+  RouteNode *fRoot;
+  ExtensionRoute *fExtensions;
+  RouteHandlers *fDefault;
+
+  Table()
+      : fArena(),
+        fRoot(newNode(nullptr, 0)),
+        fExtensions(nullptr),
+        fDefault(nullptr) {}
+
+  RouteNode *newNode(char const *inLabel, UInt32 inLabelLen) {
+    auto *theNode = fArena.New<RouteNode>();
+    ::memset(theNode, 0, sizeof(RouteNode));
+    theNode->fLabel.Set((char *) inLabel, inLabelLen);
+    return theNode;
+  }
 
-  UInt32 index = 0;
-  for (int i = 0; i < count; i++) {
-    HTTPPathMapper *mapper = HTTPPathMapper::BuildPathMatcher(mapping[i]);
-    if (mapper != nullptr)
-      fMappers[index++] = mapper;
+  RouteHandlers *newHandlers() {
+    auto *theHandlers = fArena.New<RouteHandlers>();
+    ::memset(theHandlers, 0, sizeof(RouteHandlers));
+    return theHandlers;
+  }
+
+  void addChild(RouteNode *inParent, RouteNode *inChild) {
+    if (inParent->fNumChildren == inParent->fMaxChildren) {
+      // the old arrays stay in the arena until the table goes
+      UInt32 theMax = (inParent->fMaxChildren == 0) ? 4 : inParent->fMaxChildren * 2;
+      auto *theIndices = (char *) fArena.Alloc(theMax);
+      auto **theChildren = (RouteNode **) fArena.Alloc(theMax * sizeof(RouteNode *));
+      if (inParent->fNumChildren > 0) {
+        ::memcpy(theIndices, inParent->fIndices, inParent->fNumChildren);
+        ::memcpy(theChildren, inParent->fChildren,
+                 inParent->fNumChildren * sizeof(RouteNode *));
+      }
+      inParent->fIndices = theIndices;
+      inParent->fChildren = theChildren;
+      inParent->fMaxChildren = theMax;
+    }
+    inParent->fIndices[inParent->fNumChildren] = inChild->fLabel.Ptr[0];
+    inParent->fChildren[inParent->fNumChildren++] = inChild;
+  }
+
+  // The child whose label starts with inChar
+  static UInt32 findChild(RouteNode *inNode, char inChar) {
+    if (inNode->fNumChildren == 0)
+      return 0;
+    auto *theIndex = (char *) ::memchr(inNode->fIndices, inChar, inNode->fNumChildren);
+    return (theIndex == nullptr) ? inNode->fNumChildren : (UInt32) (theIndex - inNode->fIndices);
+  }
+
+  // The node for inPattern, made as needed
+  RouteNode *insert(char const *inPattern, UInt32 inLen) {
+    RouteNode *theNode = fRoot;
+    UInt32 thePos = 0;
+    while (thePos < inLen) {
+      if (inPattern[thePos] == '{') {
+        auto *theEnd = (char const *) ::memchr(inPattern + thePos, '}', inLen - thePos);
+        StrPtrLen theName((char *) inPattern + thePos + 1,
+                          (UInt32) (theEnd - inPattern) - thePos - 1);
+        if (theNode->fParam == nullptr) {
+          theNode->fParam = this->newNode(nullptr, 0);
+          theNode->fParamName = theName;
+        } else if (!theNode->fParamName.Equal(theName)) {
+          return nullptr;
+        }
+        theNode = theNode->fParam;
+        thePos += theName.Len + 2;
+        continue;
+      }
+
+      UInt32 theRunEnd = thePos;
+      while (theRunEnd < inLen && inPattern[theRunEnd] != '{')
+        theRunEnd++;
+
+      UInt32 theIndex = findChild(theNode, inPattern[thePos]);
+      if (theIndex == theNode->fNumChildren) {
+        RouteNode *theChild = this->newNode(inPattern + thePos, theRunEnd - thePos);
+        this->addChild(theNode, theChild);
+        theNode = theChild;
+        thePos = theRunEnd;
+        continue;
+      }
+
+      RouteNode *theChild = theNode->fChildren[theIndex];
+      UInt32 theCommon = 0;
+      while (theCommon < theChild->fLabel.Len && thePos + theCommon < theRunEnd
+          && theChild->fLabel.Ptr[theCommon] == inPattern[thePos + theCommon])
+        theCommon++;
+
+      if (theCommon < theChild->fLabel.Len) {
+        // split the child where the pattern leaves its label
+        RouteNode *theSplit = this->newNode(theChild->fLabel.Ptr, theCommon);
+        theChild->fLabel.Set(theChild->fLabel.Ptr + theCommon,
+                             theChild->fLabel.Len - theCommon);
+        this->addChild(theSplit, theChild);
+        theNode->fChildren[theIndex] = theSplit;
+        theChild = theSplit;
+      }
+      theNode = theChild;
+      thePos += theCommon;
+    }
+    return theNode;
+  }
+
+  CF_Error Add(Route &inRoute) {
+    StrPtrLen thePattern(inRoute.fPattern);
+    RouteHandlers *theHandlers = nullptr;
+
+    switch (getRouteType(thePattern)) {
+      case kExactRoute:
+      case kWildcardRoute: {
+        bool isWildcard = (getRouteType(thePattern) == kWildcardRoute);
+        if (isWildcard)
+          thePattern.Len -= 2; // xxxxx/*
+        if (!isValidTreePattern(thePattern))
+          return CF_BadArgument;
+        char *theCopy = fArena.CopyString(thePattern.Ptr, thePattern.Len);
+        RouteNode *theNode = this->insert(theCopy, thePattern.Len);
+        if (theNode == nullptr)
+          return CF_BadArgument;
+        RouteHandlers **theSlot = isWildcard ? &theNode->fWildcard : &theNode->fExact;
+        if (*theSlot == nullptr)
+          *theSlot = this->newHandlers();
+        theHandlers = *theSlot;
+        break;
+      }
+
+      case kExtensionRoute: {
+        // *.ext
+        StrPtrLen theExtension(thePattern.Ptr + 1, thePattern.Len - 1);
+        ExtensionRoute *theRoute = fExtensions;
+        while (theRoute != nullptr && !theRoute->fExtension.Equal(theExtension))
+          theRoute = theRoute->fNext;
+        if (theRoute == nullptr) {
+          theRoute = fArena.New<ExtensionRoute>();
+          ::memset(theRoute, 0, sizeof(ExtensionRoute));
+          theRoute->fExtension.Set(fArena.CopyString(theExtension.Ptr, theExtension.Len),
+                                   theExtension.Len);
+          theRoute->fNext = fExtensions;
+          fExtensions = theRoute;
+        }
+        theHandlers = &theRoute->fHandlers;
+        break;
+      }
+
+      default: {
+        if (fDefault == nullptr)
+          fDefault = this->newHandlers();
+        theHandlers = fDefault;
+        break;
+      }
+    }
+
+    if (inRoute.fMethod < httpNumMethods)
+      theHandlers->fMethods[inRoute.fMethod] = inRoute.fFunc;
     else
-      s_printf("error: construct path matcher failed, path: %s",
-               mapping->path);
+      theHandlers->fAny = inRoute.fFunc;
+    return CF_NoErr;
+  }
+
+  // inNode's label ends at inPos of the path. Static children are tried
+  // before the {name} one, going back when they don't lead to a route.
+  bool find(RouteNode *inNode, UInt32 inPos, RouteSearch *ioSearch) {
+    if (inNode->fWildcard != nullptr
+        && (ioSearch->fWildcard == nullptr || inPos > ioSearch->fWildcardLen)) {
+      CF_CGIFunction theFunc = getHandler(inNode->fWildcard, ioSearch);
+      if (theFunc != nullptr) {
+        ioSearch->fWildcard = theFunc;
+        ioSearch->fWildcardLen = inPos;
+        ioSearch->fNumWildcardParams = ioSearch->fNumParams;
+        for (UInt32 i = 0; i < ioSearch->fNumParams; i++) {
+          ioSearch->fWildcardParams[i].fName = ioSearch->fNames[i].Ptr;
+          ioSearch->fWildcardParams[i].fNameLen = ioSearch->fNames[i].Len;
+          ioSearch->fWildcardParams[i].fValue = ioSearch->fValues[i].Ptr;
+          ioSearch->fWildcardParams[i].fValueLen = ioSearch->fValues[i].Len;
+        }
+      }
+    }
+
+    StrPtrLen &thePath = ioSearch->fPath;
+    if (inPos == thePath.Len) {
+      ioSearch->fExact = getHandler(inNode->fExact, ioSearch);
+      return ioSearch->fExact != nullptr;
+    }
+
+    UInt32 theIndex = findChild(inNode, thePath.Ptr[inPos]);
+    if (theIndex < inNode->fNumChildren) {
+      RouteNode *theChild = inNode->fChildren[theIndex];
+      if (thePath.Len - inPos >= theChild->fLabel.Len
+          && ::memcmp(thePath.Ptr + inPos, theChild->fLabel.Ptr, theChild->fLabel.Len) == 0
+          && this->find(theChild, inPos + theChild->fLabel.Len, ioSearch))
+        return true;
+    }
+
+    if (inNode->fParam != nullptr && thePath.Ptr[inPos] != '/') {
+      auto *theSlash = (char *) ::memchr(thePath.Ptr + inPos, '/', thePath.Len - inPos);
+      UInt32 theEnd = (theSlash == nullptr) ? thePath.Len : (UInt32) (theSlash - thePath.Ptr);
+      UInt32 theParam = ioSearch->fNumParams++;
+      ioSearch->fNames[theParam] = inNode->fParamName;
+      ioSearch->fValues[theParam].Set(thePath.Ptr + inPos, theEnd - inPos);
+      if (this->find(inNode->fParam, theEnd, ioSearch))
+        return true;
+      ioSearch->fNumParams--;
+    }
+    return false;
+  }
+
+  // The handler for ioSearch's path and method, nullptr if there is none.
+  // ioSearch then has the parameters of the route.
+  CF_CGIFunction Find(RouteSearch *ioSearch) {
+    ioSearch->fNumParams = 0;
+    ioSearch->fWildcard = nullptr;
+    ioSearch->fWildcardLen = 0;
+    ioSearch->fNumWildcardParams = 0;
+    ioSearch->fWrongMethod = false;
+
+    if (this->find(fRoot, 0, ioSearch))
+      return ioSearch->fExact;
+
+    ioSearch->fNumParams = 0;
+    if (ioSearch->fWildcard != nullptr) {
+      ioSearch->fNumParams = ioSearch->fNumWildcardParams;
+      for (UInt32 i = 0; i < ioSearch->fNumParams; i++) {
+        ioSearch->fNames[i].Set(ioSearch->fWildcardParams[i].fName,
+                                ioSearch->fWildcardParams[i].fNameLen);
+        ioSearch->fValues[i].Set(ioSearch->fWildcardParams[i].fValue,
+                                 ioSearch->fWildcardParams[i].fValueLen);
+      }
+      return ioSearch->fWildcard;
+    }
+
+    StrPtrLen &thePath = ioSearch->fPath;
+    for (ExtensionRoute *theRoute = fExtensions; theRoute != nullptr; theRoute = theRoute->fNext) {
+      StrPtrLen &theExtension = theRoute->fExtension;
+      if (thePath.Len < theExtension.Len)
+        continue;
+      StrPtrLen op(thePath.Ptr + (thePath.Len - theExtension.Len), theExtension.Len);
+      if (!theExtension.Equal(op))
+        continue;
+      CF_CGIFunction theFunc = getHandler(&theRoute->fHandlers, ioSearch);
+      if (theFunc != nullptr)
+        return theFunc;
+    }
+
+    return getHandler(fDefault, ioSearch);
   }
-  fMapperNum = index;
+};
 
-  // sort
-  qsort(fMappers, fMapperNum, sizeof(HTTPPathMapper *), cmp_mapper);
+HTTPDispatcher::HTTPDispatcher(HTTPMapping *mapping)
+    : fRoutes(nullptr),
+      fNumRoutes(0),
+      fMaxRoutes(0),
+      fTable(new Table()),
+      fMutex() {
+  this->SetMapping(mapping);
 }
 
-CF_Error HTTPDispatcher::Dispatch(HTTPPacket &request, HTTPPacket &response) {
+HTTPDispatcher::~HTTPDispatcher() {
+  delete fTable.load();
+  for (UInt32 i = 0; i < fNumRoutes; i++)
+    delete[] fRoutes[i].fPattern;
+  delete[] fRoutes;
+}
 
-  StrPtrLen *requestPath = request.GetRequestRelativeURI();
+CF_Error HTTPDispatcher::Dispatch(HTTPPacket &request, HTTPPacket &response) {
+  RouteSearch theSearch;
+  theSearch.fPath = *request.GetRequestRelativeURI();
+  theSearch.fMethod = request.GetMethod();
 
-  for (UInt32 i = 0; i < fMapperNum; i++) {
-    if (fMappers[i]->Match(*requestPath))
-      return fMappers[i]->Mapping(request, response);
+  CF_CGIFunction theFunc;
+  {
+    Core::RCUReadLocker locker(&fRCU);
+    Table *theTable = fTable.load(std::memory_order_acquire);
+    theFunc = theTable->Find(&theSearch);
+    // the names are copied, they belong to the table. Most routes have no
+    // parameters, and neither has the request then, unless it is dispatched
+    // again.
+    if (theSearch.fNumParams > 0 || request.GetNumPathParams() > 0)
+      request.setPathParams(theSearch.fNames, theSearch.fValues, theSearch.fNumParams);
   }
 
+  if (theFunc != nullptr)
+    return theFunc(request, response);
+
+  if (theSearch.fWrongMethod) {
+    response.SetStatusCode(httpMethodNotAllowed);
+    return CF_NoErr;
+  }
   return CF_FileNotFound;
 }
 
-HTTPPathMapper *HTTPPathMapper::BuildPathMatcher(HTTPMapping &mapping) {
-  size_t len = strlen(mapping.path);
+CF_Error HTTPDispatcher::AddRoute(HTTPMethod inMethod, char const *inPattern,
+                                  CF_CGIFunction inFunc) {
+  if (inPattern == nullptr || inFunc == nullptr)
+    return CF_BadArgument;
 
-  if (len >= 2) {
-    StrPtrLen lastTwoLetter(mapping.path + (len - 2), 2);
-    if (sAllSuffix.Equal(lastTwoLetter)) { // 以 /* 结尾，wildcard
-      return new WildcardPathMapper(mapping);
-    }
+  Core::MutexLocker locker(&fMutex);
+  UInt32 theIndex = this->findRoute(inMethod, inPattern);
+  if (theIndex < fNumRoutes) {
+    fRoutes[theIndex].fFunc = inFunc;
+    return this->publish();
+  }
 
-    StrPtrLen firstTwoLetter(mapping.path, 2);
-    if (sTypePrefix.Equal(firstTwoLetter)) { // 以 *. 开头，extension
-      return new ExtensionPathMapper(mapping);
+  // publish drops it again if it doesn't fit in the tree
+  this->appendRoute(inMethod, inPattern, inFunc);
+  return this->publish();
+}
+
+CF_Error HTTPDispatcher::RemoveRoute(HTTPMethod inMethod, char const *inPattern) {
+  if (inPattern == nullptr)
+    return CF_BadArgument;
+
+  Core::MutexLocker locker(&fMutex);
+  UInt32 theIndex = this->findRoute(inMethod, inPattern);
+  if (theIndex == fNumRoutes)
+    return CF_ValueNotFound;
+
+  this->removeRoute(theIndex);
+  return this->publish();
+}
+
+void HTTPDispatcher::SetMapping(HTTPMapping *mapping) {
+  Core::MutexLocker locker(&fMutex);
+  while (fNumRoutes > 0)
+    this->removeRoute(fNumRoutes - 1);
+
+  for (UInt32 i = 0; mapping[i].path != nullptr && mapping[i].func != nullptr; i++) {
+    char const *thePattern = mapping[i].path;
+    HTTPMethod theMethod = httpIllegalMethod;
+
+    // "GET /path"
+    char const *theSpace = ::strchr(thePattern, ' ');
+    if (theSpace != nullptr) {
+      StrPtrLen theMethodStr((char *) thePattern, (UInt32) (theSpace - thePattern));
+      theMethod = HTTPProtocol::GetMethod(&theMethodStr);
+      if (theMethod == httpIllegalMethod) {
+        s_printf("error: unknown method in path mapping, path: %s\n", thePattern);
+        continue;
+      }
+      thePattern = theSpace + 1;
     }
+
+    // the first of the same route wins
+    if (this->findRoute(theMethod, thePattern) == fNumRoutes)
+      this->appendRoute(theMethod, thePattern, mapping[i].func);
   }
 
-  if (sRootPath.Equal(mapping.path)) { // 只有 /，default
-    return new DefaultPathMapper(mapping);
+  this->publish();
+}
+
+UInt32 HTTPDispatcher::findRoute(HTTPMethod inMethod, char const *inPattern) {
+  UInt32 i = 0;
+  for (; i < fNumRoutes; i++) {
+    if (fRoutes[i].fMethod == inMethod && ::strcmp(fRoutes[i].fPattern, inPattern) == 0)
+      break;
   }
+  return i;
+}
 
-  // 其它，exact
-  return new ExactPathMapper(mapping);
+void HTTPDispatcher::appendRoute(HTTPMethod inMethod, char const *inPattern,
+                                 CF_CGIFunction inFunc) {
+  if (fNumRoutes == fMaxRoutes) {
+    fMaxRoutes = (fMaxRoutes == 0) ? 16 : fMaxRoutes * 2;
+    auto *theRoutes = new Route[fMaxRoutes];
+    if (fNumRoutes > 0)
+      ::memcpy(theRoutes, fRoutes, fNumRoutes * sizeof(Route));
+    delete[] fRoutes;
+    fRoutes = theRoutes;
+  }
+
+  UInt32 theLen = (UInt32) ::strlen(inPattern);
+  Route &theRoute = fRoutes[fNumRoutes++];
+  theRoute.fMethod = inMethod;
+  theRoute.fPattern = new char[theLen + 1];
+  ::memcpy(theRoute.fPattern, inPattern, theLen + 1);
+  theRoute.fFunc = inFunc;
+}
+
+void HTTPDispatcher::removeRoute(UInt32 inIndex) {
+  Assert(inIndex < fNumRoutes);
+  delete[] fRoutes[inIndex].fPattern;
+  fNumRoutes--;
+  ::memmove(&fRoutes[inIndex], &fRoutes[inIndex + 1],
+            (fNumRoutes - inIndex) * sizeof(Route));
 }
 
-int HTTPPathMapper::ComparePriority(HTTPPathMapper *aMapper,
-                                    HTTPPathMapper *bMapper) {
-  return aMapper->ItsType() - bMapper->ItsType();
+CF_Error HTTPDispatcher::publish() {
+  CF_Error theErr = CF_NoErr;
+  auto *theNew = new Table();
+  for (UInt32 i = 0; i < fNumRoutes;) {
+    if (theNew->Add(fRoutes[i]) == CF_NoErr) {
+      i++;
+      continue;
+    }
+    s_printf("error: construct path matcher failed, path: %s\n", fRoutes[i].fPattern);
+    this->removeRoute(i);
+    theErr = CF_BadArgument;
+  }
+
+  Table *theOld = fTable.load(std::memory_order_relaxed);
+  fTable.store(theNew);
+
+  // readers may still walk the old tree
+  fRCU.Synchronize();
+  delete theOld;
+  return theErr;
 }
 
 } // namespace Net
@@ -24,7 +24,7 @@ Thread::Task *HTTPListenerSocket::GetSessionTask(TCPSocket **outSocket) {
 }
 
 bool HTTPListenerSocket::OverMaxConnections(UInt32 buffer) {
-  return false;
+  return HTTPSession::OverMaxConnections(buffer);
 }
 
 } // namespace Net
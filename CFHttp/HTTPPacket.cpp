@@ -24,11 +24,18 @@
  */
 
 #include <CF/Net/Http/HTTPPacket.h>
+#include <CF/Net/Http/HTTPCompletion.h>
+#include <CF/Net/Http/HTTPScanner.h>
 #include <CF/StringTranslator.h>
 #include <CF/DateTranslator.h>
 #include <CF/Core/Thread.h>
 #include <CF/CFEnv.h>
 
+#include <sys/stat.h>
+#if !__Win32__
+#include <unistd.h>
+#endif
+
 namespace CF {
 namespace Net {
 
@@ -71,8 +78,9 @@ UInt8 HTTPPacket::sURLStopConditions[] =
     };
 
 // Constructor for parse a packet header
-HTTPPacket::HTTPPacket(StrPtrLen *packetPtr)
-    : fSvrHeader(CFEnv::GetServerHeader()),
+HTTPPacket::HTTPPacket(StrPtrLen *packetPtr, Arena *inArena)
+    : fArena(inArena),
+      fSvrHeader(CFEnv::GetServerHeader()),
       fPacketHeader(*packetPtr), // 浅拷贝
       fMethod(httpIllegalMethod),
       fVersion(httpIllegalVersion),
@@ -84,18 +92,33 @@ HTTPPacket::HTTPPacket(StrPtrLen *packetPtr)
       fRequestPath(nullptr),
       fQueryString(nullptr),
       fQueryValues(nullptr),
+      fSessionTask(nullptr),
+      fCompletion(nullptr),
+      fNumPathParams(0),
       fStatusCode(httpOK),
       fRequestKeepAlive(false), // Default value when there is no version string
+      fResolvedHeaders(0),
+      fHeaderLines(fInlineHeaderLines),
+      fNumHeaderLines(0),
+      fMaxHeaderLines(kNumInlineHeaderLines),
       fHTTPHeader(nullptr),
       fHTTPHeaderFormatter(nullptr),
       fHTTPBody(nullptr),
+      fBodyInArena(false),
+      fBodyFile(nullptr),
+      fBodyFD(-1),
+      fCloseBodyFD(false),
+      fBodyIsPipe(false),
+      fBodyOffset(0),
+      fBodyLength(0),
       fHTTPType(httpIllegalType) { // 未解析情况下为httpIllegalType
 
 }
 
 // Constructor for creating a new packet
-HTTPPacket::HTTPPacket(HTTPType httpType)
-    : fSvrHeader(CFEnv::GetServerHeader()),
+HTTPPacket::HTTPPacket(HTTPType httpType, Arena *inArena)
+    : fArena(inArena),
+      fSvrHeader(CFEnv::GetServerHeader()),
       fPacketHeader(),
       fMethod(httpIllegalMethod),
       fVersion(httpIllegalVersion),
@@ -107,11 +130,25 @@ HTTPPacket::HTTPPacket(HTTPType httpType)
       fRequestPath(nullptr),
       fQueryString(nullptr),
       fQueryValues(nullptr),
+      fSessionTask(nullptr),
+      fCompletion(nullptr),
+      fNumPathParams(0),
       fStatusCode(httpOK),
       fRequestKeepAlive(false), // Default value when there is no version string
+      fResolvedHeaders(0),
+      fHeaderLines(fInlineHeaderLines),
+      fNumHeaderLines(0),
+      fMaxHeaderLines(kNumInlineHeaderLines),
       fHTTPHeader(nullptr),
       fHTTPHeaderFormatter(nullptr),
       fHTTPBody(nullptr),
+      fBodyInArena(false),
+      fBodyFile(nullptr),
+      fBodyFD(-1),
+      fCloseBodyFD(false),
+      fBodyIsPipe(false),
+      fBodyOffset(0),
+      fBodyLength(0),
       fHTTPType(httpType) {
 
   // We require the response but we allocate memory only when we call
@@ -120,14 +157,84 @@ HTTPPacket::HTTPPacket(HTTPType httpType)
 
 // Destructor
 HTTPPacket::~HTTPPacket() {
-  // delete nullptr is no effect.
+  // delete nullptr is no effect. With fArena only the destructors are run,
+  // the memory goes back when the arena is reset.
+
+  this->destroy(fHTTPHeader);
+  this->destroy(fHTTPHeaderFormatter);
+  this->deleteString(fRequestPath);
+  this->deleteString(fQueryString);
+  this->destroy(fQueryValues);
+  this->clearPathParams();
+  if (fCompletion != nullptr)
+    fCompletion->detach();
+  if (!fBodyInArena)
+    delete fHTTPBody;
+  clearBodyFile();
+  if (fHeaderLines != fInlineHeaderLines && fArena == nullptr)
+    delete[] fHeaderLines;
+}
+
+char *HTTPPacket::newString(UInt32 inLength) {
+  if (fArena != nullptr)
+    return (char *) fArena->Alloc(inLength);
+  return new char[inLength];
+}
+
+void HTTPPacket::deleteString(char *inString) {
+  if (fArena == nullptr)
+    delete[] inString;
+}
+
+StrPtrLen *HTTPPacket::NewBody(UInt32 inLength) {
+  StrPtrLen *theBody;
+  if (fArena != nullptr)
+    theBody = fArena->New<StrPtrLen>(this->newString(inLength), inLength);
+  else
+    theBody = new StrPtrLenDel(this->newString(inLength), inLength);
+
+  this->SetBody(theBody);
+  fBodyInArena = (fArena != nullptr);
+  return theBody;
+}
+
+void HTTPPacket::SetBodyFile(FileSource *file, UInt64 offset, UInt64 length) {
+  clearBodyFile();
+  if (file == nullptr) return;
+
+  fBodyFile = file;
+  setBodyFD(file->GetFD(), offset, length);
+}
+
+void HTTPPacket::SetBodyFD(int fd, UInt64 offset, UInt64 length, bool closeFD) {
+  clearBodyFile();
+  fCloseBodyFD = closeFD;
+  setBodyFD(fd, offset, length);
+}
+
+void HTTPPacket::setBodyFD(int fd, UInt64 offset, UInt64 length) {
+  fBodyFD = fd;
+  fBodyOffset = offset;
+  fBodyLength = length;
+
+#if !__Win32__
+  struct stat theStat;
+  fBodyIsPipe = (fd != -1) && (::fstat(fd, &theStat) == 0)
+      && S_ISFIFO(theStat.st_mode);
+#endif
+}
 
-  delete fHTTPHeader;
-  delete fHTTPHeaderFormatter;
-  delete[] fRequestPath;
-  delete[] fQueryString;
-  delete fQueryValues;
-  delete fHTTPBody;
+void HTTPPacket::clearBodyFile() {
+  if (fCloseBodyFD && fBodyFD != -1)
+    ::close(fBodyFD);
+  delete fBodyFile;
+
+  fBodyFile = nullptr;
+  fBodyFD = -1;
+  fCloseBodyFD = false;
+  fBodyIsPipe = false;
+  fBodyOffset = 0;
+  fBodyLength = 0;
 }
 
 // Parses the request
@@ -137,8 +244,8 @@ CF_Error HTTPPacket::Parse() {
 
   // Store the request line (used for logging)
   // (ex: GET /index.html HTTP/1.0)
-  StringParser requestLineParser(&fPacketHeader);
-  requestLineParser.ConsumeUntil(&fRequestLine, StringParser::sEOLMask);
+  HTTPScanner theLineScanner(fPacketHeader.Ptr, fPacketHeader.Len, HTTPScanner::kEOL);
+  fRequestLine.Set(fPacketHeader.Ptr, theLineScanner.Next(0));
 
   // Parse request line returns an error if there is an error in the
   // request URI or the formatting of the request line.
@@ -174,6 +281,7 @@ CF_Error HTTPPacket::parseRequestLine(StringParser *parser) {
     UInt32 statusCode = parser->ConsumeInteger(NULL);
     if (statusCode != 0) {
       fHTTPType = httpResponseType;
+      fStatusCode = HTTPProtocol::GetStatusCodeEnum(statusCode);
 
       parser->ConsumeWhitespace();
       parser->ConsumeUntilWhitespace(NULL);
@@ -248,20 +356,16 @@ CF_Error HTTPPacket::parseURI(StringParser *parser) {
       parser->ConsumeUntilWhitespace(&queryString);
 
       if (queryString.Len) {
-        if (fQueryString != NULL) {
-          delete[] fQueryString;
-          fQueryString = NULL;
-        }
-
-        fQueryString = new char[queryString.Len + 1];
+        this->deleteString(fQueryString);
+        fQueryString = this->newString(queryString.Len + 1);
         ::memcpy(fQueryString, queryString.Ptr, queryString.Len);
         fQueryString[queryString.Len] = '\0';
       }
     }
   }
 
-  delete fQueryValues;
-  fQueryValues = new QueryParamList(fQueryString);
+  this->destroy(fQueryValues);
+  fQueryValues = nullptr;
 
   // whatever is in this position is the relative URI
   StrPtrLen relativeURI(urlParser.GetCurrentPosition(),
@@ -270,81 +374,83 @@ CF_Error HTTPPacket::parseURI(StringParser *parser) {
   // read this URI into fRequestRelURI
   fRelativeURI = relativeURI;
 
-  // Allocate memory for fRequestPath
+  // Allocate memory for fRequestPath, the URI is decoded in place
   UInt32 len = fRelativeURI.Len;
   len++;
-  //char* relativeURIDecoded = new char[len];
-  char relativeURIDecoded[512] = {0};
+  this->deleteString(fRequestPath);
+  fRequestPath = this->newString(len);
 
   SInt32 theBytesWritten =
       StringTranslator::DecodeURL(fRelativeURI.Ptr, fRelativeURI.Len,
-                                  relativeURIDecoded, len);
+                                  fRequestPath, len);
 
   //if negative, an error occurred, reported as an CF_Error
   //we also need to leave room for a terminator.
   if ((theBytesWritten < 0) || (static_cast<UInt32>(theBytesWritten) == len)) {
+    fRequestPath[0] = '\0';
     fStatusCode = httpBadRequest;
     return CF_BadArgument;
   }
 
-  if (fRequestPath != NULL)
-    delete[] fRequestPath;
-
-  fRequestPath = NULL;
-
-  fRequestPath = new char[theBytesWritten + 1];
-  ::memcpy(fRequestPath, relativeURIDecoded + 1, theBytesWritten);
-  //delete relativeURIDecoded;
-  fRequestPath[theBytesWritten] = '\0';
+  // without the leading '/'
+  if (theBytesWritten > 0)
+    ::memmove(fRequestPath, fRequestPath + 1, theBytesWritten - 1);
+  fRequestPath[theBytesWritten > 0 ? theBytesWritten - 1 : 0] = '\0';
 
   return CF_NoErr;
 }
 
 // Parses the Connection header and makes sure that request is properly terminated
 CF_Error HTTPPacket::parseHeaders(StringParser *parser) {
-  StrPtrLen theKeyWord;
-  bool isStreamOK;
-
-  //Repeat until we get a \r\n\r\n, which signals the end of the headers
-  while ((parser->PeekFast() != '\r') && (parser->PeekFast() != '\n')) {
+  // One pass over the header for the ':' of each field and the end of each
+  // line, the values are left where they are.
+  char *theHeader = parser->GetCurrentPosition();
+  UInt32 theLength = parser->GetDataRemaining();
+  HTTPScanner theScanner(theHeader, theLength, HTTPScanner::kHeader);
+
+  UInt32 theHeaderOffset = (UInt32) (theHeader - fPacketHeader.Ptr);
+  fNumHeaderLines = 0;
+  fResolvedHeaders = 0;
+
+  //Repeat until we get an empty line, which signals the end of the headers
+  UInt32 theLineStart = 0;
+  while ((theLineStart < theLength) && (theHeader[theLineStart] != '\r')
+      && (theHeader[theLineStart] != '\n')) {
     //First get the header identifier
-
-    isStreamOK = parser->GetThru(&theKeyWord, ':');
-    if (!isStreamOK) {       // No colon after header!
+    UInt32 theColon = theScanner.Next(theLineStart);
+    if ((theColon == theLength) || (theHeader[theColon] != ':')) {
+      // No colon after header!
       fStatusCode = httpBadRequest;
       return CF_BadArgument;
     }
 
-    if (parser->PeekFast() == ' ') {        // handle space, if any
-      isStreamOK = parser->Expect(' ');
-      Assert(isStreamOK);
-    }
-
-    //Look up the proper header enumeration based on the header string.
-    HTTPHeader theHeader = HTTPProtocol::GetHeader(&theKeyWord);
+    UInt32 theValueStart = theColon + 1;
+    if ((theValueStart < theLength) && (theHeader[theValueStart] == ' '))
+      theValueStart++;                      // handle space, if any
 
-    StrPtrLen theHeaderVal;
-    isStreamOK = parser->GetThruEOL(&theHeaderVal);
-
-    if (!isStreamOK) {       // No EOL after header!
+    // a ':' in the value is part of it
+    UInt32 theEOL = theScanner.Next(theValueStart);
+    while ((theEOL < theLength) && (theHeader[theEOL] == ':'))
+      theEOL = theScanner.Next(theEOL + 1);
+    if (theEOL == theLength) {              // No EOL after header!
       fStatusCode = httpBadRequest;
       return CF_BadArgument;
     }
 
-    // If this is the connection header
-    if (theHeader == httpConnectionHeader) {
-      // Set the keep alive boolean based on the connection header value
-      setKeepAlive(&theHeaderVal);
-    }
-
-    // Have the header field and the value; Add value to the array
-    // If the field is invalid (or unrecognized) just skip over gracefully
-    if (theHeader != httpIllegalHeader)
-      fFieldValues[theHeader] = theHeaderVal;
+    // Most handlers read a few headers only, the names are matched to an
+    // HTTPHeader when one of them is first asked for
+    this->addHeaderLine(theHeaderOffset + theLineStart, theColon - theLineStart,
+                        theHeaderOffset + theValueStart, theEOL - theValueStart);
 
+    // \r\n, \n or \r
+    theLineStart = theEOL + 1;
+    if ((theHeader[theEOL] == '\r') && (theLineStart < theLength)
+        && (theHeader[theLineStart] == '\n'))
+      theLineStart++;
   }
 
-  isStreamOK = parser->ExpectEOL();
+  parser->ConsumeLength(nullptr, theLineStart);
+  bool isStreamOK = parser->ExpectEOL();
   Assert(isStreamOK);
 
   return CF_NoErr;
@@ -361,13 +467,121 @@ void HTTPPacket::setKeepAlive(StrPtrLen *keepAliveValue) {
 }
 
 char const *HTTPPacket::GetQueryValues(char *inParam) {
+  if (fQueryValues == nullptr) {
+    if (fArena != nullptr)
+      fQueryValues = fArena->New<QueryParamList>(fQueryString, fArena);
+    else
+      fQueryValues = new QueryParamList(fQueryString);
+  }
   return fQueryValues->DoFindCGIValueForParam(inParam);
 }
 
+HTTPCompletion *HTTPPacket::Defer(SInt64 inTimeoutInMs) {
+  if (fSessionTask == nullptr)
+    return nullptr;
+  if (fCompletion == nullptr)
+    fCompletion = new HTTPCompletion(fSessionTask, inTimeoutInMs);
+  return fCompletion;
+}
+
+StrPtrLen *HTTPPacket::GetPathParam(char const *inName) {
+  for (UInt32 i = 0; i < fNumPathParams; i++) {
+    if (fPathParamNames[i].Equal(inName))
+      return &fPathParamValues[i];
+  }
+  return nullptr;
+}
+
+void HTTPPacket::setPathParams(StrPtrLen *inNames, StrPtrLen *inValues,
+                               UInt32 inNum) {
+  Assert(inNum <= kMaxPathParams);
+  this->clearPathParams();
+  for (UInt32 i = 0; i < inNum; i++) {
+    char *theName = this->newString(inNames[i].Len + 1);
+    ::memcpy(theName, inNames[i].Ptr, inNames[i].Len);
+    theName[inNames[i].Len] = '\0';
+    fPathParamNames[i].Set(theName, inNames[i].Len);
+    fPathParamValues[i] = inValues[i];
+  }
+  fNumPathParams = inNum;
+}
+
+void HTTPPacket::clearPathParams() {
+  for (UInt32 i = 0; i < fNumPathParams; i++)
+    this->deleteString(fPathParamNames[i].Ptr);
+  fNumPathParams = 0;
+}
+
+void HTTPPacket::addHeaderLine(UInt32 inNameOffset, UInt32 inNameLen,
+                               UInt32 inValueOffset, UInt32 inValueLen) {
+  if (fNumHeaderLines == fMaxHeaderLines) {
+    HeaderLine *theLines;
+    if (fArena != nullptr)
+      theLines = (HeaderLine *) fArena->Alloc(sizeof(HeaderLine) * fMaxHeaderLines * 2);
+    else
+      theLines = new HeaderLine[fMaxHeaderLines * 2];
+    ::memcpy(theLines, fHeaderLines, sizeof(HeaderLine) * fNumHeaderLines);
+    if (fHeaderLines != fInlineHeaderLines && fArena == nullptr)
+      delete[] fHeaderLines;
+    fHeaderLines = theLines;
+    fMaxHeaderLines *= 2;
+  }
+
+  HeaderLine *theLine = &fHeaderLines[fNumHeaderLines++];
+  theLine->fNameOffset = inNameOffset;
+  theLine->fNameLen = inNameLen;
+  theLine->fValueOffset = inValueOffset;
+  theLine->fValueLen = inValueLen;
+  theLine->fHeader = httpIllegalHeader;
+}
+
+void HTTPPacket::classifyHeaderLines() {
+  for (UInt32 i = 0; i < fNumHeaderLines; i++) {
+    HeaderLine *theLine = &fHeaderLines[i];
+    StrPtrLen theName(fPacketHeader.Ptr + theLine->fNameOffset, theLine->fNameLen);
+    theLine->fHeader = HTTPProtocol::GetHeader(&theName);
+  }
+}
+
+void HTTPPacket::resolveHeader(HTTPHeader inHeader) {
+  static_assert(httpNumHeaders <= 64, "fResolvedHeaders has a bit per header");
+  // no lookup since the parse yet, hash every name once
+  if (fResolvedHeaders == 0)
+    this->classifyHeaderLines();
+  fResolvedHeaders |= (UInt64) 1 << inHeader;
+
+  // the last line with this name wins
+  for (UInt32 i = fNumHeaderLines; i > 0; i--) {
+    HeaderLine *theLine = &fHeaderLines[i - 1];
+    if (theLine->fHeader != inHeader)
+      continue;
+
+    fFieldValues[inHeader].Set(fPacketHeader.Ptr + theLine->fValueOffset,
+                               theLine->fValueLen);
+    // Set the keep alive boolean based on the connection header value
+    if (inHeader == httpConnectionHeader)
+      setKeepAlive(&fFieldValues[inHeader]);
+    break;
+  }
+}
+
 StrPtrLen *HTTPPacket::GetHeaderValue(HTTPHeader inHeader) {
-  if (inHeader != httpIllegalHeader)
-    return &fFieldValues[inHeader];
-  return NULL;
+  if (inHeader == httpIllegalHeader)
+    return NULL;
+  if ((fResolvedHeaders & ((UInt64) 1 << inHeader)) == 0)
+    this->resolveHeader(inHeader);
+  return &fFieldValues[inHeader];
+}
+
+bool HTTPPacket::IsRequestKeepAlive() {
+  this->GetHeaderValue(httpConnectionHeader);
+  return fRequestKeepAlive;
+}
+
+void HTTPPacket::SetRequestKeepAlive(bool inKeepAlive) {
+  // resolve the header first, so it can't override this later
+  this->GetHeaderValue(httpConnectionHeader);
+  fRequestKeepAlive = inKeepAlive;
 }
 
 void HTTPPacket::putStatusLine(StringFormatter *putStream,
@@ -392,19 +606,30 @@ void HTTPPacket::putMethedLine(StringFormatter *putStream,
   putStream->PutEOL();
 }
 
-bool HTTPPacket::CreateResponseHeader() {
-  if (fHTTPType != httpResponseType) return false;
-
+void HTTPPacket::newHeader() {
   // If we are creating a second response for the same request, make sure and
   // deallocate memory for old response and allocate fresh memory
-  delete fHTTPHeader;
-  delete fHTTPHeaderFormatter;
+  this->destroy(fHTTPHeader);
+  this->destroy(fHTTPHeaderFormatter);
+
+  // Allocate memory for the response when you first create it. A header
+  // that outgrows it moves to the heap.
+  char *responseString = this->newString(kMinHeaderSizeInBytes);
+  if (fArena != nullptr) {
+    fHTTPHeader = fArena->New<StrPtrLen>(responseString, kMinHeaderSizeInBytes);
+    fHTTPHeaderFormatter = fArena->New<ResizeableStringFormatter>(
+        fHTTPHeader->Ptr, fHTTPHeader->Len);
+  } else {
+    fHTTPHeader = new StrPtrLenDel(responseString, kMinHeaderSizeInBytes);
+    fHTTPHeaderFormatter =
+        new ResizeableStringFormatter(fHTTPHeader->Ptr, fHTTPHeader->Len);
+  }
+}
+
+bool HTTPPacket::CreateResponseHeader() {
+  if (fHTTPType != httpResponseType) return false;
 
-  // Allocate memory for the response when you first create it
-  char *responseString = new char[kMinHeaderSizeInBytes];
-  fHTTPHeader = new StrPtrLenDel(responseString, kMinHeaderSizeInBytes);
-  fHTTPHeaderFormatter =
-      new ResizeableStringFormatter(fHTTPHeader->Ptr, fHTTPHeader->Len);
+  this->newHeader();
 
   // make a partial header for the given version and status code
   putStatusLine(fHTTPHeaderFormatter, fStatusCode, fVersion);
@@ -423,16 +648,7 @@ bool HTTPPacket::CreateResponseHeader() {
 bool HTTPPacket::CreateRequestHeader() {
   if (fHTTPType != httpRequestType) return false;
 
-  // If we are creating a second response for the same request, make sure and
-  // deallocate memory for old response and allocate fresh memory
-  delete fHTTPHeader;
-  delete fHTTPHeaderFormatter;
-
-  // Allocate memory for the response when you first create it
-  char *responseString = new char[kMinHeaderSizeInBytes];
-  fHTTPHeader = new StrPtrLenDel(responseString, kMinHeaderSizeInBytes);
-  fHTTPHeaderFormatter =
-      new ResizeableStringFormatter(fHTTPHeader->Ptr, fHTTPHeader->Len);
+  this->newHeader();
 
   //make a partial header for the given version and status code
   putMethedLine(fHTTPHeaderFormatter, fMethod, fVersion);
@@ -447,7 +663,9 @@ bool HTTPPacket::CreateRequestHeader() {
 StrPtrLen *HTTPPacket::GetCompleteHTTPHeader() const {
   fHTTPHeaderFormatter->PutEOL();
   fHTTPHeader->Len = fHTTPHeaderFormatter->GetCurrentOffset();
-  return fHTTPHeader;
+  fCompleteHTTPHeader.Set(fHTTPHeaderFormatter->GetBufPtr(),
+                          fHTTPHeaderFormatter->GetCurrentOffset());
+  return &fCompleteHTTPHeader;
 }
 
 void HTTPPacket::AppendResponseHeader(HTTPHeader inHeader,
@@ -507,7 +725,7 @@ void HTTPPacket::AppendDateField() const {
 
 time_t HTTPPacket::ParseIfModSinceHeader() {
   time_t theIfModSinceDate = static_cast<time_t>(
-      DateTranslator::ParseDate(&fFieldValues[httpIfModifiedSinceHeader]));
+      DateTranslator::ParseDate(this->GetHeaderValue(httpIfModifiedSinceHeader)));
   return theIfModSinceDate;
 }
 
@@ -145,55 +145,54 @@ const StrPtrLen HTTPProtocol::sHeaders[] = {
     StrPtrLen(" ,")
 };
 
+// Perfect hash of the header names: with the case folded, every name in
+// sHeaders gets a slot of its own, so a lookup is one hash, one table read
+// and one compare. The coefficients were searched for offline, they have
+// to be searched for again when a header is added.
+static_assert(httpNumHeaders == 51, "sHeaderSlots must be regenerated");
+
+enum {
+  kNumHeaderSlots = 128   // UInt32, a power of 2
+};
+
+static inline UInt32 hashHeader(char const *inName, UInt32 inLen) {
+  // | 0x20 folds the case of letters, and leaves '-' and digits alone
+  return (inLen
+      + 22 * (UInt32) ((UInt8) inName[0] | 0x20)
+      + 24 * (UInt32) ((UInt8) inName[inLen - 1] | 0x20)
+      + 28 * (UInt32) ((UInt8) inName[inLen / 2] | 0x20))
+      & (kNumHeaderSlots - 1);
+}
+
+// the HTTPHeader of each slot, httpIllegalHeader for the empty ones
+static const UInt8 sHeaderSlots[kNumHeaderSlots] = {
+     4, 51,  9,  8, 51, 12, 51, 51,  //0-7
+    51, 51, 36,  3, 51, 44, 51, 29,  //8-15
+    51, 49, 51, 51, 31, 33, 51, 32,  //16-23
+    16, 17, 51, 51, 51, 11, 51, 51,  //24-31
+    19, 51, 24, 51, 20, 51, 51, 48,  //32-39
+    51, 51, 26, 10, 51, 18, 51,  2,  //40-47
+     0, 51, 43, 51, 50, 51, 46, 45,  //48-55
+    51, 25, 51, 13, 42, 51, 51, 51,  //56-63
+    51, 51, 51, 51,  1, 51, 40, 51,  //64-71
+    15, 51, 51, 51, 51, 51,  5, 51,  //72-79
+    35, 28, 51, 39, 51, 51, 51, 51,  //80-87
+    51,  7, 41, 51, 51, 51, 51, 23,  //88-95
+    51, 51, 51, 27, 51, 51, 51, 51,  //96-103
+    21, 51, 22, 51, 51, 51, 51, 51,  //104-111
+    51, 14, 51, 37, 51, 51, 34, 51,  //112-119
+    38,  6, 51, 47, 51, 51, 30, 51   //120-127
+};
+
 HTTPHeader HTTPProtocol::GetHeader(const StrPtrLen *inHeaderStr) {
   if (inHeaderStr->Len == 0)
     return httpIllegalHeader;
 
-  HTTPHeader theHeader = httpIllegalHeader;
-
-  //chances are this is one of our selected "VIP" headers. so check for this.
-  switch ((inHeaderStr->Ptr)[0]) {
-    case 'C':
-    case 'c': theHeader = httpConnectionHeader;
-      break;
-    case 'S':
-    case 's': theHeader = httpServerHeader;
-      break;
-    case 'D':
-    case 'd': theHeader = httpDateHeader;
-      break;
-    case 'A':
-    case 'a': theHeader = httpAuthorizationHeader;
-      break;
-    case 'W':
-    case 'w': theHeader = httpWWWAuthenticateHeader;
-      break;
-    case 'I':
-    case 'i': theHeader = httpIfModifiedSinceHeader;
-      break;
-    case 'E':
-    case 'e': theHeader = httpExpiresHeader;
-      break;
-    case 'L':
-    case 'l': theHeader = httpLastModifiedHeader;
-      break;
-      // Added this to optimize for HTTP tunnelling in the server (Not really a VIP header)
-    case 'X':
-    case 'x': theHeader = httpSessionCookieHeader;
-      break;
-    default: break;
-  }
-
+  UInt8 theHeader = sHeaderSlots[hashHeader(inHeaderStr->Ptr, inHeaderStr->Len)];
   if ((theHeader != httpIllegalHeader) &&
       (inHeaderStr->EqualIgnoreCase(sHeaders[theHeader].Ptr,
                                     sHeaders[theHeader].Len)))
-    return theHeader;
-
-  //If this isn't one of our VIP headers, go through the remaining request headers, trying
-  //to find the right one.
-  for (SInt32 x = httpNumVIPHeaders; x < httpNumHeaders; x++)
-    if (inHeaderStr->EqualIgnoreCase(sHeaders[x].Ptr, sHeaders[x].Len))
-      return (HTTPHeader) x;
+    return (HTTPHeader) theHeader;
   return httpIllegalHeader;
 }
 
@@ -232,6 +231,7 @@ const StrPtrLen HTTPProtocol::sStatusCodeStrings[] = {
     StrPtrLen("Unsupported Media Type"),        //kUnsupportedMediaType
     StrPtrLen("Request Range Not Satisfiable"), //kRequestRangeNotSatisfiable
     StrPtrLen("Expectation Failed"),            //kExpectationFailed
+    StrPtrLen("Request Header Fields Too Large"), //kRequestHeaderFieldsTooLarge
     StrPtrLen("Internal Server Error"),         //kInternalServerError
     StrPtrLen("Not Implemented"),               //kNotImplemented
     StrPtrLen("Bad Gateway"),                   //kBadGateway
@@ -275,6 +275,7 @@ const SInt32 HTTPProtocol::sStatusCodes[] = {
     415,            //kUnsupportedMediaType
     416,            //kRequestRangeNotSatisfiable
     417,            //kExpectationFailed
+    431,            //kRequestHeaderFieldsTooLarge
     500,            //kInternalServerError
     501,            //kNotImplemented
     502,            //kBadGateway
@@ -318,6 +319,7 @@ const StrPtrLen HTTPProtocol::sStatusCodeAsStrings[] = {
     StrPtrLen("415"),               //kUnsupportedMediaType
     StrPtrLen("416"),               //kRequestRangeNotSatisfiable
     StrPtrLen("417"),               //kExpectationFailed
+    StrPtrLen("431"),               //kRequestHeaderFieldsTooLarge
     StrPtrLen("500"),               //kInternalServerError
     StrPtrLen("501"),               //kNotImplemented
     StrPtrLen("502"),               //kBadGateway
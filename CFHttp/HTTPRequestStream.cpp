@@ -29,6 +29,7 @@
 */
 
 #include <CF/Net/Http/HTTPRequestStream.h>
+#include <CF/Net/Http/HTTPScanner.h>
 #include <CF/StringParser.h>
 #include <CF/Core/Time.h>
 #include <CF/base64.h>
@@ -37,24 +38,128 @@
 
 using namespace CF::Net;
 
+UInt32 HTTPRequestStream::sMaxRequestSize = HTTPRequestStream::kDefaultMaxRequestSize;
+
 HTTPRequestStream::HTTPRequestStream(TCPSocket *sock)
     : fSocket(sock),
       fRetreatBytes(0),
       fRetreatBytesRead(0),
+      fRequestBuffer(nullptr),
+      fBufferClass(0),
       fCurOffset(0),
+      fHeaderScanned(0),
       fEncodedBytesRemaining(0),
-      fRequest(fRequestBuffer, 0),
+      fRequest(nullptr, 0),
       fRequestPtr(NULL),
       fDecode(false),
       fPrintRTSP(false) {}
 
+HTTPRequestStream::~HTTPRequestStream() {
+  // We may have to delete this memory if it was allocated due to base64 decoding
+  if (fRequest.Ptr != fRequestBuffer)
+    delete[] fRequest.Ptr;
+  if (fRequestBuffer != nullptr)
+    getBufferPool(fBufferClass)->Put(fRequestBuffer);
+}
+
+static CF::BufferPool **newBufferPools(UInt32 inNumPools, UInt32 inSmallestSize) {
+  auto **thePools = new CF::BufferPool *[inNumPools];
+  for (UInt32 i = 0; i < inNumPools; i++)
+    thePools[i] = new CF::BufferPool(inSmallestSize << i);
+  return thePools;
+}
+
+CF::BufferPool *HTTPRequestStream::getBufferPool(UInt32 inClass) {
+  // one pool per buffer size, never destroyed, sessions may still give
+  // buffers back during exit
+  static CF::BufferPool **sBufferPools =
+      newBufferPools(kNumBufferSizes, kRequestBufferSizeInBytes);
+  Assert(inClass < kNumBufferSizes);
+  return sBufferPools[inClass];
+}
+
+void HTTPRequestStream::SetMaxRequestSize(UInt32 inMaxSize) {
+  if (inMaxSize == 0)
+    inMaxSize = kDefaultMaxRequestSize;
+  if (inMaxSize < kRequestBufferSizeInBytes)
+    inMaxSize = kRequestBufferSizeInBytes;
+  if (inMaxSize > kMaxRequestSize)
+    inMaxSize = kMaxRequestSize;
+  sMaxRequestSize = inMaxSize;
+}
+
+void HTTPRequestStream::getBuffer() {
+  if (fRequestBuffer != nullptr)
+    return;
+
+  fRequestBuffer = (char *) getBufferPool(fBufferClass)->Get();
+  if (fRequest.Ptr == nullptr)
+    fRequest.Ptr = fRequestBuffer;
+}
+
+void HTTPRequestStream::putBuffer() {
+  if ((fRequestBuffer == nullptr) || (fCurOffset > 0) || (fRetreatBytes > 0)
+      || (fRequestPtr != NULL))
+    return;
+
+  if (fRequest.Ptr == fRequestBuffer)
+    fRequest.Ptr = nullptr;
+  getBufferPool(fBufferClass)->Put(fRequestBuffer);
+  fRequestBuffer = nullptr;
+  // the next request starts small again
+  fBufferClass = 0;
+}
+
+bool HTTPRequestStream::makeRoom() {
+  // base64 decoding keeps the decoded request in a buffer of its own, and
+  // the encoded bytes in place, it stays with the first buffer size
+  if (fDecode)
+    return false;
+
+  // pipelined requests before this one, move it to the front
+  if (fRequest.Ptr > fRequestBuffer) {
+    UInt32 theStart = (UInt32) (fRequest.Ptr - fRequestBuffer);
+    ::memmove(fRequestBuffer, fRequest.Ptr, fCurOffset - theStart);
+    fCurOffset -= theStart;
+    fRequest.Ptr = fRequestBuffer;
+    return true;
+  }
+
+  if ((bufferSize(fBufferClass) >= sMaxRequestSize)
+      || (fBufferClass + 1 >= kNumBufferSizes))
+    return false;
+
+  char *theBuffer = (char *) getBufferPool(fBufferClass + 1)->Get();
+  ::memcpy(theBuffer, fRequestBuffer, fCurOffset);
+  getBufferPool(fBufferClass)->Put(fRequestBuffer);
+  fRequestBuffer = theBuffer;
+  fRequest.Ptr = theBuffer;
+  fBufferClass++;
+  return true;
+}
+
+bool HTTPRequestStream::HasRequestLine() {
+  return (fRequest.Ptr != nullptr) && (fRequest.Len > 0)
+      && (::memchr(fRequest.Ptr, '\n', fRequest.Len) != nullptr);
+}
+
 void HTTPRequestStream::SnarfRetreat(HTTPRequestStream &fromRequest) {
   // Simplest thing to do is to just completely blow away everything in this current
   // stream, and replace it with the retreat bytes from the other stream.
   fRequestPtr = NULL;
-  Assert(fRetreatBytes < kRequestBufferSizeInBytes);
   fRetreatBytes = fromRequest.fRetreatBytes;
-  fEncodedBytesRemaining = fCurOffset = fRequest.Len = 0;
+  fEncodedBytesRemaining = fCurOffset = fRequest.Len = fHeaderScanned = 0;
+
+  // the other stream's buffer may have grown, take one of the same size
+  if ((fRequestBuffer != nullptr) && (fBufferClass != fromRequest.fBufferClass)) {
+    if (fRequest.Ptr == fRequestBuffer)
+      fRequest.Ptr = nullptr;
+    getBufferPool(fBufferClass)->Put(fRequestBuffer);
+    fRequestBuffer = nullptr;
+  }
+  fBufferClass = fromRequest.fBufferClass;
+  Assert(fRetreatBytes < bufferSize(fBufferClass));
+  this->getBuffer();
   ::memcpy(&fRequestBuffer[0],
            fromRequest.fRequest.Ptr + fromRequest.fRequest.Len,
            fromRequest.fRetreatBytes);
@@ -71,41 +176,56 @@ CF_Error HTTPRequestStream::ReadRequest() {
     // part of a new request
     if (fRequestPtr != NULL) {
       fRequestPtr = NULL; // flag that we no longer have a complete request
-
-      // Take all the retreated leftover data and move it to the beginning of the buffer
-      if ((fRetreatBytes > 0) && (fRequest.Len > 0))
-        ::memmove(fRequest.Ptr,
-                  fRequest.Ptr + fRequest.Len + fRetreatBytesRead,
-                  fRetreatBytes);
-
-      // if we are decoding, we need to also move over the remaining encoded bytes
-      // to the right position in the fRequestBuffer
-      if (fEncodedBytesRemaining > 0) {
-        //Assert(fEncodedBytesRemaining < 4);
-
-        // The right position is at fRetreatBytes offset in the request buffer.
-        // The reason for this is:
-        //  1) We need to find a place in the request buffer where we know we
-        //     have enough space to store fEncodedBytesRemaining.
-        //     fRetreatBytes + fEncodedBytesRemaining will always be less than
-        //     kRequestBufferSize because all this data must have been in the
-        //     same request buffer, together, at one point.
-        //  2) We need to make sure that there is always more data in the
-        //     RequestBuffer than in the decoded request buffer, otherwise we
-        //     could overrun the decoded request buffer (we bounds check on the
-        //     encoded buffer, not the decoded buffer). Leaving fRetreatBytes
-        //     as empty space in the request buffer ensures that this principle
-        //     is maintained.
-        ::memmove(&fRequestBuffer[fRetreatBytes],
-                  &fRequestBuffer[fCurOffset - fEncodedBytesRemaining],
-                  fEncodedBytesRemaining);
-        fCurOffset = fRetreatBytes + fEncodedBytesRemaining;
-        Assert(fCurOffset < kRequestBufferSizeInBytes);
-      } else
-        fCurOffset = fRetreatBytes;
-
-      newOffset = fRequest.Len = fRetreatBytes;
-      fRetreatBytes = fRetreatBytesRead = 0;
+      fHeaderScanned = 0;
+
+      if (!fDecode) {
+        // The next request starts right after this one and its body, leave
+        // it where it is. Nothing left, start over at the beginning of the
+        // buffer.
+        if (fRetreatBytes > 0)
+          fRequest.Ptr += fRequest.Len + fRetreatBytesRead;
+        else {
+          fRequest.Ptr = fRequestBuffer;
+          fCurOffset = 0;
+        }
+        newOffset = fRequest.Len = fRetreatBytes;
+        fRetreatBytes = fRetreatBytesRead = 0;
+      } else {
+        // Take all the retreated leftover data and move it to the beginning of the buffer
+        if ((fRetreatBytes > 0) && (fRequest.Len > 0))
+          ::memmove(fRequest.Ptr,
+                    fRequest.Ptr + fRequest.Len + fRetreatBytesRead,
+                    fRetreatBytes);
+
+        // if we are decoding, we need to also move over the remaining encoded bytes
+        // to the right position in the fRequestBuffer
+        if (fEncodedBytesRemaining > 0) {
+          //Assert(fEncodedBytesRemaining < 4);
+
+          // The right position is at fRetreatBytes offset in the request buffer.
+          // The reason for this is:
+          //  1) We need to find a place in the request buffer where we know we
+          //     have enough space to store fEncodedBytesRemaining.
+          //     fRetreatBytes + fEncodedBytesRemaining will always be less than
+          //     kRequestBufferSize because all this data must have been in the
+          //     same request buffer, together, at one point.
+          //  2) We need to make sure that there is always more data in the
+          //     RequestBuffer than in the decoded request buffer, otherwise we
+          //     could overrun the decoded request buffer (we bounds check on the
+          //     encoded buffer, not the decoded buffer). Leaving fRetreatBytes
+          //     as empty space in the request buffer ensures that this principle
+          //     is maintained.
+          ::memmove(&fRequestBuffer[fRetreatBytes],
+                    &fRequestBuffer[fCurOffset - fEncodedBytesRemaining],
+                    fEncodedBytesRemaining);
+          fCurOffset = fRetreatBytes + fEncodedBytesRemaining;
+          Assert(fCurOffset < bufferSize(fBufferClass));
+        } else
+          fCurOffset = fRetreatBytes;
+
+        newOffset = fRequest.Len = fRetreatBytes;
+        fRetreatBytes = fRetreatBytesRead = 0;
+      }
     }
 
     // We don't have any new data, so try and get some
@@ -121,9 +241,10 @@ CF_Error HTTPRequestStream::ReadRequest() {
       } else {
         // We don't have any new data, get some from the Socket...
         // 注意我们的 Socket 端口是 non blocking
+        this->getBuffer();
         CF_Error sockErr = fSocket->Read(
             &fRequestBuffer[fCurOffset],
-            (kRequestBufferSizeInBytes - fCurOffset) - 1,
+            (bufferSize(fBufferClass) - fCurOffset) - 1,
             &newOffset);
         // assume the client is dead if we get an error back
 #if __WinSock__
@@ -131,7 +252,11 @@ CF_Error HTTPRequestStream::ReadRequest() {
 #else
         if (sockErr == EAGAIN)
 #endif
+        {
+          // nothing buffered, don't hold on to the buffer while idle
+          this->putBuffer();
           return CF_NoErr;
+        }
         if (sockErr != CF_NoErr) {
           Assert(!fSocket->IsConnected());
           return sockErr;
@@ -151,7 +276,7 @@ CF_Error HTTPRequestStream::ReadRequest() {
         if (decodeErr == CF_NoErr) Assert(fEncodedBytesRemaining < 4);
       } else
         fRequest.Len += newOffset;
-      Assert(fRequest.Len < kRequestBufferSizeInBytes);
+      Assert(fRequest.Len < bufferSize(fBufferClass));
       fCurOffset += newOffset;
     }
     Assert(newOffset > 0);
@@ -211,60 +336,92 @@ CF_Error HTTPRequestStream::ReadRequest() {
       str.PrintStrEOL("\n\r\n", "\n");
     }
 
-    // use a StringParser object to search for a double EOL, which signifies
-    // the end of the header.
-    bool weAreDone = false;
-    StringParser headerParser(&fRequest);
-
-    UInt16 lcount = 0;
-    while (headerParser.GetThruEOL(NULL)) {
-      lcount++;
-      if (headerParser.ExpectEOL()) {
-        // The legal end-of-header sequences are \r\r, \r\n\r\n, & \n\n.
-        // NOT \r\n\r!
-        // If the packets arrive just a certain way, we could get here with
-        // the latter combo, and not wait for a final \n.
-        if ((headerParser.GetDataParsedLen() > 2) &&
-            (memcmp(headerParser.GetCurrentPosition() - 3, "\r\n\r", 3) == 0))
-          continue;
-        weAreDone = true;
-        break;
-      } else if (lcount == 1) {
-        // if this request is actually a ShoutCast password it will be
-        // in the form of "xxxxxx\r" where "xxxxx" is the password.
-        // If we get a 1st request line ending in \r with no blanks we will
-        // assume that this is the end of the request.
-        UInt16 flag = 0;
-        UInt16 i = 0;
-        for (i = 0; i < fRequest.Len; i++) {
-          if (fRequest.Ptr[i] == ' ')
-            flag++;
-        }
-        if (flag == 0) {
-          weAreDone = true;
-          break;
-        }
-      }
-    }
+    // search for an empty line, which signifies the end of the header. The
+    // lines found complete by an earlier read aren't gone over again.
+    UInt32 theHeaderLength = 0;
+    bool weAreDone = this->findEndOfHeader(&theHeaderLength);
 
     // weAreDone means we have gotten a full request
     if (weAreDone) {
       // put back any data that is not part of the header
-      fRequest.Len -= headerParser.GetDataRemaining();
-      fRetreatBytes += headerParser.GetDataRemaining();
+      fRetreatBytes += fRequest.Len - theHeaderLength;
+      fRequest.Len = theHeaderLength;
 
       fRequestPtr = &fRequest;
       return CF_RequestArrived;
     }
 
-    // check for a full buffer
-    if (fCurOffset == kRequestBufferSizeInBytes - 1) {
+    // check for a full buffer, make room for more or give up
+    if ((fCurOffset == bufferSize(fBufferClass) - 1) && !this->makeRoom()) {
       fRequestPtr = &fRequest;
       return (CF_Error) E2BIG;
     }
   }
 }
 
+bool HTTPRequestStream::findEndOfHeader(UInt32 *outHeaderLength) {
+  char *theRequest = fRequest.Ptr;
+  UInt32 theLength = fRequest.Len;
+  HTTPScanner theScanner(theRequest, theLength, HTTPScanner::kEOL);
+
+  while (true) {
+    UInt32 theLineStart = fHeaderScanned;
+    UInt32 theEOL = theScanner.Next(theLineStart);
+    if (theEOL == theLength)
+      return false;
+
+    // The legal EOLs are \r\n, \n and \r.
+    UInt32 theNextLine = theEOL + 1;
+    if (theRequest[theEOL] == '\r') {
+      if (theNextLine < theLength) {
+        if (theRequest[theNextLine] == '\n')
+          theNextLine++;
+      } else if ((theLineStart == 0) || (theEOL > theLineStart)) {
+        // the \n may still come, the line isn't complete yet
+        return this->isShoutCast(theLength, outHeaderLength);
+      }
+    }
+
+    if ((theLineStart > 0) && (theEOL == theLineStart)) {
+      // The legal end-of-header sequences are \r\r, \r\n\r\n, & \n\n.
+      // NOT \r\n\r! Wait for the \n, anything else after it starts the
+      // next line.
+      bool theAfterCRLF = (theLineStart >= 2)
+          && (theRequest[theLineStart - 2] == '\r')
+          && (theRequest[theLineStart - 1] == '\n');
+      bool theLoneCR = (theRequest[theEOL] == '\r') && (theNextLine == theEOL + 1);
+      if (!theAfterCRLF || !theLoneCR) {
+        *outHeaderLength = theNextLine;
+        return true;
+      }
+      if (theNextLine == theLength)
+        return false;
+      fHeaderScanned = theNextLine;
+      continue;
+    }
+
+    // a first line of its own
+    if ((theLineStart == 0)
+        && ((theNextLine == theLength)
+            || ((theRequest[theNextLine] != '\r') && (theRequest[theNextLine] != '\n')))
+        && this->isShoutCast(theNextLine, outHeaderLength))
+      return true;
+    fHeaderScanned = theNextLine;
+  }
+}
+
+bool HTTPRequestStream::isShoutCast(UInt32 inLineEnd, UInt32 *outHeaderLength) {
+  // if this request is actually a ShoutCast password it will be
+  // in the form of "xxxxxx\r" where "xxxxx" is the password.
+  // If we get a 1st request line ending in \r with no blanks we will
+  // assume that this is the end of the request.
+  if ((fHeaderScanned != 0)
+      || (::memchr(fRequest.Ptr, ' ', fRequest.Len) != nullptr))
+    return false;
+  *outHeaderLength = inLineEnd;
+  return true;
+}
+
 CF_Error HTTPRequestStream::Read(void *ioBuffer,
                                  UInt32 inBufLen,
                                  UInt32 *outLengthRead) {
@@ -320,8 +477,8 @@ CF_Error HTTPRequestStream::DecodeIncomingData(char *inSrcData,
                                                UInt32 inSrcDataLen) {
   Assert(fRetreatBytes == 0);
 
-  if (fRequest.Ptr == &fRequestBuffer[0]) {
-    fRequest.Ptr = new char[kRequestBufferSizeInBytes];
+  if (fRequest.Ptr == fRequestBuffer) {
+    fRequest.Ptr = new char[bufferSize(fBufferClass)];
     fRequest.Len = 0;
   }
 
@@ -364,7 +521,7 @@ CF_Error HTTPRequestStream::DecodeIncomingData(char *inSrcData,
   // Make sure to replace the sacred endChar
   inSrcData[bytesToDecode] = endChar;
 
-  Assert(fRequest.Len < kRequestBufferSizeInBytes);
+  Assert(fRequest.Len < bufferSize(fBufferClass));
   Assert(encodedBytesConsumed == bytesToDecode);
 
   return CF_NoErr;
@@ -33,6 +33,119 @@
 
 using namespace CF::Net;
 
+UInt32 HTTPResponseStream::sZeroCopyThreshold = 0;
+std::atomic<UInt32> HTTPResponseStream::sNumLeakedBuffers(0);
+
+HTTPResponseStream::~HTTPResponseStream() {
+  // the base class would delete[] a pinned or pooled buffer, hand it over first
+  this->ResetToOriginalBuffer();
+  this->ReapZeroCopy();
+
+  // the Socket is going away, nothing will ever be reaped from it again.
+  // A retransmission may still read these pages, reusing them could put
+  // another session's data on the wire, so they are leaked. Sessions wait
+  // for ReapZeroCopy before deleting themselves, this is the rare case of
+  // a peer that didn't ack in time.
+  while (fPinnedHead != nullptr) {
+    PinnedBuffer *theNext = fPinnedHead->fNext;
+    ++sNumLeakedBuffers;
+    delete fPinnedHead;
+    fPinnedHead = theNext;
+  }
+}
+
+CF::BufferPool *HTTPResponseStream::getBufferPool() {
+  // never destroyed, sessions may still give buffers back during exit
+  static auto *sBufferPool = new BufferPool(kOutputBufferSizeInBytes);
+  return sBufferPool;
+}
+
+bool HTTPResponseStream::BufferIsFull(char *inBuffer, UInt32 inBufferLen) {
+  if (inBuffer != nullptr)
+    return ResizeableStringFormatter::BufferIsFull(inBuffer, inBufferLen);
+
+  fPooledBuffer = (char *) getBufferPool()->Get();
+  fStartPut = fPooledBuffer;
+  fCurrentPut = fPooledBuffer;
+  fEndPut = fPooledBuffer + kOutputBufferSizeInBytes;
+  return true;
+}
+
+void HTTPResponseStream::SetZeroCopyThreshold(UInt32 inThreshold) {
+  if (inThreshold != 0 && inThreshold <= kOutputBufferSizeInBytes)
+    inThreshold = kOutputBufferSizeInBytes + 1;
+  sZeroCopyThreshold = inThreshold;
+}
+
+bool HTTPResponseStream::useZeroCopy(UInt32 inLength) {
+  if (sZeroCopyThreshold == 0 || inLength < sZeroCopyThreshold)
+    return false;
+
+  // the pooled buffer goes to another stream next, it can't be pinned
+  if (this->GetBufPtr() == fPooledBuffer)
+    return false;
+
+  if (!fZeroCopyTried) {
+    fZeroCopyTried = true;
+    (void) fSocket->EnableZeroCopy(); // old kernels, unix domain Sockets
+  }
+  return fSocket->IsZeroCopy();
+}
+
+void HTTPResponseStream::resetBuffer() {
+  // gives the buffer back, a pinned one is parked until the kernel is done
+  this->ResetToOriginalBuffer();
+  fBytesSentInBuffer = 0;
+}
+
+void HTTPResponseStream::ReleaseBuffer(char *inBuffer) {
+  if (inBuffer == fPooledBuffer) {
+    getBufferPool()->Put(fPooledBuffer);
+    fPooledBuffer = nullptr;
+    return;
+  }
+
+  if (!fBufferPinned
+      || (SInt32) (fBufferSequence - fSocket->ReapZeroCopy()) <= 0) {
+    fBufferPinned = false;
+    delete[] inBuffer;
+    return;
+  }
+
+  auto *thePinned = new PinnedBuffer;
+  thePinned->fBuffer = inBuffer;
+  thePinned->fSequence = fBufferSequence;
+  thePinned->fNext = nullptr;
+  if (fPinnedTail == nullptr)
+    fPinnedHead = thePinned;
+  else
+    fPinnedTail->fNext = thePinned;
+  fPinnedTail = thePinned;
+  fBufferPinned = false;
+}
+
+bool HTTPResponseStream::ReapZeroCopy() {
+  if (fPinnedHead == nullptr && !fBufferPinned)
+    return false;
+
+  // sequences complete in order, so do the parked buffers
+  UInt32 theCompleted = fSocket->ReapZeroCopy();
+  while (fPinnedHead != nullptr
+      && (SInt32) (fPinnedHead->fSequence - theCompleted) <= 0) {
+    PinnedBuffer *theNext = fPinnedHead->fNext;
+    delete[] fPinnedHead->fBuffer;
+    delete fPinnedHead;
+    fPinnedHead = theNext;
+  }
+  if (fPinnedHead == nullptr)
+    fPinnedTail = nullptr;
+
+  if (fBufferPinned && (SInt32) (fBufferSequence - theCompleted) <= 0)
+    fBufferPinned = false;
+
+  return fPinnedHead != nullptr || fBufferPinned;
+}
+
 CF_Error HTTPResponseStream::WriteV(iovec *inVec,
                                       UInt32 inNumVectors,
                                       UInt32 inTotalLength,
@@ -66,8 +179,7 @@ CF_Error HTTPResponseStream::WriteV(iovec *inVec,
 
     if (theLengthSent >= amtInBuffer) {
       // We were able to send all the data in the buffer. Great. Flush it.
-      this->Reset();
-      fBytesSentInBuffer = 0;
+      this->resetBuffer();
 
       // Make theLengthSent reflect the amount of data sent in the ioVec
       theLengthSent -= amtInBuffer;
@@ -138,7 +250,33 @@ CF_Error HTTPResponseStream::WriteV(iovec *inVec,
   return CF_NoErr;
 }
 
+CF_Error HTTPResponseStream::WriteSegments(StrPtrLen *inSegments,
+                                           UInt32 inNumSegments) {
+  Assert(inNumSegments <= kMaxSegments);
+
+  // inVec[0] is WriteV's, for the buffered data
+  iovec theVec[kMaxSegments + 1];
+  UInt32 theNumVectors = 1;
+  UInt32 theTotalLength = 0;
+  for (UInt32 i = 0; i < inNumSegments && i < kMaxSegments; i++) {
+    if (inSegments[i].Len == 0)
+      continue;
+    theVec[theNumVectors].iov_base = inSegments[i].Ptr;
+    theVec[theNumVectors].iov_len = inSegments[i].Len;
+    theTotalLength += inSegments[i].Len;
+    theNumVectors++;
+  }
+  if (theTotalLength == 0)
+    return CF_NoErr;
+
+  UInt32 theLengthSent = 0;
+  return this->WriteV(theVec, theNumVectors, theTotalLength, &theLengthSent,
+                      kAlwaysBuffer);
+}
+
 CF_Error HTTPResponseStream::Flush() {
+  this->ReapZeroCopy();
+
   UInt32 amtInBuffer = this->GetCurrentOffset() - fBytesSentInBuffer;
   if (amtInBuffer > 0) {
     if (fPrintRTSP) {
@@ -152,10 +290,27 @@ CF_Error HTTPResponseStream::Flush() {
       str.PrintStrEOL();
     }
 
+    // Send until everything is out or the Socket pushes back, an edge
+    // triggered Socket only reports writability after EAGAIN.
     UInt32 theLengthSent = 0;
-    (void) fSocket->Send(this->GetBufPtr() + fBytesSentInBuffer,
-                         amtInBuffer,
-                         &theLengthSent);
+    UInt32 theChunkSent;
+    OS_Error theErr = OS_NoErr;
+    bool theZeroCopy = this->useZeroCopy(amtInBuffer);
+    do {
+      theChunkSent = 0;
+      char const *theData = this->GetBufPtr() + fBytesSentInBuffer + theLengthSent;
+      if (theZeroCopy)
+        theErr = fSocket->SendZeroCopy(theData, amtInBuffer - theLengthSent, &theChunkSent);
+      else
+        theErr = fSocket->Send(theData, amtInBuffer - theLengthSent, &theChunkSent);
+      if (theErr != OS_NoErr)
+        break;
+      if (theZeroCopy && theChunkSent > 0) {
+        fBufferPinned = true;
+        fBufferSequence = fSocket->GetZeroCopySequence();
+      }
+      theLengthSent += theChunkSent;
+    } while ((theChunkSent > 0) && (theLengthSent < amtInBuffer));
 
     // Refresh the timeout if we were able to send any data
     if (theLengthSent > 0)
@@ -163,12 +318,13 @@ CF_Error HTTPResponseStream::Flush() {
 
     if (theLengthSent == amtInBuffer) {
       // We were able to send all the data in the buffer. Great. Flush it.
-      this->Reset();
-      fBytesSentInBuffer = 0;
+      this->resetBuffer();
     } else {
       // Not all the data was sent, so report an EAGAIN
       fBytesSentInBuffer += theLengthSent;
       Assert(fBytesSentInBuffer < this->GetCurrentOffset());
+      if ((theErr != OS_NoErr) && (theErr != EAGAIN))
+        return (CF_Error) theErr;
       return (CF_Error) EAGAIN;
     }
   }
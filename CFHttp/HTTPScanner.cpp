@@ -0,0 +1,163 @@
+/*
+    File:       HTTPScanner.cpp
+
+    Contains:   Implementation of HTTPScanner.
+
+*/
+
+#include <string.h>
+#include <CF/Net/Http/HTTPScanner.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SCANNER_X86 1
+#include <immintrin.h>
+#else
+#define HTTP_SCANNER_X86 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace CF::Net;
+
+static inline UInt32 lowestBit(UInt64 inMask) {
+#if defined(_MSC_VER)
+  unsigned long theIndex;
+  _BitScanForward64(&theIndex, inMask);
+  return (UInt32) theIndex;
+#else
+  return (UInt32) __builtin_ctzll(inMask);
+#endif
+}
+
+static UInt64 blockMaskScalar(char const *inBlock, char const *inDelimiters) {
+  UInt64 theMask = 0;
+  for (UInt32 i = 0; i < 64; i++) {
+    char theChar = inBlock[i];
+    if ((theChar == inDelimiters[0]) || (theChar == inDelimiters[1])
+        || (theChar == inDelimiters[2]))
+      theMask |= (UInt64) 1 << i;
+  }
+  return theMask;
+}
+
+#if HTTP_SCANNER_X86
+
+__attribute__((target("sse2")))
+static UInt64 blockMaskSSE2(char const *inBlock, char const *inDelimiters) {
+  __m128i theDelim0 = _mm_set1_epi8(inDelimiters[0]);
+  __m128i theDelim1 = _mm_set1_epi8(inDelimiters[1]);
+  __m128i theDelim2 = _mm_set1_epi8(inDelimiters[2]);
+
+  UInt64 theMask = 0;
+  for (UInt32 i = 0; i < 4; i++) {
+    __m128i theData = _mm_loadu_si128((__m128i const *) (inBlock + i * 16));
+    __m128i theEqual = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(theData, theDelim0),
+                     _mm_cmpeq_epi8(theData, theDelim1)),
+        _mm_cmpeq_epi8(theData, theDelim2));
+    theMask |= (UInt64) (UInt32) _mm_movemask_epi8(theEqual) << (i * 16);
+  }
+  return theMask;
+}
+
+__attribute__((target("avx2")))
+static UInt64 blockMaskAVX2(char const *inBlock, char const *inDelimiters) {
+  __m256i theDelim0 = _mm256_set1_epi8(inDelimiters[0]);
+  __m256i theDelim1 = _mm256_set1_epi8(inDelimiters[1]);
+  __m256i theDelim2 = _mm256_set1_epi8(inDelimiters[2]);
+
+  UInt64 theMask = 0;
+  for (UInt32 i = 0; i < 2; i++) {
+    __m256i theData = _mm256_loadu_si256((__m256i const *) (inBlock + i * 32));
+    __m256i theEqual = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(theData, theDelim0),
+                        _mm256_cmpeq_epi8(theData, theDelim1)),
+        _mm256_cmpeq_epi8(theData, theDelim2));
+    theMask |= (UInt64) (UInt32) _mm256_movemask_epi8(theEqual) << (i * 32);
+  }
+  return theMask;
+}
+
+#endif
+
+static HTTPScanner::BlockMaskFunc chooseBlockMask(char const **outName) {
+#if HTTP_SCANNER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    *outName = "avx2";
+    return blockMaskAVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    *outName = "sse2";
+    return blockMaskSSE2;
+  }
+#endif
+  *outName = "scalar";
+  return blockMaskScalar;
+}
+
+static HTTPScanner::BlockMaskFunc getBlockMask(char const **outName = nullptr) {
+  static char const *sName = nullptr;
+  static HTTPScanner::BlockMaskFunc sBlockMask = chooseBlockMask(&sName);
+  if (outName != nullptr)
+    *outName = sName;
+  return sBlockMask;
+}
+
+char const *HTTPScanner::GetImplementation() {
+  char const *theName = nullptr;
+  getBlockMask(&theName);
+  return theName;
+}
+
+HTTPScanner::HTTPScanner(char const *inData, UInt32 inLength,
+                         Delimiters inDelimiters)
+    : fData(inData),
+      fLength(inLength),
+      fBlockMask(getBlockMask()),
+      fBlockStart(0),
+      fMask(0) {
+  fDelimiters[0] = '\r';
+  fDelimiters[1] = '\n';
+  // a set of two repeats one, so the block functions always compare three
+  fDelimiters[2] = (inDelimiters == kHeader) ? ':' : '\n';
+
+  if (fLength > 0)
+    this->loadBlock(0);
+}
+
+void HTTPScanner::loadBlock(UInt32 inBlockStart) {
+  fBlockStart = inBlockStart;
+  if (fLength - inBlockStart >= kBlockSize) {
+    fMask = fBlockMask(fData + inBlockStart, fDelimiters);
+    return;
+  }
+
+  // the last, partial block: never read past the buffer, NULs aren't
+  // delimiters
+  char theTail[kBlockSize];
+  ::memset(theTail, 0, kBlockSize);
+  ::memcpy(theTail, fData + inBlockStart, fLength - inBlockStart);
+  fMask = fBlockMask(theTail, fDelimiters);
+}
+
+UInt32 HTTPScanner::Next(UInt32 inFrom) {
+  if (inFrom >= fLength)
+    return fLength;
+
+  UInt32 theBlockStart = inFrom & ~((UInt32) kBlockSize - 1);
+  if (theBlockStart != fBlockStart)
+    this->loadBlock(theBlockStart);
+
+  // the delimiters before inFrom don't count
+  UInt64 theMask = fMask & (~(UInt64) 0 << (inFrom - fBlockStart));
+  while (theMask == 0) {
+    if (fLength - fBlockStart <= kBlockSize)
+      return fLength;
+    this->loadBlock(fBlockStart + kBlockSize);
+    theMask = fMask;
+  }
+  return fBlockStart + lowestBit(theMask);
+}
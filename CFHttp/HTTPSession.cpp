@@ -15,13 +15,51 @@
 
 using namespace CF::Net;
 
+std::atomic<UInt32> HTTPSession::sNumSessions(0);
+std::atomic<UInt64> HTTPSession::sNumShedRequests(0);
+UInt32 HTTPSession::sMaxConnections = 0;
+UInt32 HTTPSession::sMaxQueueDelayInMs = 0;
+UInt32 HTTPSession::sMaxRequestBodySize = HTTPSession::kDefaultMaxRequestBodySize;
+char HTTPSession::sServiceUnavailable[256];
+UInt32 HTTPSession::sServiceUnavailableLen = 0;
+
+void HTTPSession::SetAdmissionLimits(UInt32 inMaxConnections,
+                                     UInt32 inMaxQueueDelayInMs) {
+  StrPtrLen &theServer = CFEnv::GetServerHeader();
+  int theLen = s_snprintf(sServiceUnavailable, sizeof(sServiceUnavailable),
+                          "HTTP/1.1 503 Service Unavailable\r\n"
+                          "Server: %.*s\r\n"
+                          "Content-Length: 0\r\n"
+                          "Retry-After: 1\r\n"
+                          "Connection: close\r\n\r\n",
+                          (int) theServer.Len, theServer.Ptr);
+  Assert(theLen > 0 && theLen < (int) sizeof(sServiceUnavailable));
+  sServiceUnavailableLen = (UInt32) theLen;
+
+  sMaxConnections = inMaxConnections;
+  sMaxQueueDelayInMs = inMaxQueueDelayInMs;
+}
+
+void HTTPSession::SetMaxRequestBodySize(UInt32 inMaxSize) {
+  if (inMaxSize == 0)
+    inMaxSize = kDefaultMaxRequestBodySize;
+  if (inMaxSize > kMaxRequestBodySize)
+    inMaxSize = kMaxRequestBodySize;
+  sMaxRequestBodySize = inMaxSize;
+}
+
 HTTPSession::HTTPSession()
     : HTTPSessionInterface(),
       fRequest(nullptr),
       fResponse(nullptr),
+      fArena(getArenaPool()),
       fReadMutex(),
-      fState(kReadingFirstRequest) {
+      fState(kReadingFirstRequest),
+      fFlowControlled(false),
+      fZeroCopyLingering(false) {
   this->SetTaskName("HTTPSession");
+  ++sNumSessions;
+  fOverMaxConnections = OverMaxConnections(0);
 }
 
 HTTPSession::~HTTPSession() {
@@ -33,6 +71,7 @@ HTTPSession::~HTTPSession() {
 
   fLiveSession = false; //used in Clean up request to remove the RTP session.
   this->CleanupRequestAndResponse();// Make sure that all our objects are deleted
+  --sNumSessions;
 }
 
 SInt64 HTTPSession::Run() {
@@ -45,10 +84,24 @@ SInt64 HTTPSession::Run() {
   if (events & Thread::Task::kKillEvent)
     fLiveSession = false;
 
-  if (events & Thread::Task::kTimeoutEvent) {
-    /* Session超时,释放Session */
-    return -1;
-  }
+  // zero copy completions come in on the error queue
+  if (events & Thread::Task::kErrorEvent)
+    fOutputStream.ReapZeroCopy();
+
+  /* Session超时，清理后释放，MSG_ZEROCOPY 的缓冲区同样要等内核用完。
+   * 异步处理的请求超时，由 kWaitingForResponse 回复 504 */
+  bool isTimedOut = (events & Thread::Task::kTimeoutEvent) && fState != kWaitingForResponse;
+  if (isTimedOut)
+    fLiveSession = false;
+
+  /* 响应被 flow control 阻塞时，只有可写(或连接出错)才能推进，其它唤醒直接忽略。
+   * kIdleEvent 是 pipe body 的轮询 */
+  static const EventFlags sWakeWriter = Thread::Task::kWriteEvent
+      | Thread::Task::kHangupEvent | Thread::Task::kErrorEvent
+      | Thread::Task::kKillEvent | Thread::Task::kIdleEvent;
+  if (fFlowControlled && this->IsLiveSession() && !(events & sWakeWriter))
+    return 0;
+  fFlowControlled = false;
 
   while (this->IsLiveSession()) {
     switch (fState) {
@@ -118,10 +171,18 @@ SInt64 HTTPSession::Run() {
 
         Assert(fInputStream.GetRequestBuffer());
 
+        /* 过载时不处理请求，直接回复 503 并关闭连接 */
+        if (this->shouldShed()) {
+          this->sendServiceUnavailable();
+          fState = kLingering;
+          continue;
+        }
+
         Assert(fRequest == nullptr);
         Assert(fResponse == nullptr);
-        fRequest = new HTTPPacket(fInputStream.GetRequestBuffer());
-        fResponse = new HTTPPacket(httpResponseType);
+        fRequest = fArena.New<HTTPPacket>(fInputStream.GetRequestBuffer(), &fArena);
+        fResponse = fArena.New<HTTPPacket>(httpResponseType, &fArena);
+        fRequest->fSessionTask = this;
 
         /*
            在这里，我们已经读取了一个完整的 Request，并准备进行请求的处理，
@@ -133,8 +194,12 @@ SInt64 HTTPSession::Run() {
 
         fOutputStream.ResetBytesWritten();
 
+        // the request is over the size limit, the connection is closed
+        // after the response
         if (err == E2BIG) {
-          fResponse->SetStatusCode(httpInternalServerError);
+          fResponse->SetStatusCode(fInputStream.HasRequestLine()
+                                   ? httpRequestHeaderFieldsTooLarge
+                                   : httpRequestURITooLarge);
           fState = kSendingResponse;
           break;
         }
@@ -170,6 +235,14 @@ SInt64 HTTPSession::Run() {
           return 0;
         }
 
+        /* body 超过上限，不读取，回复 413 后关闭连接 */
+        if (theErr == E2BIG) {
+          fResponse->SetStatusCode(httpRequestEntityTooLarge);
+          fRequest->SetRequestKeepAlive(false);
+          fState = kSendingResponse;
+          break;
+        }
+
         fState = kPreprocessingRequest;
         break;
       }
@@ -190,12 +263,75 @@ SInt64 HTTPSession::Run() {
 
         // doDispatch
         CF_Error theErr = sDispatcher->Dispatch(*fRequest, *fResponse);
-        if (theErr == CF_FileNotFound) {
-          fResponse->SetStatusCode(httpNotFound);
-        } else if (theErr != CF_NoErr) {
-          fResponse->SetStatusCode(httpInternalServerError);
+        HTTPCompletion *theCompletion = fRequest->fCompletion;
+        if (theErr == CF_RequestPending && theCompletion != nullptr) {
+          /* 异步处理：等待 Complete 的 kUpdateEvent 或超时，期间不占用线程 */
+          if (theCompletion->GetTimeoutInMs() > 0)
+            fTimeoutTask.SetTimeout(theCompletion->GetTimeoutInMs());
+          else
+            fTimeoutTask.RefreshTimeout();
+          fState = kWaitingForResponse;
+          continue;
         }
 
+        // the handler answered after all, a late Complete must not touch
+        // the response while it is sent
+        if (theCompletion != nullptr)
+          theCompletion->poll(true, &theErr);
+
+        this->setResultStatus(theErr);
+        fState = kSendingResponse;
+        break;
+      }
+
+      case kLingering: {
+        /* 503 后面已经跟了 FIN，读掉客户端还在发的请求数据，直到它关闭连接
+         * 或超时。带着未读数据 close 会发出 RST，客户端可能因此收不到 503 */
+        char theDumpBuffer[CF_MAX_REQUEST_BUFFER_SIZE];
+        UInt32 theLengthRead = 0;
+        OS_Error theErr = OS_NoErr;
+        for (UInt32 i = 0; i < kMaxDrainReads && theErr == OS_NoErr; i++)
+          theErr = fInputSocketP->Read(theDumpBuffer, sizeof(theDumpBuffer), &theLengthRead);
+
+        if (theErr == OS_NoErr)
+          return kPipePollIntervalInMs; // still more, let other tasks run
+        if (theErr == EAGAIN) {
+          fInputSocketP->RequestEvent(EV_RE);
+          return 0;
+        }
+        fLiveSession = false;
+        break;
+      }
+
+      case kWaitingForResponse: {
+        bool isTimedOut = (events & Thread::Task::kTimeoutEvent) != 0;
+        CF_Error theErr = CF_NoErr;
+
+        /* 客户端已断开，不再等处理结果，放弃 completion 后关闭 Session。
+         * 连接出错时内核同时报告挂断，单独的 kErrorEvent 是 MSG_ZEROCOPY 的完成通知 */
+        if (events & Thread::Task::kHangupEvent) {
+          fRequest->fCompletion->poll(true, &theErr);
+          fLiveSession = false;
+          break;
+        }
+
+        if (!fRequest->fCompletion->poll(isTimedOut, &theErr)) {
+          if (!isTimedOut) {
+            // We are holding mutexes, so we need to force
+            // the same Thread to be used for next Run()
+            this->ForceSameThread();
+            return 0;
+          }
+
+          /* 超时未完成，丢弃处理了一半的响应，回复 504 */
+          fResponse->~HTTPPacket();
+          fResponse = fArena.New<HTTPPacket>(httpResponseType, &fArena);
+          fResponse->SetStatusCode(httpGatewayTimeout);
+        } else {
+          this->setResultStatus(theErr);
+        }
+
+        fTimeoutTask.SetTimeout(kSessionTimeoutInMs);
         fState = kSendingResponse;
       }
 
@@ -204,25 +340,39 @@ SInt64 HTTPSession::Run() {
         Assert(fRequest != nullptr);
         Assert(fResponse != nullptr);
 
-        /* 构造响应信息 */
-        CF_Error theErr = SetupResponse();
+        /* 构造响应信息，因 flow control 重入时只继续发送，不再重复构造 */
+        if (fOutputStream.GetBytesWritten() == 0) {
+          err = SetupResponse();
+          if (err != CF_NoErr) {
+            Assert(!this->IsLiveSession());
+            break;
+          }
+        }
 
         if (fOutputStream.GetBytesWritten() == 0) {
           fState = kCleaningUp;
           break;
         }
 
-        /* 发送响应报文 */
+        /* 发送响应报文，先发缓冲区(头部和内存 body)，再发文件 body */
         err = fOutputStream.Flush();
+        if (err == CF_NoErr && fResponse->GetBodyFileLength() > 0)
+          err = this->sendBodyFile();
 
         if (err == EAGAIN) {
           // If we get this error, we are currently flow-controlled and should
           // wait for the Socket to become writeable again
           /* 如果收到Socket EAGAIN错误，那么我们需要等Socket再次可写的时候再调用发送 */
+          fFlowControlled = true;
           fSocket.RequestEvent(EV_WR);
           this->ForceSameThread();
           // We are holding mutexes, so we need to force
           // the same Thread to be used for next Run()
+
+          // an empty pipe also reports EAGAIN, and it won't make the Socket
+          // writable, so poll it as well
+          if (fResponse->GetBodyFileLength() > 0 && fResponse->IsBodyPipe())
+            return kPipePollIntervalInMs;
           return 0;
         } else if (err != CF_NoErr) {
           // Any other error means that the client has disconnected, right?
@@ -230,6 +380,8 @@ SInt64 HTTPSession::Run() {
           break;
         }
 
+        /* 边缘触发下 EV_WR 一直挂着，发完就撤掉，免得每次可写都唤醒 */
+        fSocket.DropEvent(EV_WR);
         fState = kCleaningUp;
       }
 
@@ -247,6 +399,19 @@ SInt64 HTTPSession::Run() {
           }
         }
 
+        /* 非 keep-alive 的请求(包括超长被拒的请求)，响应发完就关闭连接，
+         * 不再把后面的数据当作下一个请求读取 */
+        if (!fRequest->IsRequestKeepAlive()) {
+          /* 先丢掉已到达还未读取的数据，带着未读数据 close 会发出 RST，
+           * 客户端可能因此收不到刚发出的响应 */
+          char theDumpBuffer[CF_MAX_REQUEST_BUFFER_SIZE];
+          UInt32 theLengthRead = 0;
+          for (UInt32 i = 0; i < kMaxDrainReads; i++)
+            if (fInputSocketP->Read(theDumpBuffer, sizeof(theDumpBuffer), &theLengthRead) != CF_NoErr)
+              break;
+          fLiveSession = false;
+        }
+
         /* 一次请求的读取、处理、响应过程完整，等待下一次网络报文！ */
         this->CleanupRequestAndResponse();
         fState = kReadingRequest;
@@ -258,6 +423,16 @@ SInt64 HTTPSession::Run() {
   /* 清空Session占用的所有资源 */
   this->CleanupRequestAndResponse();
 
+  /* MSG_ZEROCOPY 发送的数据内核还在用，等它释放缓冲区后再删除 Session，
+   * 最多再等一个超时，之后仍未释放的缓冲区由 HTTPResponseStream 泄漏掉 */
+  if (fOutputStream.ReapZeroCopy() && !(isTimedOut && fZeroCopyLingering)) {
+    if (!fZeroCopyLingering) {
+      fZeroCopyLingering = true;
+      fTimeoutTask.RefreshTimeout();
+    }
+    return kZeroCopyLingerInMs;
+  }
+
   /* Session引用数为0，返回-1后，系统会将此Session删除 */
   if (fObjectHolders == 0)
     return -1;
@@ -280,18 +455,12 @@ CF_Error HTTPSession::SendHTTPPacket(CF::StrPtrLen *contentXML,
   if (connectionClose)
     httpAck.AppendConnectionCloseHeader();
 
-  char respHeader[2048] = {0};
-  StrPtrLen *ackPtr = httpAck.GetCompleteHTTPHeader();
-  strncpy(respHeader, ackPtr->Ptr, ackPtr->Len);
-
+  // httpAck goes away with this call, what the Socket doesn't take now is
+  // buffered by WriteSegments
+  StrPtrLen theSegments[2] = {*httpAck.GetCompleteHTTPHeader(), *contentXML};
   HTTPResponseStream *pOutputStream = GetOutputStream();
-  pOutputStream->Put(respHeader);
-  if (contentXML->Len > 0)
-    pOutputStream->Put(contentXML->Ptr, contentXML->Len);
-
-  if (pOutputStream->GetBytesWritten() != 0) {
+  if (pOutputStream->WriteSegments(theSegments, 2) == CF_NoErr)
     pOutputStream->Flush();
-  }
 
   /* 将对HTTPSession的引用减少 1 */
   if (fObjectHolders && decrement)
@@ -320,7 +489,13 @@ CF_Error HTTPSession::SetupRequest() {
   StrPtrLen *lengthPtr = fRequest->GetHeaderValue(httpContentLengthHeader);
   StringParser theContentLenParser(lengthPtr);
   theContentLenParser.ConsumeWhitespace();
-  UInt32 content_length = theContentLenParser.ConsumeInteger(nullptr);
+  StrPtrLen theDigits;
+  UInt32 content_length = theContentLenParser.ConsumeInteger(&theDigits);
+
+  // the length comes from the client: more digits than the largest limit
+  // has could have wrapped ConsumeInteger
+  if (theDigits.Len > 9 || content_length > sMaxRequestBodySize)
+    return E2BIG;
 
   if (content_length) {
     s_printf("HTTPSession read content-length:%d \n", content_length);
@@ -334,24 +509,31 @@ CF_Error HTTPSession::SetupRequest() {
       theRequestBody = requestBody->Ptr;
       theBufferOffset = requestBody->Len;
     } else {
-      theRequestBody = new char[content_length + 1];
+      requestBody = fRequest->NewBody(content_length + 1);
+      theRequestBody = requestBody->Ptr;
       memset(theRequestBody, 0, content_length + 1);
-      requestBody = new StrPtrLenDel(theRequestBody, 0);
-      fRequest->SetBody(requestBody);
+      requestBody->Len = 0;
     }
 
-    UInt32 theLen;
-
-    // We have our buffer and offset. Read the data.
-    theErr = fInputStream.Read(theRequestBody + theBufferOffset,
-                               content_length - theBufferOffset,
-                               &theLen);
-    Assert(theErr != CF_BadArgument);
-
-    if (theErr == CF_RequestFailed) {
-      // NEED TO RETURN HTTP ERROR RESPONSE
-      return CF_RequestFailed;
-    }
+    UInt32 theLen = 0;
+
+    // We have our buffer and offset. Read the data. Keep reading until the
+    // body is complete or the Socket would block, because an edge triggered
+    // Socket won't report the data left behind again.
+    do {
+      theBufferOffset += theLen;
+      theLen = 0;
+      theErr = fInputStream.Read(theRequestBody + theBufferOffset,
+                                 content_length - theBufferOffset,
+                                 &theLen);
+      Assert(theErr != CF_BadArgument);
+
+      if (theErr == CF_RequestFailed) {
+        // NEED TO RETURN HTTP ERROR RESPONSE
+        return CF_RequestFailed;
+      }
+    } while ((theErr == CF_NoErr) && (theLen > 0) &&
+        (theLen < (content_length - theBufferOffset)));
 
     // Update our offset in the buffer
     requestBody->Len = theBufferOffset + theLen;
@@ -387,25 +569,50 @@ CF_Error HTTPSession::SetupResponse() {
   fResponse->CreateResponseHeader();
 
   StrPtrLen *respBody = fResponse->GetBody();
-  if (respBody != NULL && respBody->Len > 0)
-    fResponse->AppendContentLengthHeader(respBody->Len);
-  else
-    fResponse->AppendContentLengthHeader((UInt32) 0);
+  UInt64 bodyLen = fResponse->GetBodyFileLength();
+  if (respBody != NULL)
+    bodyLen += respBody->Len;
+  fResponse->AppendContentLengthHeader(bodyLen);
 
   if (!fRequest->IsRequestKeepAlive()) {
     fResponse->AppendConnectionCloseHeader();
   }
 
-  char respHeader[2048] = {0};
-  StrPtrLen *ackPtr = fResponse->GetCompleteHTTPHeader();
-  strncpy(respHeader, ackPtr->Ptr, ackPtr->Len);
-
-  fOutputStream.Put(respHeader);
+  // header and body go out in one writev, a file body follows them in
+  // sendBodyFile
+  StrPtrLen theSegments[2];
+  theSegments[0] = *fResponse->GetCompleteHTTPHeader();
+  if (respBody != NULL)
+    theSegments[1] = *respBody;
+  return fOutputStream.WriteSegments(theSegments, 2);
+}
 
-  // construct response body
-  if (respBody != NULL && respBody->Len > 0)
-    fOutputStream.Put(*respBody);
+CF_Error HTTPSession::sendBodyFile() {
+  int theFD = fResponse->GetBodyFD();
+  bool isPipe = fResponse->IsBodyPipe();
+
+  while (fResponse->GetBodyFileLength() > 0) {
+    UInt64 theLeft = fResponse->GetBodyFileLength();
+    UInt32 theChunk = theLeft > kSendFileChunkSize
+        ? (UInt32) kSendFileChunkSize : (UInt32) theLeft;
+    UInt32 theSent = 0;
+
+    OS_Error theErr = isPipe
+        ? fSocket.Splice(theFD, theChunk, &theSent)
+        : fSocket.SendFile(theFD, fResponse->GetBodyFileOffset(), theChunk, &theSent);
+    if (theErr != OS_NoErr)
+      return theErr;
+
+    if (theSent == 0) {
+      // the file is shorter than the Content-Length we announced, the only
+      // way to tell the client is to drop the connection
+      fLiveSession = false;
+      return (CF_Error) EPIPE;
+    }
 
+    fResponse->ConsumeBodyFile(theSent);
+    fTimeoutTask.RefreshTimeout();
+  }
   return CF_NoErr;
 }
 
@@ -416,15 +623,18 @@ void HTTPSession::CleanupRequestAndResponse() {
       this->Signal(Thread::Task::kKillEvent);
 
     // nullptr out any references to the current request
-    delete fRequest;
+    fRequest->~HTTPPacket();
     fRequest = nullptr;
   }
 
   if (fResponse != nullptr) {
-    delete fResponse;
+    fResponse->~HTTPPacket();
     fResponse = nullptr;
   }
 
+  // all the request's memory at once
+  fArena.Reset();
+
   fSessionMutex.Unlock();
   fReadMutex.Unlock();
 
@@ -433,9 +643,38 @@ void HTTPSession::CleanupRequestAndResponse() {
   this->SetRequestBodyLength(-1);
 }
 
+void HTTPSession::setResultStatus(CF_Error inResult) {
+  if (inResult == CF_FileNotFound) {
+    fResponse->SetStatusCode(httpNotFound);
+  } else if (inResult != CF_NoErr) {
+    fResponse->SetStatusCode(httpInternalServerError);
+  }
+}
+
+CF::BufferPool *HTTPSession::getArenaPool() {
+  static auto *sArenaPool = new BufferPool(kArenaBlockSize);
+  return sArenaPool;
+}
+
 bool HTTPSession::OverMaxConnections(UInt32 buffer) {
+  return (sMaxConnections > 0) && (sNumSessions + buffer > sMaxConnections);
+}
+
+bool HTTPSession::shouldShed() {
+  if (fOverMaxConnections)
+    return true;
+  return (sMaxQueueDelayInMs > 0)
+      && (this->GetQueueDelay() > (SInt64) sMaxQueueDelayInMs);
+}
 
-  return false;
+void HTTPSession::sendServiceUnavailable() {
+  // best effort, then the write side is shut down: the FIN goes out
+  // behind the 503 and kLingering waits for the client's
+  UInt32 theLengthSent = 0;
+  (void) fSocket.Send(sServiceUnavailable, sServiceUnavailableLen, &theLengthSent);
+  fSocket.ShutdownWrite();
+  fTimeoutTask.SetTimeout(kLingerTimeoutInMs);
+  ++sNumShedRequests;
 }
 
 CF_Error HTTPSession::dumpRequestData() {
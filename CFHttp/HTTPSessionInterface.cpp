@@ -50,11 +50,14 @@ void HTTPSessionInterface::Initialize(HTTPMapping *mapping) {
 
 HTTPSessionInterface::HTTPSessionInterface()
     : Task(),
-      fTimeoutTask(nullptr, 30 * 1000),
+      fTimeoutTask(nullptr, kSessionTimeoutInMs),
       fInputStream(&fSocket),
       fOutputStream(&fSocket, &fTimeoutTask),
       fSessionMutex(),
-      fSocket(nullptr, Socket::kNonBlockingSocketType),
+      // the session state machine reads until EAGAIN and flushes until
+      // EAGAIN, so it can use the cheaper edge triggered mode.
+      fSocket(nullptr, Socket::kNonBlockingSocketType
+          | Socket::kEdgeTriggeredSocketMode),
       fOutputSocketP(&fSocket),
       fInputSocketP(&fSocket),
       fLiveSession(true),
@@ -97,8 +100,20 @@ CF_Error HTTPSessionInterface::Write(void *inBuffer,
                                      UInt32 *outLenWritten,
                                      CF_WriteFlags inFlags) {
   UInt32 sendType = HTTPResponseStream::kDontBuffer;
-  if ((inFlags & cfWriteFlagsBufferData) != 0)
+  if ((inFlags & cfWriteFlagsBufferData) != 0) {
+    // Don't let a slow reader make us buffer without bound. The caller gets
+    // EAGAIN and a kWriteEvent once the Socket drains.
+    if (fOutputStream.IsOverHighWater()) {
+      CF_Error theErr = fOutputStream.Flush();
+      if (theErr == EAGAIN) {
+        fOutputSocketP->RequestEvent(EV_WR);
+        return theErr;
+      } else if (theErr != CF_NoErr) {
+        return theErr;
+      }
+    }
     sendType = HTTPResponseStream::kAlwaysBuffer;
+  }
 
   iovec theVec[2];
   theVec[1].iov_base = (char *) inBuffer;
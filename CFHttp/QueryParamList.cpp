@@ -28,31 +28,45 @@
 
 using namespace CF::Net;
 
-QueryParamList::QueryParamList(const std::string &queryString) {
+QueryParamList::QueryParamList(const std::string &queryString)
+    : fArena(nullptr), fHead(nullptr) {
   StrPtrLen querySPL(const_cast<char *>(queryString.c_str()),
                      queryString.size());
 
-  fNameValueQueryParamList = new PLDoubleLinkedList<QueryParamListElement>();
-
   this->BulidList(&querySPL);
 }
 
-QueryParamList::QueryParamList(CF::StrPtrLen *querySPL) {
+QueryParamList::QueryParamList(CF::StrPtrLen *querySPL, CF::Arena *inArena)
+    : fArena(inArena), fHead(nullptr) {
   // ctor from StrPtrLen
-  fNameValueQueryParamList = new PLDoubleLinkedList<QueryParamListElement>();
-
   this->BulidList(querySPL);
 }
 
-QueryParamList::QueryParamList(char *queryString) {
+QueryParamList::QueryParamList(char *queryString, CF::Arena *inArena)
+    : fArena(inArena), fHead(nullptr) {
   // ctor from char*
   StrPtrLen querySPL(queryString);
 
-  fNameValueQueryParamList = new ::PLDoubleLinkedList<QueryParamListElement>();
-
   this->BulidList(&querySPL);
 }
 
+QueryParamList::~QueryParamList() {
+  if (fArena != nullptr)
+    return;
+
+  while (fHead != nullptr) {
+    QueryParamListElement *theNext = fHead->mNext;
+    delete fHead;
+    fHead = theNext;
+  }
+}
+
+char *QueryParamList::CopyString(CF::StrPtrLen *inString) {
+  if (fArena != nullptr)
+    return fArena->CopyString(inString->Ptr, inString->Len);
+  return inString->GetAsCString();
+}
+
 void QueryParamList::BulidList(CF::StrPtrLen *querySPL) {
   // parse the string and build the name/value list from the tokens.
   // the string is a 'form' encoded query string ( see rfc - 1808 )
@@ -83,44 +97,22 @@ void QueryParamList::BulidList(CF::StrPtrLen *querySPL) {
         // our value will end by here...
       }
 
-      AddNameValuePairToList(theCGIParamName.GetAsCString(),
-                             theCGIParamValue.GetAsCString());
+      AddNameValuePairToList(this->CopyString(&theCGIParamName),
+                             this->CopyString(&theCGIParamValue));
 
       queryParser.ConsumeLength(&theCGIParamValue, 1);   // the '='
     }
   }
 }
 
-static void PrintNameAndValue(::PLDoubleLinkedListNode<QueryParamListElement> *node,
-                              void *userData) {
-  // used by QueryParamList::PrintAll
-  QueryParamListElement *nvPair = node->fElement;
-
-  s_printf("qpl: %s, name %s, val %s\n",
-           (char *) userData,
-           nvPair->mName,
-           nvPair->mValue);
-}
-
 void QueryParamList::PrintAll(char *idString) {
   // print name and value of each item in the list, print each pair preceded by "idString"
-  fNameValueQueryParamList->ForEach(PrintNameAndValue, idString);
-}
-
-/*
- * make a case insenstitive comparison between "node" name and the userData
- * used by QueryParamList::DoFindCGIValueForParam
- */
-static bool CompareStrToName(::PLDoubleLinkedListNode<QueryParamListElement> *node,
-                             void *userData) {
-
-  CF::Net::QueryParamListElement *nvPair = node->fElement;
-  CF::StrPtrLen name(nvPair->mName);
-
-  if (name.EqualIgnoreCase((char *) userData, strlen((char *) userData)))
-    return true;
-
-  return false;
+  for (QueryParamListElement *nvPair = fHead; nvPair != nullptr; nvPair = nvPair->mNext) {
+    s_printf("qpl: %s, name %s, val %s\n",
+             idString,
+             nvPair->mName,
+             nvPair->mValue);
+  }
 }
 
 /*
@@ -129,36 +121,32 @@ static bool CompareStrToName(::PLDoubleLinkedListNode<QueryParamListElement> *no
  */
 char const *QueryParamList::DoFindCGIValueForParam(char *name) {
 
-  ::PLDoubleLinkedListNode<QueryParamListElement> *node;
-
-  node = fNameValueQueryParamList->ForEachUntil(CompareStrToName, name);
-
-  if (node != nullptr) {
-    QueryParamListElement *nvPair = node->fElement;
-    return nvPair->mValue;
+  UInt32 nameLen = ::strlen(name);
+  for (QueryParamListElement *nvPair = fHead; nvPair != nullptr; nvPair = nvPair->mNext) {
+    CF::StrPtrLen theName(nvPair->mName);
+    if (theName.EqualIgnoreCase(name, nameLen))
+      return nvPair->mValue;
   }
 
   return nullptr;
 }
 
 void QueryParamList::AddNameValuePairToList(char *name, char *value) {
-  // add the name/value pair to the by creating the holder struct
-  // then adding that as the element in the linked list
+  // add the name/value pair at the head of the list, the last pair added
+  // is found first
 
-  ::PLDoubleLinkedListNode<QueryParamListElement> *nvNode;
   QueryParamListElement *nvPair;
 
   this->DecodeArg(name);
   this->DecodeArg(value);
 
-  nvPair = new QueryParamListElement(name, value);
-
-
-  // create a node to hold the pair
-  nvNode = new ::PLDoubleLinkedListNode<QueryParamListElement>(nvPair);
+  if (fArena != nullptr)
+    nvPair = fArena->New<QueryParamListElement>(name, value);
+  else
+    nvPair = new QueryParamListElement(name, value);
 
-  // add it to the list
-  fNameValueQueryParamList->AddNode(nvNode);
+  nvPair->mNext = fHead;
+  fHead = nvPair;
 }
 
 void QueryParamList::DecodeArg(char *ioCodedPtr) {
@@ -0,0 +1,301 @@
+/*
+    File:       HTTPClientPool.h
+
+    Contains:   A pool of keep-alive HTTP/1.1 client connections to upstream
+                servers.
+
+                Connections are kept per host (address and port). Acquire
+                hands out an idle one when there is one, otherwise it starts
+                a non-blocking connect; Release puts a connection that can
+                carry another request back on its host's idle list, and
+                closes the rest. Idle connections are checked before they
+                are reused and evicted after an idle timeout.
+
+                A connection only allocates its buffers when it sends or
+                reads, and grows them to what the responses need. With
+                pipelining on, several requests can be sent before their
+                responses are read; they come back in request order.
+*/
+
+#ifndef __HTTP_CLIENT_POOL_H__
+#define __HTTP_CLIENT_POOL_H__
+
+#include <CF/Queue.h>
+#include <CF/OpenHashTable.h>
+#include <CF/ResizeableStringFormatter.h>
+#include <CF/Core/Mutex.h>
+#include <CF/Thread/Task.h>
+#include <CF/Net/Socket/TCPSocket.h>
+#include <CF/Net/Http/HTTPPacket.h>
+
+namespace CF {
+namespace Net {
+
+class HTTPClientPool;
+
+class HTTPClientHost {
+ public:
+
+  UInt32 GetAddr() { return fAddr; }
+
+  UInt16 GetPort() { return fPort; }
+
+ private:
+
+  HTTPClientHost(UInt32 inAddr, UInt16 inPort)
+      : fAddr(inAddr), fPort(inPort), fNumConnections(0) {}
+
+  UInt32 fAddr;
+  UInt16 fPort;
+
+  Queue fIdle;              // oldest at the head, most recently released at the tail
+  UInt32 fNumConnections;   // idle and acquired
+
+  friend class HTTPClientPool;
+};
+
+class HTTPClientHostKey {
+ public:
+
+  HTTPClientHostKey(UInt32 inAddr, UInt16 inPort)
+      : fAddr(inAddr), fPort(inPort) {}
+
+  explicit HTTPClientHostKey(HTTPClientHost *inHost)
+      : fAddr(inHost->GetAddr()), fPort(inHost->GetPort()) {}
+
+  UInt32 GetHashKey() { return fAddr ^ ((UInt32) fPort << 16); }
+
+  bool operator==(const HTTPClientHostKey &key) const {
+    return (fAddr == key.fAddr) && (fPort == key.fPort);
+  }
+
+ private:
+
+  UInt32 fAddr;
+  UInt16 fPort;
+};
+
+/**
+ * @brief 连接池中的一条 HTTP/1.1 客户端连接
+ *
+ * @note 由 Acquire 交给一个 Task 使用，该 Task 的 Run 收到 kWriteEvent /
+ *       kReadEvent 时调用 Flush / ReadResponse
+ */
+class HTTPClientConnection {
+ public:
+
+  /**
+   * SendRequest - queues a complete request (request line, headers and
+   * body) and starts sending it. Without pipelining only one request may be
+   * outstanding at a time.
+   *
+   * @return OS_NoErr, EAGAIN if part of it waits for the Socket, EPERM if
+   *         another request's response hasn't been read yet, or POSIX error
+   *         code.
+   */
+  OS_Error SendRequest(char const *inData, UInt32 inLength);
+
+  /**
+   * Flush - sends what SendRequest queued. While the connect is still in
+   * progress this checks on it first.
+   *
+   * @return OS_NoErr when all is sent, EAGAIN or EINPROGRESS when the task
+   *         will get a kWriteEvent to call this again, or POSIX error code.
+   */
+  OS_Error Flush();
+
+  /**
+   * ReadResponse - reads the response to the oldest outstanding request.
+   * Calling it again drops that response and reads the next one.
+   *
+   * @return OS_NoErr with the response in GetResponse, EAGAIN when the task
+   *         will get a kReadEvent to call this again, E2BIG for a header over
+   *         kMaxHeaderSize or a response over the pool's max response size,
+   *         EINVAL for a malformed response, or POSIX error code. ENOTCONN
+   *         when the server closed the connection.
+   */
+  OS_Error ReadResponse();
+
+  // valid after ReadResponse returned OS_NoErr, until the next call
+  HTTPPacket *GetResponse() { return fResponse; }
+
+  // the body, chunked transfer coding already removed
+  StrPtrLen *GetResponseBody() { return &fBody; }
+
+  // sent, or queued, and their response not read yet
+  UInt32 GetNumOutstanding() { return fNumOutstanding; }
+
+  UInt32 GetNumRequests() { return fNumRequests; }
+
+  // the server can take another request on this connection
+  bool IsKeepAlive() { return fKeepAlive; }
+
+  TCPSocket *GetSocket() { return &fSocket; }
+
+  HTTPClientHost *GetHost() { return fHost; }
+
+ private:
+
+  enum {
+    kInitialBufferSize = 4096,      // UInt32
+    kMaxHeaderSize = 64 * 1024      // UInt32
+  };
+
+  HTTPClientConnection(HTTPClientHost *inHost, bool inPipelining);
+
+  ~HTTPClientConnection();
+
+  // a new connection, or an idle one handed out again
+  void attach(Thread::Task *inTask, UInt32 inMaxResponseSize);
+
+  void detach();
+
+  // an idle connection that the server hasn't closed and that has no
+  // stray data waiting
+  bool isHealthy();
+
+  // the connection can be released to the idle list
+  bool isReusable();
+
+  // frames the response at the start of fBuffer, true once all of it is
+  // there
+  bool parseResponse(OS_Error *outErr);
+
+  // decodes the chunked body in place, true once the last chunk is there
+  bool parseChunked(OS_Error *outErr);
+
+  void completeResponse();
+
+  // drops the response in fResponse, if any
+  void dropResponse();
+
+  TCPSocket fSocket;
+  HTTPClientHost *fHost;
+
+  ResizeableStringFormatter fOutput;
+  UInt32 fOutputSent;
+
+  char *fBuffer;            // allocated on the first read
+  UInt32 fBufferSize;
+  UInt32 fBufferLength;     // bytes read, the response and pipelined ones
+  UInt32 fMaxResponseSize;  // fBufferSize never grows past it
+
+  UInt32 fHeaderLength;     // of the response being read, 0 if unknown yet
+  UInt32 fResponseLength;   // of the response in fResponse, 0 if none
+  UInt32 fBodyLength;       // decoded so far, for a chunked body
+  UInt32 fDecodePos;        // of the next chunk
+  HTTPPacket *fResponse;
+  StrPtrLen fResponseHeader;
+  StrPtrLen fBody;
+
+  UInt32 fNumOutstanding;
+  UInt32 fNumRequests;
+  bool fKeepAlive;
+  bool fPipelining;
+  bool fChunked;
+  bool fUntilClose;         // the response body ends when the server closes
+
+  SInt64 fIdleSince;
+  QueueElem fElem;
+
+  friend class HTTPClientPool;
+};
+
+class HTTPClientPool {
+ public:
+
+  enum {
+    kDefaultMaxIdlePerHost = 8,           // UInt32
+    kDefaultMaxPerHost = 64,              // UInt32
+    kDefaultIdleTimeoutInMilSecs = 30000, // UInt32
+    kDefaultMaxResponseSize = 16 * 1024 * 1024, // UInt32
+    kMaxResponseSize = 512 * 1024 * 1024        // UInt32, 9 digits
+  };
+
+  /**
+   * @param inMaxIdlePerHost - idle connections kept per host, past it the
+   *                           oldest one is closed
+   * @param inMaxPerHost - idle and acquired connections per host, 0 is no limit
+   * @param inIdleTimeoutInMilSecs - idle connections older than this are
+   *                                 closed, 0 keeps them
+   * @param inPipelining - connections take requests before the previous
+   *                       responses are read
+   */
+  HTTPClientPool(UInt32 inMaxIdlePerHost = kDefaultMaxIdlePerHost,
+                 UInt32 inMaxPerHost = kDefaultMaxPerHost,
+                 UInt32 inIdleTimeoutInMilSecs = kDefaultIdleTimeoutInMilSecs,
+                 bool inPipelining = false);
+
+  // closes the idle connections, all acquired ones must be released first
+  ~HTTPClientPool();
+
+  // timeout of new connections' connect, 0 (the default) is none
+  void SetConnectTimeout(UInt32 inMilSecs) { fConnectTimeoutInMilSecs = inMilSecs; }
+
+  // a connection is closed after this many requests, 0 (the default) is no limit
+  void SetMaxRequestsPerConnection(UInt32 inMaxRequests) { fMaxRequestsPerConnection = inMaxRequests; }
+
+  // Bytes a connection buffers for one response, header and framing
+  // included: ReadResponse gives E2BIG for a bigger one, before reading
+  // all of it when its Content-Length says so. Taken by connections as
+  // they are acquired. 0 restores the default, it can't be set above
+  // kMaxResponseSize.
+  void SetMaxResponseSize(UInt32 inMaxSize);
+
+  /**
+   * Acquire - gets a connection to the host for inTask, whose Run will get
+   * the connection's Socket events. Requests can be sent right away, also
+   * while a new connection is still connecting.
+   *
+   * @return OS_NoErr for an idle connection, EINPROGRESS for a new one,
+   *         EAGAIN if the host already has inMaxPerHost connections, or
+   *         POSIX error code.
+   */
+  OS_Error Acquire(UInt32 inAddr, UInt16 inPort, Thread::Task *inTask,
+                   HTTPClientConnection **outConnection);
+
+  // gives the connection back, it is kept idle if it can take another
+  // request and closed otherwise. Release it from the task it was
+  // acquired for, not after that task is gone.
+  void Release(HTTPClientConnection *inConnection);
+
+  // closes the idle connections that timed out or were closed by their
+  // server, returns how many
+  UInt32 EvictIdle();
+
+  UInt32 GetNumIdle() { return fNumIdle; }
+
+  UInt32 GetNumConnections() { return fNumConnections; }
+
+  UInt64 GetNumCreated() { return fNumCreated; }
+
+  UInt64 GetNumReused() { return fNumReused; }
+
+ private:
+
+  // closes the connection, and drops its host when it was the last one
+  void close(HTTPClientConnection *inConnection);
+
+  bool isExpired(HTTPClientConnection *inConnection, SInt64 inNow);
+
+  UInt32 fMaxIdlePerHost;
+  UInt32 fMaxPerHost;
+  UInt32 fIdleTimeoutInMilSecs;
+  bool fPipelining;
+  UInt32 fConnectTimeoutInMilSecs;
+  UInt32 fMaxRequestsPerConnection;
+  UInt32 fMaxResponseSize;
+
+  Core::Mutex fMutex;
+  OpenHashTable<HTTPClientHost, HTTPClientHostKey> fHosts;
+
+  UInt32 fNumIdle;
+  UInt32 fNumConnections;
+  UInt64 fNumCreated;
+  UInt64 fNumReused;
+};
+
+} // namespace Net
+} // namespace CF
+
+#endif // __HTTP_CLIENT_POOL_H__
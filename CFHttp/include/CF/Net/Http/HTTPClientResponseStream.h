@@ -34,7 +34,7 @@ class HTTPClientResponseStream : public ResizeableStringFormatter {
   // on the Socket.
   HTTPClientResponseStream(ClientSocket *inSocket,
                            Thread::TimeoutTask *inTimeoutTask)
-      : ResizeableStringFormatter(fOutputBuf, kOutputBufferSizeInBytes),
+      : ResizeableStringFormatter(nullptr, 0),
         fSocket(inSocket),
         fBytesSentInBuffer(0),
         fTimeoutTask(inTimeoutTask),
@@ -84,15 +84,8 @@ class HTTPClientResponseStream : public ResizeableStringFormatter {
 
  private:
 
-  enum {
-    kOutputBufferSizeInBytes = 64 * 1024 - 1  //64k Buffer UInt32
-  };
-
-  //The default buffer size is allocated inline as part of the object. Because this size
-  //is good enough for 99.9% of all requests, we avoid the dynamic memory allocation in most
-  //cases. But if the response is too big for this buffer, the BufferIsFull function will
-  //allocate a larger buffer.
-  char fOutputBuf[kOutputBufferSizeInBytes];
+  // No inline buffer: a client stream mostly sends small requests, the
+  // buffer is allocated by the first Put that needs it and grows from there.
   ClientSocket *fSocket;
   UInt32 fBytesSentInBuffer;
   Thread::TimeoutTask *fTimeoutTask;
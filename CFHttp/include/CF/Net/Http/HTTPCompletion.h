@@ -0,0 +1,84 @@
+/*
+    File:       HTTPCompletion.h
+
+    Contains:   The token an asynchronous handler finishes its request with.
+
+                A handler that has to wait for something, another service
+                say, takes the token with HTTPPacket::Defer and returns
+                CF_RequestPending. The session then sleeps without holding
+                a task thread until Complete is called, from any thread,
+                and sends the response. If that doesn't happen before the
+                timeout, the session answers 504 instead, as it gives up
+                when the client goes away, and a later Complete does
+                nothing.
+
+                So the request and the response can go away at any time
+                before Complete: only touch them between Lock and Unlock,
+                and only when Lock returns true.
+
+                    if (theCompletion->Lock()) {
+                      ... fill in the response ...
+                    }
+                    theCompletion->Unlock();
+                    theCompletion->Complete(CF_NoErr);
+
+                Complete must be called exactly once, after Unlock. The
+                token may be deleted by the time it returns.
+*/
+
+#ifndef __HTTP_COMPLETION_H__
+#define __HTTP_COMPLETION_H__
+
+#include <atomic>
+#include <CF/CFDef.h>
+#include <CF/Core/Mutex.h>
+#include <CF/Thread/Task.h>
+
+namespace CF {
+namespace Net {
+
+class HTTPCompletion {
+ public:
+
+  // true if the request and the response may be used until Unlock
+  bool Lock();
+
+  void Unlock() { fMutex.Unlock(); }
+
+  // inResult is taken as the handler's return value: CF_FileNotFound
+  // gives 404, another error 500
+  void Complete(CF_Error inResult = CF_NoErr);
+
+  SInt64 GetTimeoutInMs() { return fTimeoutInMs; }
+
+ private:
+
+  friend class HTTPPacket;
+  friend class HTTPSession;
+
+  // one reference for the packet, one for the handler
+  HTTPCompletion(Thread::Task *inSession, SInt64 inTimeoutInMs);
+
+  ~HTTPCompletion() = default;
+
+  // For the session. Returns true with the result once completed.
+  // Otherwise inGiveUp detaches the session, later calls change nothing.
+  bool poll(bool inGiveUp, CF_Error *outResult);
+
+  // the packet is going away
+  void detach();
+
+  void release();
+
+  Core::Mutex fMutex;
+  Thread::Task *fSession;   // nullptr once detached
+  SInt64 fTimeoutInMs;
+  bool fCompleted;
+  CF_Error fResult;
+  std::atomic<UInt32> fRefCount;
+};
+
+} // namespace Net
+} // namespace CF
+
+#endif // __HTTP_COMPLETION_H__
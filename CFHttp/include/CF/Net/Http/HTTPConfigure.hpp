@@ -8,7 +8,7 @@
 #include <CF/CFEnv.h>
 #include <CF/Net/Http/HTTPDef.h>
 #include <CF/Net/Http/HTTPListenerSocket.h>
-#include <CF/Net/Http/HTTPSessionInterface.h>
+#include <CF/Net/Http/HTTPSession.h>
 #include <CF/Net/Socket/SocketUtils.h>
 
 namespace CF {
@@ -25,8 +25,14 @@ class HTTPConfigure {
     // Http server configure;
     UInt32 numHttpListens;
     CF_NetAddr *httpListenAddrs = config->GetHttpListenAddr(&numHttpListens);
-    if (numHttpListens > 0) {
+    UInt32 numHttpListenPaths;
+    char **httpListenPaths = config->GetHttpListenPath(&numHttpListenPaths);
+    if (numHttpListens > 0 || numHttpListenPaths > 0) {
       HTTPSessionInterface::Initialize(config->GetHttpMapping());
+      HTTPResponseStream::SetZeroCopyThreshold(config->GetHttpZeroCopyThreshold());
+      HTTPSession::SetAdmissionLimits(config->GetHttpMaxConnections(),
+                                      config->GetHttpMaxQueueDelay());
+      HTTPRequestStream::SetMaxRequestSize(config->GetHttpMaxRequestSize());
       for (UInt32 i = 0; i < numHttpListens; i++) {
         auto *httpSocket = new HTTPListenerSocket();
         theErr = httpSocket->Initialize(SocketUtils::ConvertStringToAddr(
@@ -38,6 +44,16 @@ class HTTPConfigure {
           delete httpSocket;
         }
       }
+      for (UInt32 i = 0; i < numHttpListenPaths; i++) {
+        auto *httpSocket = new HTTPListenerSocket();
+        theErr = httpSocket->Initialize(httpListenPaths[i]);
+        if (theErr == CF_NoErr) {
+          CFEnv::AddListenerSocket(httpSocket);
+          httpSocket->RequestEvent(EV_RE);
+        } else {
+          delete httpSocket;
+        }
+      }
     }
 
     return CF_NoErr;
@@ -72,6 +88,43 @@ class HTTPConfigure {
     return defaultHttpAddrs;
   }
 
+  /**
+   * unix domain Socket paths to serve http on, for local clients such as
+   * sidecars and health checkers. None by default.
+   */
+  virtual char **GetHttpListenPath(UInt32 *outNum) {
+    *outNum = 0;
+    return nullptr;
+  }
+
+  /**
+   * responses buffered in memory of at least this many bytes are sent with
+   * MSG_ZEROCOPY where the kernel supports it. 0 turns it off. Pays off for
+   * bodies of a few hundred KB and up, below that the page pinning and
+   * completion handling cost more than the copy.
+   */
+  virtual UInt32 GetHttpZeroCopyThreshold() { return 0; }
+
+  /**
+   * sessions over this many are answered with a 503 and closed, and the
+   * listeners pause accepting for a while. 0 means no limit.
+   */
+  virtual UInt32 GetHttpMaxConnections() { return 0; }
+
+  /**
+   * requests are answered with a 503 while the task threads' run queue
+   * delay, in ms, is over this, so a burst is shed instead of every request
+   * timing out. 0 turns it off.
+   */
+  virtual UInt32 GetHttpMaxQueueDelay() { return 0; }
+
+  /**
+   * request line and headers larger than this are answered with a 414 or a
+   * 431 and the connection is closed. Request buffers start at 2 KB and
+   * double up to it, 1 MB at most. 0 means 16 KB.
+   */
+  virtual UInt32 GetHttpMaxRequestSize() { return 0; }
+
 };
 
 }
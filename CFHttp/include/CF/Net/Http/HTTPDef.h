@@ -6,11 +6,13 @@
 #define __CF_HTTP_DEF_H__
 
 #include <CF/Net/Http/HTTPPacket.h>
+#include <CF/Net/Http/HTTPCompletion.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* CF_RequestPending 表示异步处理，见 HTTPCompletion */
 typedef CF_Error (*CF_CGIFunction) (CF::Net::HTTPPacket &request,
                                     CF::Net::HTTPPacket &response);
 
@@ -2,138 +2,101 @@
 // Created by james on 8/26/17.
 //
 
+/*
+    Routes map the relative URI of a request, and optionally its method, to
+    a CF_CGIFunction. A pattern is one of
+
+      "/a/b"          exact
+      "/users/{id}"   exact, {id} matches one non-empty path segment, which
+                      the handler gets with HTTPPacket::GetPathParam("id")
+      "/static/*"     wildcard, any path starting with "/static"
+      "*.html"        extension
+      "/"             default, any path
+
+    and they are tried in that order, the longest wildcard first. Static
+    segments are preferred to {name} ones. A route for a method wins over
+    one for any method; a path that only has routes for other methods gets
+    405 Method Not Allowed.
+
+    The exact and wildcard patterns are kept in a compressed radix tree on
+    their bytes, so finding a route costs the length of the path rather than
+    the number of routes. A tree is never changed once it is published:
+    AddRoute, RemoveRoute and SetMapping build a new one and swap it in
+    under RCU, so Dispatch takes no lock and routes can change while
+    requests are served.
+*/
+
 #ifndef __HTTP_DISPATCHER_H__
 #define __HTTP_DISPATCHER_H__
 
+#include <atomic>
+#include <CF/Core/Mutex.h>
+#include <CF/Core/RCU.h>
 #include <CF/Net/Http/HTTPDef.h>
 #include <CF/Net/Http/HTTPPacket.h>
 
 namespace CF {
 namespace Net {
 
-class HTTPPathMapper;
-
 class HTTPDispatcher {
  public:
 
+  // mapping ends with an entry whose path or func is NULL. A path may start
+  // with a method name and a space, "GET /users/{id}", to only match it.
   HTTPDispatcher(HTTPMapping *mapping);
 
-  virtual ~HTTPDispatcher() { delete[] fMappers; }
+  virtual ~HTTPDispatcher();
 
+  // Lock free. The handler is called outside the RCU read section, so it
+  // may change the routes itself.
   CF_Error Dispatch(HTTPPacket &request, HTTPPacket &response);
 
- private:
-  HTTPPathMapper **fMappers;
-  UInt32 fMapperNum;
-};
-
-class HTTPPathMapper {
- public:
-  // 四种类型的映射器
-  enum {
-    httpExactMapper = 0,
-    httpWildcardMapper = 1,
-    httpExtensionMapper = 2,
-    httpDefaultMapper = 4
-  };
-
-  static HTTPPathMapper *BuildPathMatcher(HTTPMapping &mapping);
-
-  static int ComparePriority(HTTPPathMapper *aMapper, HTTPPathMapper *bMapper);
-
-  virtual ~HTTPPathMapper() = default;;
-
-  virtual UInt32 ItsType() = 0;
-
-  virtual bool Match(const StrPtrLen &path) = 0;
-
-  CF_Error Mapping(HTTPPacket &request, HTTPPacket &response) {
-    return fFunc(request, response);
-  }
+  // Adds a route, or replaces the one with the same method and pattern.
+  // httpIllegalMethod matches any method. CF_BadArgument if inPattern is
+  // malformed, or names a parameter differently than a route sharing its
+  // prefix does.
+  CF_Error AddRoute(HTTPMethod inMethod, char const *inPattern,
+                    CF_CGIFunction inFunc);
 
- protected:
-  HTTPPathMapper(HTTPMapping mapping) : fFunc(mapping.func) {}
+  // CF_ValueNotFound if there is no such route
+  CF_Error RemoveRoute(HTTPMethod inMethod, char const *inPattern);
 
-  CF_CGIFunction fFunc;
+  // Replaces all the routes. Entries that can't be added are logged and
+  // left out.
+  void SetMapping(HTTPMapping *mapping);
 
-  static StrPtrLen sAllSuffix;
-  static StrPtrLen sTypePrefix;
-  static StrPtrLen sRootPath;
-};
+  // The writers grab the Mutex and wait for the readers of the table they
+  // replace, don't call them from inside a read section of the RCU.
+  Core::Mutex *GetMutex() { return &fMutex; }
 
-class ExactPathMapper : public HTTPPathMapper {
- public:
-  ExactPathMapper(HTTPMapping mapping) : HTTPPathMapper(mapping) {
-    auto len = static_cast<UInt32>(strlen(mapping.path));
-    char *buffer = new char[len + 1];
-    memcpy(buffer, mapping.path, len);
-    buffer[len] = '\0';
-    pattern.Set(buffer, len);
-  }
-  ~ExactPathMapper() override { delete[] pattern.Ptr; }
+ private:
 
-  UInt32 ItsType() override { return httpExactMapper; }
+  struct Route {
+    HTTPMethod fMethod;
+    char *fPattern;
+    CF_CGIFunction fFunc;
+  };
 
-  bool Match(const StrPtrLen &path) override { return pattern.Equal(path); }
+  struct Table;
 
- private:
-  StrPtrLen pattern;
-};
+  // writers only, with fMutex held
 
-class WildcardPathMapper : public HTTPPathMapper {
- public:
-  WildcardPathMapper(HTTPMapping mapping) : HTTPPathMapper(mapping) {
-    // xxxxx/*
-    auto len = static_cast<UInt32>(strlen(mapping.path) - 2);
-    char *buffer = new char[len + 1];
-    memcpy(buffer, mapping.path, len);
-    buffer[len] = '\0';
-    pattern.Set(buffer, len);
-  }
-  ~WildcardPathMapper() override { delete[] pattern.Ptr; }
-
-  UInt32 ItsType() override { return httpWildcardMapper; }
-
-  bool Match(const StrPtrLen &path) override {
-    if (path.Len < pattern.Len) return false;
-    StrPtrLen op(path.Ptr, pattern.Len);
-    return pattern.Equal(op);
-  }
- private:
-  StrPtrLen pattern;
-};
+  UInt32 findRoute(HTTPMethod inMethod, char const *inPattern);
+  void appendRoute(HTTPMethod inMethod, char const *inPattern,
+                   CF_CGIFunction inFunc);
+  void removeRoute(UInt32 inIndex);
 
-class ExtensionPathMapper : public HTTPPathMapper {
- public:
-  ExtensionPathMapper(HTTPMapping mapping) : HTTPPathMapper(mapping) {
-    // *.ext
-    auto len = static_cast<UInt32>(strlen(mapping.path) - 1);
-    char *buffer = new char[len + 1];
-    memcpy(buffer, mapping.path + 1, len);
-    buffer[len] = '\0';
-    pattern.Set(buffer, len);
-  }
-  ~ExtensionPathMapper() override { delete[] pattern.Ptr; }
-
-  UInt32 ItsType() override { return httpExtensionMapper; }
-
-  bool Match(const StrPtrLen &path) override {
-    if (path.Len < pattern.Len) return false;
-    StrPtrLen op(path.Ptr + (path.Len - pattern.Len), pattern.Len);
-    return pattern.Equal(op);
-  }
- private:
-  StrPtrLen pattern;
-};
+  // builds a table of fRoutes and swaps it in
+  CF_Error publish();
 
-class DefaultPathMapper : public HTTPPathMapper {
- public:
-  DefaultPathMapper(HTTPMapping mapping) : HTTPPathMapper(mapping) {}
-  ~DefaultPathMapper() override = default;
+  Route *fRoutes;
+  UInt32 fNumRoutes;
+  UInt32 fMaxRoutes;
 
-  UInt32 ItsType() override { return httpDefaultMapper; }
+  std::atomic<Table *> fTable;
 
-  bool Match(const StrPtrLen &path) override { return true; }
+  Core::Mutex fMutex;   // serializes writers
+  Core::RCU fRCU;       // readers of fTable
 };
 
 } // namespace Net
@@ -26,14 +26,23 @@
 #define __HTTP_PACKET_H__
 
 #include <CF/CFDef.h>
+#include <CF/Arena.h>
+#include <CF/FileSource.h>
 #include <CF/StringParser.h>
 #include <CF/ResizeableStringFormatter.h>
 #include <CF/Net/Http/HTTPProtocol.h>
 #include <CF/Net/Http/QueryParamList.h>
 
 namespace CF {
+
+namespace Thread {
+class Task;
+}
+
 namespace Net {
 
+class HTTPCompletion;
+
 class HTTPPacket {
  public:
 
@@ -41,21 +50,28 @@ class HTTPPacket {
    * @brief construct object for parse http packet header.
    *
    * @param packetPtr - http packet data
+   * @param inArena - where the packet's own allocations come from, the
+   *                  heap if nullptr. It must outlive the packet.
    */
-  HTTPPacket(StrPtrLen *packetPtr);
+  HTTPPacket(StrPtrLen *packetPtr, Arena *inArena = nullptr);
 
   /**
    * @brief construct object for build http packet
    *
    * @param httpType - http packet type
+   * @param inArena - as above
    */
-  HTTPPacket(HTTPType httpType = httpResponseType);
+  HTTPPacket(HTTPType httpType = httpResponseType, Arena *inArena = nullptr);
 
   // Destructor
   virtual ~HTTPPacket();
 
   HTTPType GetHTTPType() { return fHTTPType; }
 
+  // nullptr for a packet on the heap. Handlers can take request scoped
+  // memory from it, it is reset after the response is sent.
+  Arena *GetArena() { return fArena; }
+
   /**
    * @brief parse http request header
    *
@@ -72,7 +88,10 @@ class HTTPPacket {
   HTTPMethod GetMethod() { return fMethod; }
   HTTPVersion GetVersion() { return fVersion; }
   HTTPStatusCode GetStatusCode() { return fStatusCode; }
-  bool IsRequestKeepAlive() { return fRequestKeepAlive; }
+  // from the Connection header, false without one
+  bool IsRequestKeepAlive();
+  // overrides the Connection header, e.g. to close after an error
+  void SetRequestKeepAlive(bool inKeepAlive);
 
   StrPtrLen *GetRequestLine() { return &fRequestLine; }
   StrPtrLen *GetRequestAbsoluteURI() { return &fAbsoluteURI; }
@@ -84,8 +103,19 @@ class HTTPPacket {
 
   char const *GetQueryValues(char *inParam);
 
-  // If header field exists in the request, it will be found in the dictionary
-  // and the value returned. Otherwise, NULL is returned.
+  enum {
+    kMaxPathParams = 8   // UInt32, {name} segments in one route pattern
+  };
+
+  // The part of the relative URI matched by {inName} in the pattern of the
+  // route the request was dispatched to, as sent (not URL decoded).
+  // nullptr if that pattern has no such parameter.
+  StrPtrLen *GetPathParam(char const *inName);
+  UInt32 GetNumPathParams() { return fNumPathParams; }
+
+  // If header field exists in the request, its value is returned, empty
+  // otherwise. NULL for httpIllegalHeader. The header lines are matched
+  // against inHeader on its first lookup, Parse doesn't classify them.
   StrPtrLen *GetHeaderValue(HTTPHeader inHeader);
 
   // Creates a header
@@ -109,9 +139,11 @@ class HTTPPacket {
   StrPtrLen *GetCompleteHTTPHeader() const;
 
   StrPtrLen *GetBody() { return fHTTPBody; }
+  // a body from NewBody belongs to the arena, don't delete it
   StrPtrLen *GetAndSetBody(StrPtrLen *body) {
     StrPtrLen *old = fHTTPBody;
     fHTTPBody = body;
+    fBodyInArena = false;
     return old;
   }
 
@@ -120,8 +152,61 @@ class HTTPPacket {
    *       需要使用 StrPtrLenDel
    */
   void SetBody(StrPtrLen *body) {
-    delete fHTTPBody;
+    if (!fBodyInArena)
+      delete fHTTPBody;
     fHTTPBody = body;
+    fBodyInArena = false;
+  }
+
+  /**
+   * @brief makes the request asynchronous, for a handler that returns
+   *        CF_RequestPending and completes it later. See HTTPCompletion.
+   *
+   * @param inTimeoutInMs - the session answers 504 if the request isn't
+   *                        completed in this time, 0 for its usual timeout.
+   *                        The TimeoutTask thread checks it, so it may
+   *                        fire up to its interval late.
+   * @return the token, the same one on each call. nullptr if no session
+   *         serves the request.
+   */
+  HTTPCompletion *Defer(SInt64 inTimeoutInMs = 0);
+
+  /**
+   * @brief replaces the body with inLength uninitialized bytes for the
+   *        caller to fill in, taken from the packet's arena if it has one.
+   */
+  StrPtrLen *NewBody(UInt32 inLength);
+
+  /**
+   * @brief use a file as (the rest of) the body, after any SetBody data.
+   *
+   * HTTPSession streams it with sendfile, or splice when the fd is a pipe,
+   * so the file bytes never pass through user space.
+   *
+   * @note the FileSource object is owned by the packet from now on.
+   */
+  void SetBodyFile(FileSource *file, UInt64 offset, UInt64 length);
+  void SetBodyFile(FileSource *file) {
+    SetBodyFile(file, 0, file != nullptr ? file->GetLength() : 0);
+  }
+
+  /**
+   * @brief same as SetBodyFile for a plain fd, which may be a pipe.
+   *
+   * @param closeFD - close the fd when the packet is destroyed
+   */
+  void SetBodyFD(int fd, UInt64 offset, UInt64 length, bool closeFD);
+
+  bool HasBodyFile() { return fBodyFD != -1; }
+  int GetBodyFD() { return fBodyFD; }
+  bool IsBodyPipe() { return fBodyIsPipe; }
+  UInt64 *GetBodyFileOffset() { return &fBodyOffset; }
+  UInt64 GetBodyFileLength() { return fBodyLength; }
+
+  // Sending side: drops inLength bytes from the front of the file body
+  void ConsumeBodyFile(UInt64 inLength) {
+    Assert(inLength <= fBodyLength);
+    fBodyLength -= inLength;
   }
 
   //
@@ -140,16 +225,59 @@ class HTTPPacket {
   CF_Error parseRequestLine(StringParser *parser);
   // Parses the URI to get absolute and relative URIs, the host name and the file path
   CF_Error parseURI(StringParser *parser);
-  // Parses the headers and adds them into a dictionary
-  // Also calls SetKeepAlive with the Connection header field's value if it exists
+  // Checks the headers are well formed and records where each line's name
+  // and value are, in fHeaderLines
   CF_Error parseHeaders(StringParser *parser);
 
   // Sets fRequestKeepAlive
   void setKeepAlive(StrPtrLen *keepAliveValue);
 
+  // Finds the value of inHeader in fHeaderLines, into fFieldValues
+  void resolveHeader(HTTPHeader inHeader);
+
+  // Sets the fHeader of every line, on the first lookup
+  void classifyHeaderLines();
+
+  // A header line of a parsed packet, as offsets into fPacketHeader
+  struct HeaderLine {
+    UInt32 fNameOffset;
+    UInt32 fNameLen;
+    UInt32 fValueOffset;
+    UInt32 fValueLen;
+    HTTPHeader fHeader;  // httpIllegalHeader for unknown names
+  };
+
+  enum {
+    kNumInlineHeaderLines = 32   // UInt32, more are kept in fArena or on the heap
+  };
+
+  void addHeaderLine(UInt32 inNameOffset, UInt32 inNameLen,
+                     UInt32 inValueOffset, UInt32 inValueLen);
+
+  // Set by HTTPDispatcher. The names are copied, the values point into
+  // fRelativeURI.
+  friend class HTTPDispatcher;
+  friend class HTTPSession;
+  void setPathParams(StrPtrLen *inNames, StrPtrLen *inValues, UInt32 inNum);
+  void clearPathParams();
+
   //
   // For construct
 
+  // fArena's memory, or the heap's
+  char *newString(UInt32 inLength);
+  void deleteString(char *inString);
+  template<typename T>
+  void destroy(T *inObject) {
+    if (fArena == nullptr)
+      delete inObject;
+    else if (inObject != nullptr)
+      inObject->~T();
+  }
+
+  // a fresh fHTTPHeader and fHTTPHeaderFormatter
+  void newHeader();
+
   // Used in initialize and CreateResponseHeader
   static void putStatusLine(StringFormatter *putStream,
                             HTTPStatusCode status,
@@ -165,13 +293,29 @@ class HTTPPacket {
   //
   // Private members
 
+  Arena *fArena;
+
   // Complete request and response headers
   StrPtrLen fPacketHeader; // for parse
   ResizeableStringFormatter *fHTTPHeaderFormatter; // for construct
   StrPtrLen *fHTTPHeader; // for construct. it really is StrPtrLenDel
+  // fHTTPHeader keeps the first buffer to delete it, the formatter moves
+  // to a larger one when the header outgrows it
+  mutable StrPtrLen fCompleteHTTPHeader;
 
   // request and repose body
   StrPtrLen *fHTTPBody;
+  bool fBodyInArena;  // from NewBody, with fArena
+
+  // file part of the body, sent after fHTTPBody
+  void setBodyFD(int fd, UInt64 offset, UInt64 length);
+  void clearBodyFile();
+  FileSource *fBodyFile;
+  int fBodyFD;
+  bool fCloseBodyFD;
+  bool fBodyIsPipe;
+  UInt64 fBodyOffset;
+  UInt64 fBodyLength;
 
   HTTPType fHTTPType;
 
@@ -194,10 +338,24 @@ class HTTPPacket {
   char *fRequestPath; // Also contains the query string
   char *fQueryString;
 
-  QueryParamList *fQueryValues;
+  QueryParamList *fQueryValues; // made on the first GetQueryValues
+
+  // set by HTTPSession, fCompletion is made by Defer
+  Thread::Task *fSessionTask;
+  HTTPCompletion *fCompletion;
+
+  StrPtrLen fPathParamNames[kMaxPathParams];
+  StrPtrLen fPathParamValues[kMaxPathParams];
+  UInt32 fNumPathParams;
 
   bool fRequestKeepAlive;  // Keep-alive information in the client request
   StrPtrLen fFieldValues[httpNumHeaders]; // Array of header field values parsed from the request
+  UInt64 fResolvedHeaders; // bit per HTTPHeader, its fFieldValues is looked up already
+
+  HeaderLine *fHeaderLines;  // fInlineHeaderLines, or a bigger array
+  UInt32 fNumHeaderLines;
+  UInt32 fMaxHeaderLines;
+  HeaderLine fInlineHeaderLines[kNumInlineHeaderLines];
   StrPtrLen fSvrHeader;  // Server header set up at initialization
 
   static StrPtrLen sColonSpace;
@@ -184,15 +184,16 @@ typedef enum {
   httpUnsupportedMediaType = 31,         //415
   httpRequestRangeNotSatisfiable = 32,   //416
   httpExpectationFailed = 33,            //417
+  httpRequestHeaderFieldsTooLarge = 34,  //431
 
-  httpInternalServerError = 34,          //500
-  httpNotImplemented = 35,               //501
-  httpBadGateway = 36,                   //502
-  httpServiceUnavailable = 37,           //503
-  httpGatewayTimeout = 38,               //504
-  httpHTTPVersionNotSupported = 39,      //505
+  httpInternalServerError = 35,          //500
+  httpNotImplemented = 36,               //501
+  httpBadGateway = 37,                   //502
+  httpServiceUnavailable = 38,           //503
+  httpGatewayTimeout = 39,               //504
+  httpHTTPVersionNotSupported = 40,      //505
 
-  httpNumStatusCodes = 40
+  httpNumStatusCodes = 41
 } HTTPStatusCode;
 
 class HTTPProtocol {
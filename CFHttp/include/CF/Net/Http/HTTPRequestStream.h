@@ -38,6 +38,7 @@
 
 //INCLUDES
 #include <CF/CFDef.h>
+#include <CF/BufferPool.h>
 #include <CF/Net/Socket/TCPSocket.h>
 
 namespace CF {
@@ -50,11 +51,7 @@ class HTTPRequestStream {
 
   explicit HTTPRequestStream(TCPSocket *sock);
 
-  // We may have to delete this memory if it was allocated due to base64 decoding
-  ~HTTPRequestStream() {
-    if (fRequest.Ptr != &fRequestBuffer[0])
-      delete[] fRequest.Ptr;
-  }
+  ~HTTPRequestStream();
 
   /**
    * @brief ReadRequest - read request header
@@ -62,13 +59,17 @@ class HTTPRequestStream {
    * Attempts to read data into the stream, stopping when we hit the EOL - EOL
    * that ends an HTTP header.
    *
-   * @note This function will not block.
+   * @note This function will not block. The request buffer is taken from a
+   *       shared pool when data arrives, and given back when the Socket has
+   *       nothing more and no data of a next request is left in it, so an
+   *       idle connection holds no buffer. A request that doesn't fit moves
+   *       to a buffer twice as big, up to the size of SetMaxRequestSize.
    *
    * @return CF_NoErr          - Out of data, haven't hit EOL - EOL yet
    * @return CF_RequestArrived - full request has arrived
    * @return CF_RequestFailed  - if the client has disconnected
    * @return CF_OutOfState
-   * @return E2BIG             - ran out of buffer space
+   * @return E2BIG             - the header is larger than SetMaxRequestSize
    * @return EINVAL            - if we are base64 decoding and the stream is corrupt
    */
   CF_Error ReadRequest();
@@ -108,23 +109,66 @@ class HTTPRequestStream {
 
   void SnarfRetreat(HTTPRequestStream &fromRequest);
 
+  /**
+   * After E2BIG, whether the request line was complete. If it wasn't, the
+   * URI is what's too long (414), otherwise the header fields are (431).
+   */
+  bool HasRequestLine();
+
+  /**
+   * The largest request header, request line included, that is read.
+   * Rounded up to a buffer size, between CF_MAX_REQUEST_BUFFER_SIZE and
+   * kMaxRequestSize. 0 restores the default.
+   */
+  static void SetMaxRequestSize(UInt32 inMaxSize);
+
+  enum {
+    kDefaultMaxRequestSize = 16 * 1024,   //UInt32
+    kMaxRequestSize = 1024 * 1024         //UInt32
+  };
+
  private:
 
   //CONSTANTS:
   enum {
-    kRequestBufferSizeInBytes = CF_MAX_REQUEST_BUFFER_SIZE        //UInt32
+    kRequestBufferSizeInBytes = CF_MAX_REQUEST_BUFFER_SIZE,       //UInt32
+    kNumBufferSizes = 10  // UInt32, kRequestBufferSizeInBytes << 0..9
   };
 
   // Base64 decodes into fRequest.Ptr, updates fRequest.Len, and returns the amount
   // of data left undecoded in inSrcData
   CF_Error DecodeIncomingData(char *inSrcData, UInt32 inSrcDataLen);
 
+  // takes the request buffer from the pool, if not held yet
+  void getBuffer();
+
+  // gives it back, when it holds no data
+  void putBuffer();
+
+  // the header of fRequest is complete, how long it is
+  bool findEndOfHeader(UInt32 *outHeaderLength);
+
+  // a first line without blanks is all there is
+  bool isShoutCast(UInt32 inLineEnd, UInt32 *outHeaderLength);
+
+  // a full buffer: moves the partial request to its start, or to a bigger
+  // buffer. false at the size limit.
+  bool makeRoom();
+
+  static BufferPool *getBufferPool(UInt32 inClass);
+
+  static UInt32 bufferSize(UInt32 inClass) { return kRequestBufferSizeInBytes << inClass; }
+
+  static UInt32 sMaxRequestSize;
+
   TCPSocket *fSocket;
   UInt32 fRetreatBytes;
   UInt32 fRetreatBytesRead; // Used by Read() when it is reading RetreatBytes
 
-  char fRequestBuffer[kRequestBufferSizeInBytes];
+  char *fRequestBuffer;  // from the pool, nullptr while idle
+  UInt32 fBufferClass;   // fRequestBuffer is kRequestBufferSizeInBytes << this
   UInt32 fCurOffset; // tracks how much valid data is in the above buffer
+  UInt32 fHeaderScanned; // of fRequest, the start of the first line not seen complete
   UInt32
       fEncodedBytesRemaining; // If we are decoding, tracks how many encoded bytes are in the buffer
 
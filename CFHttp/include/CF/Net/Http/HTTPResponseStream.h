@@ -36,7 +36,9 @@
 #ifndef __HTTP_RESPONSE_STREAM_H__
 #define __HTTP_RESPONSE_STREAM_H__
 
+#include <atomic>
 #include <CF/CFDef.h>
+#include <CF/BufferPool.h>
 #include <CF/ResizeableStringFormatter.h>
 #include <CF/Net/Socket/TCPSocket.h>
 #include <CF/Thread/TimeoutTask.h>
@@ -51,13 +53,19 @@ class HTTPResponseStream : public ResizeableStringFormatter {
   // It also refreshes the timeout whenever there is a successful write
   // on the Socket.
   HTTPResponseStream(TCPSocket *inSocket, Thread::TimeoutTask *inTimeoutTask)
-      : ResizeableStringFormatter(fOutputBuf, kOutputBufferSizeInBytes),
+      : ResizeableStringFormatter(nullptr, 0),
+        fPooledBuffer(nullptr),
         fSocket(inSocket),
         fBytesSentInBuffer(0),
         fTimeoutTask(inTimeoutTask),
-        fPrintRTSP(false) {}
+        fPrintRTSP(false),
+        fZeroCopyTried(false),
+        fBufferPinned(false),
+        fBufferSequence(0),
+        fPinnedHead(nullptr),
+        fPinnedTail(nullptr) {}
 
-  virtual ~HTTPResponseStream() {}
+  ~HTTPResponseStream() override;
 
   // WriteV
   //
@@ -85,28 +93,93 @@ class HTTPResponseStream : public ResizeableStringFormatter {
   CF_Error WriteV(iovec *inVec, UInt32 inNumVectors, UInt32 inTotalLength,
                   UInt32 *outLengthSent, UInt32 inSendType);
 
+  // WriteSegments
+  //
+  // Sends the segments, e.g. a response header and its body, with one WriteV
+  // straight from where they are, after whatever is still buffered. Only the
+  // part the Socket doesn't take is copied into the buffer, for Flush to
+  // send. Empty segments are skipped, at most kMaxSegments are taken.
+  //
+  // Returns QTSS_NoErr when all of it was sent or buffered, otherwise the
+  // Socket error.
+  enum {
+    kMaxSegments = 8
+  };
+
+  CF_Error WriteSegments(StrPtrLen *inSegments, UInt32 inNumSegments);
+
   // Flushes any buffered data to the Socket. If all data could be sent,
-  // this returns QTSS_NoErr, otherwise, it returns EWOULDBLOCK
+  // this returns QTSS_NoErr, if the Socket is flow-controlled, it returns
+  // EWOULDBLOCK, otherwise the Socket error.
   CF_Error Flush();
 
+  // Bytes buffered but not yet accepted by the Socket.
+  UInt32 GetPendingBytes() { return this->GetCurrentOffset() - fBytesSentInBuffer; }
+
+  // Past this much pending output, buffered writers get EWOULDBLOCK and
+  // should wait for a writable event instead of buffering more.
+  bool IsOverHighWater() { return GetPendingBytes() >= kMaxPendingBytes; }
+
   void ShowRTSP(bool enable) { fPrintRTSP = enable; }
 
+  // Buffered output of at least this many bytes is sent with MSG_ZEROCOPY,
+  // 0 (the default) turns zero copy off. Values below the pooled buffer
+  // size are raised to it, only dynamically allocated buffers are pinned.
+  static void SetZeroCopyThreshold(UInt32 inThreshold);
+
+  // Frees the buffers the kernel is done with. Returns true while some
+  // buffer is still pinned by an unfinished zero copy send.
+  bool ReapZeroCopy();
+
+  // Buffers still pinned when their stream was destroyed. They are never
+  // freed: the kernel may retransmit from them after the Socket is gone.
+  static UInt32 GetNumLeakedBuffers() { return sNumLeakedBuffers; }
+
  private:
 
+  // a buffer handed to MSG_ZEROCOPY, freed once fSequence completes
+  struct PinnedBuffer {
+    char *fBuffer;
+    UInt32 fSequence;
+    PinnedBuffer *fNext;
+  };
+
+  bool useZeroCopy(UInt32 inLength);
+
+  // empties the buffer after everything in it was sent
+  void resetBuffer();
+
+  // the first Put of a response borrows a buffer from the pool
+  bool BufferIsFull(char *inBuffer, UInt32 inBufferLen) override;
+
+  void ReleaseBuffer(char *inBuffer) override;
+
+  static BufferPool *getBufferPool();
+
   enum {
-    kOutputBufferSizeInBytes = CF_MAX_REQUEST_BUFFER_SIZE  //UInt32
+    kOutputBufferSizeInBytes = CF_MAX_REQUEST_BUFFER_SIZE,  //UInt32
+    kMaxPendingBytes = 256 * 1024
   };
 
-  //The default buffer size is allocated inline as part of the object. Because this size
-  //is good enough for 99.9% of all requests, we avoid the dynamic memory allocation in most
-  //cases. But if the response is too big for this buffer, the BufferIsFull function will
-  //allocate a larger buffer.
-  char fOutputBuf[kOutputBufferSizeInBytes];
+  //A buffer of the default size is good enough for 99.9% of all responses. It comes from
+  //a pool shared by all streams while there is output, and goes back once all of it is
+  //sent, so idle connections hold none. If the response is too big for it, ResizeableStringFormatter
+  //allocates a larger buffer.
+  char *fPooledBuffer;
   TCPSocket *fSocket;
   UInt32 fBytesSentInBuffer;
   Thread::TimeoutTask *fTimeoutTask;
   bool fPrintRTSP;     // debugging printfs
 
+  bool fZeroCopyTried;      // EnableZeroCopy was called on fSocket
+  bool fBufferPinned;       // the current buffer was sent with zero copy
+  UInt32 fBufferSequence;   // completes once the current buffer is released
+  PinnedBuffer *fPinnedHead;
+  PinnedBuffer *fPinnedTail;
+
+  static UInt32 sZeroCopyThreshold;
+  static std::atomic<UInt32> sNumLeakedBuffers;
+
   friend class HTTPRequestInterface;
 };
 
@@ -0,0 +1,67 @@
+/*
+    File:       HTTPScanner.h
+
+    Contains:   Finds the delimiters of an HTTP/1.x header (':', '\r' and
+                '\n') 64 bytes at a time.
+
+                Each block of the buffer is compared against the delimiters
+                with AVX2 or SSE2 when the CPU has them, and with a plain
+                loop otherwise, into a bit mask of where they are. Next
+                then only has to find the lowest bit, so the header is
+                gone over once, however many fields it has.
+*/
+
+#ifndef __HTTP_SCANNER_H__
+#define __HTTP_SCANNER_H__
+
+#include <CF/Types.h>
+
+namespace CF {
+namespace Net {
+
+class HTTPScanner {
+ public:
+
+  enum Delimiters {
+    kEOL = 0,     // '\r' and '\n'
+    kHeader = 1   // ':', '\r' and '\n'
+  };
+
+  HTTPScanner(char const *inData, UInt32 inLength, Delimiters inDelimiters);
+
+  /**
+   * Next - finds the first delimiter at or after inFrom. Scanning forward
+   * only loads the blocks in between once.
+   *
+   * @return its offset, or GetLength() if there is none
+   */
+  UInt32 Next(UInt32 inFrom);
+
+  UInt32 GetLength() { return fLength; }
+
+  // the implementation in use, "avx2", "sse2" or "scalar"
+  static char const *GetImplementation();
+
+  typedef UInt64 (*BlockMaskFunc)(char const *inBlock, char const *inDelimiters);
+
+ private:
+
+  enum {
+    kBlockSize = 64   // UInt32, bits in fMask
+  };
+
+  void loadBlock(UInt32 inBlockStart);
+
+  char const *fData;
+  UInt32 fLength;
+  char fDelimiters[3];
+  BlockMaskFunc fBlockMask;
+
+  UInt32 fBlockStart;   // of the block in fMask
+  UInt64 fMask;         // bit i set when fData[fBlockStart + i] is a delimiter
+};
+
+} // namespace Net
+} // namespace CF
+
+#endif // __HTTP_SCANNER_H__
@@ -16,6 +16,36 @@ class HTTPSession : public HTTPSessionInterface {
                           bool connectionClose,
                           bool decrement) override;
 
+  /**
+   * Admission control, 0 turns a limit off.
+   *
+   * @param inMaxConnections - sessions over this many answer their request
+   *                           with 503 and close, the listeners slow down
+   * @param inMaxQueueDelayInMs - requests are answered with 503 while the
+   *                              task thread's run queue delay is over this
+   */
+  static void SetAdmissionLimits(UInt32 inMaxConnections,
+                                 UInt32 inMaxQueueDelayInMs);
+
+  /**
+   * The largest request body that is read, a larger Content-Length is
+   * answered with 413 and the connection closed. 0 restores the default,
+   * it can't be set above kMaxRequestBodySize.
+   */
+  static void SetMaxRequestBodySize(UInt32 inMaxSize);
+
+  enum {
+    kDefaultMaxRequestBodySize = 8 * 1024 * 1024,  //UInt32
+    kMaxRequestBodySize = 512 * 1024 * 1024        //UInt32, 9 digits
+  };
+
+  // test current connections handled by this object against server pref connection limit
+  static bool OverMaxConnections(UInt32 buffer);
+
+  static UInt32 GetNumSessions() { return sNumSessions; }
+
+  static UInt64 GetNumShedRequests() { return sNumShedRequests; }
+
  private:
   SInt64 Run() override;
 
@@ -25,13 +55,37 @@ class HTTPSession : public HTTPSessionInterface {
   CF_Error SetupResponse();
   void CleanupRequestAndResponse();
 
-  // test current connections handled by this object against server pref connection limit
-  static inline bool OverMaxConnections(UInt32 buffer);
+  // a handler's result, as the response's status
+  void setResultStatus(CF_Error inResult);
+
+  // over a limit of SetAdmissionLimits, the request gets the 503
+  bool shouldShed();
+
+  void sendServiceUnavailable();
 
   CF_Error dumpRequestData();
 
+  // Streams the response's file body straight from the fd to the Socket.
+  // Returns EAGAIN when flow-controlled.
+  CF_Error sendBodyFile();
+
+  enum {
+    kSendFileChunkSize = 1024 * 1024, // per sendfile / splice call
+    kPipePollIntervalInMs = 10,
+    kZeroCopyLingerInMs = 10, // poll for completions before deleting
+    kMaxDrainReads = 64,      // unread input dropped before a close, in 2 KB reads
+    kLingerTimeoutInMs = 2000,// kLingering, at most
+    kArenaBlockSize = 8192    // both packets of a request fit in one
+  };
+
+  // fArena's blocks, shared by all sessions
+  static BufferPool *getArenaPool();
+
+  // both come from fArena, with everything they allocate, which
+  // CleanupRequestAndResponse resets
   HTTPPacket *fRequest;
   HTTPPacket *fResponse;
+  Arena fArena;
   Core::Mutex fReadMutex;
 
   enum {
@@ -42,8 +96,25 @@ class HTTPSession : public HTTPSessionInterface {
     kSendingResponse = 4,
     kCleaningUp = 5,
     kReadingFirstRequest = 6,
-    kHaveCompleteMessage = 7
+    kHaveCompleteMessage = 7,
+    kWaitingForResponse = 8,  // an asynchronous handler has the request
+    kLingering = 9            // the 503 is out, reading until the client closes
   } fState;
+
+  bool fFlowControlled; // waiting for the Socket to become writable
+  bool fOverMaxConnections; // accepted while over the limit
+  bool fZeroCopyLingering;  // dead, waiting for the kernel to let go of buffers
+
+  static std::atomic<UInt32> sNumSessions;
+  static std::atomic<UInt64> sNumShedRequests;
+  static UInt32 sMaxConnections;
+  static UInt32 sMaxQueueDelayInMs;
+  static UInt32 sMaxRequestBodySize;
+
+  // prebuilt, shedding must cost less than serving
+  static char sServiceUnavailable[256];
+  static UInt32 sServiceUnavailableLen;
+
 };
 
 } // namespace Net
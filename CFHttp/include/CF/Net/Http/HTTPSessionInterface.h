@@ -32,6 +32,9 @@ class HTTPSessionInterface : public Thread::Task {
     sDispatcher = nullptr;
   }
 
+  // to change the routes while the server runs
+  static HTTPDispatcher *GetDispatcher() { return sDispatcher; }
+
   HTTPSessionInterface();
   virtual ~HTTPSessionInterface();
 
@@ -80,6 +83,7 @@ class HTTPSessionInterface : public Thread::Task {
  protected:
   enum {
     kFirstHTTPSessionID = 1,    //UInt32
+    kSessionTimeoutInMs = 30 * 1000  //SInt64, idle, or a request being handled
   };
 
   //Each http session has a unique number that identifies it.
@@ -37,7 +37,7 @@
 #define __QUERY_PARAM_LIST_H__
 
 #include <string>
-#include <CF/PLDoubleLinkedList.h>
+#include <CF/Arena.h>
 #include <CF/StrPtrLen.h>
 
 namespace CF {
@@ -49,7 +49,7 @@ class QueryParamListElement {
   QueryParamListElement(char *name, char *value) {
     mName = name;
     mValue = value;
-
+    mNext = nullptr;
   }
 
   virtual ~QueryParamListElement() {
@@ -59,15 +59,18 @@ class QueryParamListElement {
 
   char *mName;
   char *mValue;
+  QueryParamListElement *mNext;
 
 };
 
 class QueryParamList {
  public:
   QueryParamList(const std::string &queryString);
-  QueryParamList(char *queryString);
-  QueryParamList(StrPtrLen *querySPL);
-  ~QueryParamList() { delete fNameValueQueryParamList; }
+  // with an arena, the pairs and their strings are allocated from it and
+  // the list frees nothing
+  QueryParamList(char *queryString, Arena *inArena = nullptr);
+  QueryParamList(StrPtrLen *querySPL, Arena *inArena = nullptr);
+  ~QueryParamList();
 
   void AddNameValuePairToList(char *name, char *value);
   char const *DoFindCGIValueForParam(char *name);
@@ -84,7 +87,10 @@ class QueryParamList {
 
   bool IsHex(char c);
 
-  PLDoubleLinkedList<QueryParamListElement> *fNameValueQueryParamList;
+  char *CopyString(StrPtrLen *inString);
+
+  Arena *fArena;
+  QueryParamListElement *fHead; // the last pair added
 
 };
 
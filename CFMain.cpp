@@ -2,6 +2,7 @@
 #include <CF/CFState.h>
 #include <CF/Net/Socket/Socket.h>
 #include <CF/Net/Socket/SocketUtils.h>
+#include <CF/Net/Socket/TCPListenerSocket.h>
 #include <CF/CFConfigure.hpp>
 
 using namespace CF;
@@ -113,6 +114,12 @@ CF_Error CFMain(CFConfigure *config) {
    * Start service
    */
 
+  Net::TCPListenerSocket::Configure(config->GetListenQueueLength(),
+                                    config->GetMaxAcceptsPerEvent(),
+                                    config->IsTCPNoDelay(),
+                                    config->IsTCPKeepAlive(),
+                                    config->GetTCPSendBufSize());
+
   theErr = config->StartupCustomServices();
   if (theErr != CF_NoErr) return theErr;
 
@@ -44,14 +44,28 @@ using namespace CF::Net;
 ClientSocket::ClientSocket()
     : fHostAddr(0),
       fHostPort(0),
+      fConnectTimeoutInMilSecs(0),
       fEventMask(0),
       fSocketP(nullptr),
       fSendBuffer(fSendBuf, 0),
       fSentLength(0) {
+  fHostPath[0] = '\0';
+}
+
+void ClientSocket::Set(char const *hostPath) {
+  ::strncpy(fHostPath, hostPath, sizeof(fHostPath) - 1);
+  fHostPath[sizeof(fHostPath) - 1] = '\0';
 }
 
 OS_Error ClientSocket::Open(TCPSocket *inSocket) {
   OS_Error theErr = OS_NoErr;
+  if (inSocket->IsUnixDomain()) {
+    // no local address to bind and no TCP options to set
+    if (inSocket->GetSocketFD() == EventContext::kInvalidFileDesc)
+      theErr = inSocket->Open();
+    return theErr;
+  }
+
   if (!inSocket->IsBound()) {
     theErr = inSocket->Open();
     if (theErr == OS_NoErr)
@@ -78,7 +92,12 @@ OS_Error ClientSocket::Connect(TCPSocket *inSocket) {
     return theErr;
 
   if (!inSocket->IsConnected()) {
-    theErr = inSocket->Connect(fHostAddr, fHostPort);
+    if (inSocket->IsConnecting())
+      theErr = inSocket->CheckAsyncConnect();  // don't connect again
+    else if (inSocket->IsUnixDomain())
+      theErr = inSocket->Connect(fHostPath);
+    else
+      theErr = inSocket->ConnectAsync(fHostAddr, fHostPort, fConnectTimeoutInMilSecs);
     if ((theErr == EINPROGRESS) || (theErr == EAGAIN)) {
       fSocketP = inSocket;
       fEventMask = EV_RE | EV_WR;
@@ -50,17 +50,19 @@
 using namespace CF::Net;
 
 #if __WinSock__
-// See commentary in RequestEvent
-std::atomic<unsigned int> EventContext::sUniqueID(WM_USER);
+// On Win32 the event cookie is a window message ID (see win32ev.cpp), which
+// must lie in [WM_USER, WM_APP), so it carries only the handle index.
+static const UInt32 kMaxEventContexts = WM_APP - WM_USER;
 #else
-std::atomic<unsigned int> EventContext::sUniqueID(1);
+static const UInt32 kMaxEventContexts = CF::HandleTable::kMaxSlots;
 #endif
 
+EventThread::EventThread() : Thread(), fHandleTable(kMaxEventContexts) {}
+
 EventContext::EventContext(SOCKET inFileDesc, EventThread *inThread)
     : fFileDesc(inFileDesc),
       fUseETMode(false),
-      fUniqueID(0),
-      fUniqueIDStr((char *) &fUniqueID, sizeof(fUniqueID)),
+      fUniqueID(HandleTable::kInvalidHandle),
       fEventThread(inThread),
       fWatchEventCalled(false),
       fEventBits(0),
@@ -91,11 +93,11 @@ void EventContext::Cleanup() {
   // 关闭 Socket
   if (fd != kInvalidFileDesc) {
     // if this object is registered in the table, unregister it now
-    if (fUniqueID > 0) {
+    if (fUniqueID != HandleTable::kInvalidHandle) {
 #if !MACOSXEVENTQUEUE
-      select_removeevent(fFileDesc);  // 先取消 event 监听
+      select_removeevent(fd);  // 先取消 event 监听
 #endif
-      fEventThread->fRefTable.UnRegister(&fRef);  // 从 EventThread 注销
+      fEventThread->fHandleTable.UnRegister(fUniqueID);  // 从 EventThread 注销
     }
 
     // On Linux (possibly other UNIX implementations) you MUST NOT close the
@@ -113,7 +115,7 @@ void EventContext::Cleanup() {
 #endif // __WinSock__
   }
 
-  fUniqueID = 0;
+  fUniqueID = HandleTable::kInvalidHandle;
 
   // we don't really care if there was an error, but it's nice to know
 #if __WinSock__
@@ -128,9 +130,7 @@ void EventContext::SnarfEventContext(EventContext &fromContext) {
   // copy the unique id
   // set our fUniqueIDStr to the unique id
   // copy the eventreq
-  // find the old event object
-  // show us as the object in the fRefTable
-  //      we take the OSRef from the old context, point it at our context
+  // point the handle at our context, the old one no longer owns it
   //
   //TODO - this whole operation causes a race condition for Event posting
   //  way up the chain we need to disable event posting
@@ -140,12 +140,30 @@ void EventContext::SnarfEventContext(EventContext &fromContext) {
 
   fWatchEventCalled = fromContext.fWatchEventCalled;
   fUniqueID = fromContext.fUniqueID;
-  fUniqueIDStr.Set((char *) &fUniqueID, sizeof(fUniqueID)),
-      ::memcpy(&fEventReq, &fromContext.fEventReq, sizeof(struct eventreq));
+  ::memcpy(&fEventReq, &fromContext.fEventReq, sizeof(struct eventreq));
+
+  fromContext.fUniqueID = HandleTable::kInvalidHandle;
+  if (fUniqueID != HandleTable::kInvalidHandle)
+    fEventThread->fHandleTable.Swap(fUniqueID, this);
+}
+
+CF::Thread::Task::EventFlags EventContext::TaskEvents(int eventBits) {
+  CF::Thread::Task::EventFlags theEvents = 0;
+  if (eventBits & EV_RE)
+    theEvents |= CF::Thread::Task::kReadEvent;
+  if (eventBits & EV_WR)
+    theEvents |= CF::Thread::Task::kWriteEvent;
+#if defined(EV_HU) && defined(EV_ER)
+  if (eventBits & EV_HU)
+    theEvents |= CF::Thread::Task::kHangupEvent | CF::Thread::Task::kReadEvent;
+  if (eventBits & EV_ER)
+    theEvents |= CF::Thread::Task::kErrorEvent | CF::Thread::Task::kReadEvent;
+#endif
 
-  fRef.Set(fUniqueIDStr, this);
-  fEventThread->fRefTable.Swap(&fRef);
-  fEventThread->fRefTable.UnRegister(&fromContext.fRef);
+  // a backend that can't tell what happened, let the task find out.
+  if (theEvents == 0)
+    theEvents = CF::Thread::Task::kReadEvent;
+  return theEvents;
 }
 
 void EventContext::RequestEvent(UInt32 theMask) {
@@ -159,6 +177,7 @@ void EventContext::RequestEvent(UInt32 theMask) {
 //    s_printf("EventContext@%p remove event.\n", this);
     if (fWatchEventCalled) {
       select_removeevent(fFileDesc);
+      fEventReq.er_eventbits = 0;
     }
     return;
   }
@@ -167,16 +186,20 @@ void EventContext::RequestEvent(UInt32 theMask) {
 //    s_printf("EventContext@%p request read event.\n", this);
 //  }
 
-  if (theMask & EV_WR) {
-    s_printf("EventContext@%p request Write event.\n", this);
-  }
-
   //
   // The first Time this function gets called, we're supposed to
   // call watchevent. Each subsequent Time, call modwatch. That's
   // the way the MacOS X event Queue works.
 
-  if (fUseETMode) theMask |= EV_ET; // ET Mode
+  if (fUseETMode) { // ET Mode
+    // interests stay armed, one shot would defeat the purpose
+    theMask = (theMask & ~EV_OS) | EV_ET;
+    if (fWatchEventCalled) {
+      // already watching everything asked for, nothing to do.
+      if ((theMask & ~fEventReq.er_eventbits) == 0) return;
+      theMask |= fEventReq.er_eventbits;
+    }
+  }
 
   if (fWatchEventCalled) {
     fEventReq.er_eventbits = theMask;
@@ -193,58 +216,25 @@ void EventContext::RequestEvent(UInt32 theMask) {
   } else {
     if (fFileDesc == kInvalidFileDesc) return;
 
-    // allocate a Unique ID for this Socket, and add it to the Ref table
-    bool bFindValid = false;
-#if __WinSock__
-    //
-    // Kind of a hack. On Win32, the way that we pass around the unique ID is
-    // by making it the message ID of our Win32 message (see win32ev.cpp).
-    // Messages must be >= WM_USER. Hence this code to restrict the numberspace
-    // of our UniqueIDs.
-    do {
-        static unsigned int topVal = 8192;
-        if (!sUniqueID.compare_exchange_weak(topVal, WM_USER))  // Fix 2466667: message IDs above a
-            fUniqueID = ++sUniqueID;         // level are ignored, so wrap at 8192
-        else
-            fUniqueID = (PointerSizedInt) WM_USER;
-
-        //If the fUniqueID is used, find a new one until it's free
-        Ref *ref = fEventThread->fRefTable.Resolve(&fUniqueIDStr);
-        if (ref != NULL) {
-            fEventThread->fRefTable.Release(ref);
-        } else {
-            bFindValid = true; // ok, it's free
-        }
-    } while (!bFindValid);
-#else
-    do {
-      static unsigned int topVal = 10000000;
-      if (!sUniqueID.compare_exchange_weak(topVal, 1))  // Fix 2466667: message IDs above a
-        fUniqueID = ++sUniqueID;  // level are ignored, so wrap at 8192
-      else
-        fUniqueID = 1;
-
-      // If the fUniqueID is used, find a new one until it's free
-      Ref *Ref = fEventThread->fRefTable.Resolve(&fUniqueIDStr);
-      if (Ref != nullptr) {
-        fEventThread->fRefTable.Release(Ref);
-      } else {
-        bFindValid = true; // ok, it's free
-      }
-
-      // if id pool is empty, here will spin until some one release.
-    } while (!bFindValid);
-#endif
-
-    fRef.Set(fUniqueIDStr, this);
-    fEventThread->fRefTable.Register(&fRef);
+    // allocate a handle for this Socket, the event thread resolves it back
+    fUniqueID = fEventThread->fHandleTable.Register(this);
+    if (fUniqueID == HandleTable::kInvalidHandle) {
+      AssertV(false, EMFILE); // more sockets than the table holds
+      return;
+    }
 
     // fill out the eventreq data structure
     ::memset(&fEventReq, '\0', sizeof(fEventReq));
     fEventReq.er_type = EV_FD;
     fEventReq.er_handle = fFileDesc;
     fEventReq.er_eventbits = theMask;
-    fEventReq.er_data = (void *) fUniqueID;
+#if __WinSock__
+    // Messages must be >= WM_USER, see win32ev.cpp
+    fEventReq.er_data = (void *) (PointerSizedInt)
+        (WM_USER + HandleTable::GetIndex(fUniqueID));
+#else
+    fEventReq.er_data = (void *) (PointerSizedInt) fUniqueID;
+#endif
 
     fWatchEventCalled = true;
 #if MACOSXEVENTQUEUE
@@ -257,6 +247,20 @@ void EventContext::RequestEvent(UInt32 theMask) {
   }
 }
 
+void EventContext::DropEvent(UInt32 theMask) {
+  if (CFState::sState & CFState::kDisableEvent) return;
+
+  // one shot interests go away by themselves
+  if (!fUseETMode || !fWatchEventCalled) return;
+
+  UInt32 theBits = fEventReq.er_eventbits & ~(theMask & (EV_RE | EV_WR));
+  if (theBits == (UInt32) fEventReq.er_eventbits) return;
+
+  fEventReq.er_eventbits = theBits;
+  if (select_modwatch(&fEventReq, theBits) != 0)
+    AssertV(false, Core::Thread::GetErrno());
+}
+
 /**
  * 网络事件线程入口，由一个大循环组成
  */
@@ -293,10 +297,9 @@ void EventThread::Entry() {
         }
 
         if (CFState::sState & CFState::kCleanEvent) {
-          RefHashTableIter iter(fRefTable.GetHashTable());
+          HandleTableIter iter(&fHandleTable);
           while (!iter.IsDone()) {
-            Ref *ref = iter.GetCurrent();
-            auto *theContext = (EventContext *) ref->GetObject();
+            auto *theContext = (EventContext *) iter.GetCurrent();
             iter.Next();
             theContext->Cleanup();
           }
@@ -317,17 +320,22 @@ void EventThread::Entry() {
 
     // ok, there's data waiting on this Socket. Send a wakeup.
     if (theCurrentEvent.er_data != nullptr) {
-      // The cookie in this event is an ObjectID. Resolve that objectID into
-      // a pointer.
-      StrPtrLen idStr((char *) &theCurrentEvent.er_data, sizeof(PointerSizedInt));
-      Ref *ref = fRefTable.Resolve(&idStr);
-      if (ref != nullptr) {
-        auto *theContext = (EventContext *) ref->GetObject();
+      // The cookie in this event is a handle. Resolve that handle into
+      // a pointer, a stale handle simply doesn't resolve.
+      auto theCookie = (PointerSizedInt) theCurrentEvent.er_data;
+#if __WinSock__
+      HandleTable::Handle theHandle =
+          fHandleTable.GetHandle((UInt32) (theCookie - WM_USER));
+#else
+      auto theHandle = (HandleTable::Handle) theCookie;
+#endif
+      auto *theContext = (EventContext *) fHandleTable.Resolve(theHandle);
+      if (theContext != nullptr) {
 #if DEBUG_EVENT_CONTEXT
         theContext->fModwatched = false;
 #endif
         theContext->ProcessEvent(theCurrentEvent.er_eventbits);
-        fRefTable.Release(ref);
+        fHandleTable.Release(theHandle);
       }
     }
 
@@ -42,9 +42,26 @@
 #include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #endif
 
+#if __linux__
+#include <linux/errqueue.h>
+#endif
+
+// older headers don't know about zero copy yet, the kernel may still do
+#if __linux__ && !defined(SO_ZEROCOPY)
+#define SO_ZEROCOPY 60
+#endif
+#if __linux__ && !defined(MSG_ZEROCOPY)
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#if __linux__ && !defined(SO_EE_ORIGIN_ZEROCOPY)
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
 #ifdef USE_NETLOG
 #include <netlog.h>
 #else
@@ -58,10 +75,13 @@ typedef int socklen_t; // missing from some platform includes
 using namespace CF::Net;
 
 EventThread *Socket::sEventThread = nullptr;
+CF::StrPtrLen Socket::sUnixAddrStr((char *) "unix");
 
 Socket::Socket(CF::Thread::Task *inNotifyTask, UInt32 inSocketType)
     : EventContext(EventContext::kInvalidFileDesc, sEventThread),
       fState(inSocketType),
+      fZeroCopySequence(0),
+      fZeroCopyCompleted(0),
       fLocalAddrStrPtr(nullptr),
       fLocalDNSStrPtr(nullptr),
       fPortStr(fPortBuffer, kPortBufSizeInBytes) {
@@ -82,7 +102,14 @@ Socket::Socket(CF::Thread::Task *inNotifyTask, UInt32 inSocketType)
 
 OS_Error Socket::Open(int theType) {
   Assert(fFileDesc == EventContext::kInvalidFileDesc);
+#if __WinSock__
+  if (fState & kUnixDomainSocketType)
+    return (OS_Error) EAFNOSUPPORT;
   fFileDesc = ::socket(PF_INET, theType, 0);
+#else
+  fFileDesc = ::socket(
+      (fState & kUnixDomainSocketType) ? PF_UNIX : PF_INET, theType, 0);
+#endif
   if (fFileDesc == EventContext::kInvalidFileDesc)
     return (OS_Error) Core::Thread::GetErrno();
 
@@ -119,6 +146,14 @@ void Socket::KeepAlive() {
   Assert(err == 0);
 }
 
+void Socket::ShutdownWrite() {
+#if __WinSock__
+  (void) ::shutdown(fFileDesc, SD_SEND);
+#else
+  (void) ::shutdown(fFileDesc, SHUT_WR);
+#endif
+}
+
 void Socket::SetSocketBufSize(UInt32 inNewSize) {
 
 #if DEBUG_SOCKET
@@ -219,7 +254,36 @@ OS_Error Socket::Bind(UInt32 addr, UInt16 port, bool test) {
   return OS_NoErr;
 }
 
+OS_Error Socket::Bind(char const *inPath) {
+#if __WinSock__
+  return (OS_Error) EAFNOSUPPORT;
+#else
+  Assert(fState & kUnixDomainSocketType);
+  if (fFileDesc == EventContext::kInvalidFileDesc)
+    return (OS_Error) EBADF;
+
+  struct sockaddr_un theAddr;
+  size_t pathLen = ::strlen(inPath);
+  if (pathLen == 0 || pathLen >= sizeof(theAddr.sun_path))
+    return (OS_Error) ENAMETOOLONG;
+
+  ::memset(&theAddr, 0, sizeof(theAddr));
+  theAddr.sun_family = AF_UNIX;
+  ::memcpy(theAddr.sun_path, inPath, pathLen);
+
+  int err = ::bind(fFileDesc, (sockaddr *) &theAddr, sizeof(theAddr));
+  if (err == -1)
+    return (OS_Error) Core::Thread::GetErrno();
+
+  fState |= kBound;
+  return OS_NoErr;
+#endif
+}
+
 CF::StrPtrLen *Socket::GetLocalAddrStr() {
+  if (fState & kUnixDomainSocketType)
+    return &sUnixAddrStr;
+
   //Use the array of IP addr strings to locate the string formatted version
   //of this IP address.
   if (fLocalAddrStrPtr == nullptr) {
@@ -261,6 +325,9 @@ CF::StrPtrLen *Socket::GetLocalAddrStr() {
 }
 
 CF::StrPtrLen *Socket::GetLocalDNSStr() {
+  if (fState & kUnixDomainSocketType)
+    return &sUnixAddrStr;
+
   //Do the same thing as the above function, but for DNS names
   Assert(fLocalAddr.sin_addr.s_addr != INADDR_ANY);
   if (fLocalDNSStrPtr == nullptr) {
@@ -348,6 +415,80 @@ WriteV(const struct iovec *iov, const UInt32 numIOvecs, UInt32 *outLenSent) {
   return OS_NoErr;
 }
 
+OS_Error Socket::EnableZeroCopy() {
+#if __linux__
+  int one = 1;
+  int err = ::setsockopt(
+      fFileDesc, SOL_SOCKET, SO_ZEROCOPY, (char *) &one, sizeof(int));
+  if (err == -1)
+    return (OS_Error) Core::Thread::GetErrno();
+
+  fState |= kZeroCopy;
+  return OS_NoErr;
+#else
+  return (OS_Error) EOPNOTSUPP;
+#endif
+}
+
+OS_Error Socket::
+SendZeroCopy(char const *inData, const UInt32 inLength, UInt32 *outLengthSent) {
+#if __linux__
+  Assert(inData != nullptr);
+
+  if (!(fState & kZeroCopy))
+    return this->Send(inData, inLength, outLengthSent);
+
+  if (!(fState & kConnected))
+    return (OS_Error) ENOTCONN;
+
+  long err;
+  do {
+    err = ::send(fFileDesc, inData, inLength, MSG_ZEROCOPY);
+  } while ((err == -1) && (Core::Thread::GetErrno() == EINTR));
+
+  if (err == -1) {
+    int theErr = Core::Thread::GetErrno();
+    if ((theErr != EAGAIN) && (theErr != ENOBUFS) && (this->IsConnected()))
+      fState ^= kConnected;//turn off connected state flag
+    // ENOBUFS: out of optmem for notifications, retry once some are reaped
+    return (OS_Error) (theErr == ENOBUFS ? EAGAIN : theErr);
+  }
+
+  fZeroCopySequence++;
+  *outLengthSent = static_cast<UInt32>(err);
+  return OS_NoErr;
+#else
+  return this->Send(inData, inLength, outLengthSent);
+#endif
+}
+
+UInt32 Socket::ReapZeroCopy() {
+#if __linux__
+  // each notification covers a range of sequence numbers, for TCP they
+  // arrive in order, so the end of the last range is all we need.
+  while (fZeroCopyCompleted != fZeroCopySequence) {
+    char theControl[CMSG_SPACE(sizeof(struct sock_extended_err))
+        + CMSG_SPACE(sizeof(struct sockaddr_in6))];
+    struct msghdr theMsg;
+    ::memset(&theMsg, 0, sizeof(theMsg));
+    theMsg.msg_control = theControl;
+    theMsg.msg_controllen = sizeof(theControl);
+
+    if (::recvmsg(fFileDesc, &theMsg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+      break;
+
+    for (struct cmsghdr *theCmsg = CMSG_FIRSTHDR(&theMsg); theCmsg != nullptr;
+         theCmsg = CMSG_NXTHDR(&theMsg, theCmsg)) {
+      auto *theErr = (struct sock_extended_err *) CMSG_DATA(theCmsg);
+      if (theErr->ee_errno != 0 || theErr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+      fZeroCopyCompleted = theErr->ee_data + 1; // ee_info..ee_data are done
+    }
+  }
+#endif
+  return fZeroCopyCompleted;
+}
+
 OS_Error Socket::Read(void *buffer, const UInt32 length, UInt32 *outRecvLenP) {
   Assert(outRecvLenP != nullptr);
   Assert(buffer != nullptr);
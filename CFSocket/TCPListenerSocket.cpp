@@ -34,6 +34,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
@@ -42,6 +43,31 @@
 
 using namespace CF::Net;
 
+UInt32 TCPListenerSocket::sListenQueueLength = kListenQueueLength;
+UInt32 TCPListenerSocket::sMaxAcceptsPerEvent = kMaxAcceptsPerEvent;
+bool TCPListenerSocket::sNoDelay = true;
+bool TCPListenerSocket::sKeepAlive = true;
+UInt32 TCPListenerSocket::sSendBufSize = kSendBufSizeInBytes;
+
+void TCPListenerSocket::Configure(UInt32 listenQueueLength,
+                                  UInt32 maxAcceptsPerEvent,
+                                  bool noDelay,
+                                  bool keepAlive,
+                                  UInt32 sndBufSize) {
+  sListenQueueLength = listenQueueLength > 0 ? listenQueueLength : kListenQueueLength;
+  sMaxAcceptsPerEvent = maxAcceptsPerEvent > 0 ? maxAcceptsPerEvent : 1;
+  sNoDelay = noDelay;
+  sKeepAlive = keepAlive;
+  sSendBufSize = sndBufSize;
+}
+
+TCPListenerSocket::~TCPListenerSocket() {
+#if !__WinSock__
+  if (fUnixPath[0] != '\0')
+    ::unlink(fUnixPath);
+#endif
+}
+
 OS_Error TCPListenerSocket::listen(UInt32 queueLength) {
   if (fFileDesc == EventContext::kInvalidFileDesc)
     return (OS_Error) EBADF;
@@ -52,6 +78,28 @@ OS_Error TCPListenerSocket::listen(UInt32 queueLength) {
   return OS_NoErr;
 }
 
+void TCPListenerSocket::setSocketProfile(int osSocket) {
+  int one = 1;
+  int err;
+
+  // we are a server, always disable nagle algorithm
+  if (sNoDelay) {
+    err = ::setsockopt(osSocket, IPPROTO_TCP, TCP_NODELAY, (char *) &one, sizeof(int));
+    AssertV(err == 0, Core::Thread::GetErrno());
+  }
+
+  if (sKeepAlive) {
+    err = ::setsockopt(osSocket, SOL_SOCKET, SO_KEEPALIVE, (char *) &one, sizeof(int));
+    AssertV(err == 0, Core::Thread::GetErrno());
+  }
+
+  if (sSendBufSize > 0) {
+    int sndBufSize = sSendBufSize;
+    err = ::setsockopt(osSocket, SOL_SOCKET, SO_SNDBUF, (char *) &sndBufSize, sizeof(int));
+    AssertV(err == 0, Core::Thread::GetErrno());
+  }
+}
+
 /*
  * 创建打开流套接字(SOCK_STREAM)端口,并绑定 IP 地址、端口，执行 listen 操作。
  * 注意在这个函数里调用了 SetSocketRcvBufSize 成员函数,以设置这个 Socket 的
@@ -79,7 +127,14 @@ OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port) {
       // can be used for incoming broadcast data. This could force the server
       // to run out of memory faster if it gets bogged down, but it is unavoidable.
       this->SetSocketRcvBufSize(512 * 1024);
-      err = this->listen(kListenQueueLength);
+
+#if __linux__
+      // Linux copies these options from the listening Socket to every
+      // accepted Socket, so set them once here instead of per connection.
+      this->setSocketProfile(fFileDesc);
+#endif
+
+      err = this->listen(sListenQueueLength);
       AssertV(err == 0, Core::Thread::GetErrno());
       if (err != 0) break;
 
@@ -89,6 +144,76 @@ OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port) {
   return err;
 }
 
+OS_Error TCPListenerSocket::Initialize(char const *path) {
+  if (::strlen(path) >= kMaxUnixPathLen)
+    return (OS_Error) ENAMETOOLONG;
+
+  fState |= kUnixDomainSocketType;
+  OS_Error err = this->TCPSocket::Open();
+  if (0 == err) {
+    do {
+#if !__WinSock__
+      // bind fails with EADDRINUSE while the file exists. Only a stale
+      // socket is removed, never a file that happens to have the name.
+      struct stat theStat;
+      if (::lstat(path, &theStat) == 0) {
+        if (!S_ISSOCK(theStat.st_mode)) {
+          err = (OS_Error) EADDRINUSE;
+          break;
+        }
+        ::unlink(path);
+      }
+#endif
+      err = this->Bind(path);
+      if (err != 0) break;
+
+      ::strcpy(fUnixPath, path);
+
+      // TCP level options don't apply to unix domain sockets
+      err = this->listen(sListenQueueLength);
+      AssertV(err == 0, Core::Thread::GetErrno());
+      if (err != 0) break;
+
+    } while (false);
+  }
+
+  return err;
+}
+
+int TCPListenerSocket::accept(struct sockaddr_in *outAddr, int *outErr) {
+#if __Win32__ || __osf__ || __sgi__ || __hpux__
+  int size = sizeof(*outAddr);
+#else
+  socklen_t size = sizeof(*outAddr);
+#endif
+
+  // unix domain peers have no ip address to report
+  struct sockaddr *theAddr = (struct sockaddr *) outAddr;
+  if (this->IsUnixDomain()) {
+    ::memset(outAddr, 0, sizeof(*outAddr));
+    theAddr = nullptr;
+  }
+
+  int osSocket;
+  do {
+#if __linux__
+    // the new Socket comes back non-blocking, no fcntl calls needed.
+    osSocket = ::accept4(fFileDesc, theAddr, theAddr ? &size : nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    osSocket = ::accept(fFileDesc, theAddr, theAddr ? &size : nullptr);
+#endif
+  } while (osSocket == -1 && Core::Thread::GetErrno() == EINTR);
+
+  if (osSocket == -1) {
+    *outErr = Core::Thread::GetErrno();
+    return EventContext::kInvalidFileDesc;
+  }
+
+  *outErr = 0;
+  return osSocket;
+}
+
 /*
  * 在 fListeners 申请监听流套接字端口后，一旦 Socket 端口有数据,该函数会被调用。
  * 这个函数的流程是这样的:
@@ -101,47 +226,46 @@ OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port) {
  *     函数，在这个函数里会调用 fTask->Signal(Task::kReadEvent)，
  *   4.最终 TaskThread 会调用 RTSPSession::Run 函数。
  * 而 TCPListenerSocket 自己的 Socket 端口会继续被申请监听。
+ *
+ * 一次事件最多 accept sMaxAcceptsPerEvent 个连接，直到 EAGAIN；剩余的连接
+ * 由水平触发的监听事件在下一轮处理。
  */
 void TCPListenerSocket::ProcessEvent(int /*eventBits*/) {
 
   // we are executing on the same Thread as every other
   // Socket, so whatever you do here has to be fast.
 
-  struct sockaddr_in addr;
-#if __Win32__ || __osf__ || __sgi__ || __hpux__
-  int size = sizeof(addr);
-#else
-  socklen_t size = sizeof(addr);
-#endif
-  Thread::Task *theTask = nullptr;
-  TCPSocket *theSocket = nullptr;
+  // when bound to a specific address, accepted sockets share our local
+  // address and we can skip getsockname for each of them.
+  bool isUnixDomain = this->IsUnixDomain();
+  struct sockaddr_in *localAddr =
+      (isUnixDomain || fLocalAddr.sin_addr.s_addr != htonl(INADDR_ANY))
+      ? &fLocalAddr : nullptr;
 
-  // fSocket data member of TCPSocket.
-  int osSocket = accept(fFileDesc, (struct sockaddr *) &addr, &size);
+  for (UInt32 numAccepted = 0; numAccepted < sMaxAcceptsPerEvent; numAccepted++) {
+    struct sockaddr_in addr;
+    Thread::Task *theTask = nullptr;
+    TCPSocket *theSocket = nullptr;
 
-  // test osSocket = -1;
-  if (osSocket == -1) {
-    // take a look at what this error is.
-    int acceptError = Core::Thread::GetErrno();
-
-    if (acceptError == EAGAIN) {
-      // If it's EAGAIN, there's nothing on the listen Queue right now,
-      // so modwatch and return
-//      this->RequestEvent(EV_RE);
-      return;
-    }
+    int acceptError = 0;
+    int osSocket = this->accept(&addr, &acceptError);
+
+    if (osSocket == EventContext::kInvalidFileDesc) {
+      // If it's EAGAIN, there's nothing on the listen Queue right now
+      if (acceptError == EAGAIN || acceptError == EWOULDBLOCK)
+        break;
+
+      // test acceptError = ENFILE;
+      // test acceptError = ENOENT;
+      if (acceptError == EMFILE || acceptError == ENFILE) {
+        // if these error gets returned, we're out of file descriptors, the server
+        // is going to be failing on sockets, logs, qtgroups and qtuser auth file
+        // accesses and movie files. The server is not functional.
+        s_printf("Out of File Descriptors. Set max connections lower and check"
+                 " for competing usage from other processes. Exiting.");
+        exit(EXIT_FAILURE);
+      }
 
-    // test acceptError = ENFILE;
-    // test acceptError = EINTR;
-    // test acceptError = ENOENT;
-    if (acceptError == EMFILE || acceptError == ENFILE) {
-      // if these error gets returned, we're out of file descriptors, the server
-      // is going to be failing on sockets, logs, qtgroups and qtuser auth file
-      // accesses and movie files. The server is not functional.
-      s_printf("Out of File Descriptors. Set max connections lower and check"
-               " for competing usage from other processes. Exiting.");
-      exit(EXIT_FAILURE);
-    } else {
       char errStr[256];
       errStr[sizeof(errStr) - 1] = 0;
       s_snprintf(errStr, sizeof(errStr) - 1,
@@ -149,50 +273,38 @@ void TCPListenerSocket::ProcessEvent(int /*eventBits*/) {
                  acceptError, strerror(acceptError));
       WarnV((acceptError == 0), errStr);
 
-      // TODO(james): there have some questions.
-//      theTask = this->GetSessionTask(&theSocket);
-//      if (theTask == nullptr) {
-//        close(osSocket);
-//      } else {
-//        theTask->Signal(Task::kKillEvent); // just clean up the task
-//      }
-//
-//      if (theSocket)
-//        theSocket->fState &= ~kConnected; // turn off connected state
-//
-//      return;
+      // ECONNABORTED and friends only affect that one connection.
+      continue;
     }
-  }
 
-  theTask = this->GetSessionTask(&theSocket);
-  if (theTask == nullptr) { //this should be a disconnect. do an ioctl call?
-    close(osSocket);
-    if (theSocket) theSocket->fState &= ~kConnected; // turn off connected state
-  } else {
-    Assert(osSocket != EventContext::kInvalidFileDesc);
-    // set options on the Socket
-
-    // we are a server, always disable nagle algorithm
-    int one = 1;
-    int err = ::setsockopt(osSocket, IPPROTO_TCP, TCP_NODELAY, (char *) &one, sizeof(int));
-    AssertV(err == 0, Core::Thread::GetErrno());
-
-    err = ::setsockopt(osSocket, SOL_SOCKET, SO_KEEPALIVE, (char *) &one, sizeof(int));
-    AssertV(err == 0, Core::Thread::GetErrno());
+    theTask = this->GetSessionTask(&theSocket);
+    if (theTask == nullptr) { //this should be a disconnect. do an ioctl call?
+      close(osSocket);
+      if (theSocket) theSocket->fState &= ~kConnected; // turn off connected state
+    } else {
+      // set options on the Socket
+#if !__linux__
+      if (!isUnixDomain)
+        this->setSocketProfile(osSocket);
+#endif
+      if (isUnixDomain)
+        theSocket->fState |= kUnixDomainSocketType;
 
-    int sndBufSize = 96L * 1024L;
-    err = ::setsockopt(osSocket, SOL_SOCKET, SO_SNDBUF, (char *) &sndBufSize, sizeof(int));
-    AssertV(err == 0, Core::Thread::GetErrno());
+      // setup the Socket. When there is data on the Socket,
+      // theTask will get an kReadEvent event
+      theSocket->Set(osSocket, &addr, localAddr);
+#if !__linux__
+      theSocket->InitNonBlocking(osSocket); // 因为 socket 是通过 Set 注入的，需要手动设置为 non-blocking
+#endif
+      theTask->SetThreadPicker(Thread::Task::GetBlockingTaskThreadPicker()); // The Message Task processing threads
+      theSocket->SetTask(theTask); // 实际上是调用 EventContext::SetTask
 
-    // setup the Socket. When there is data on the Socket,
-    // theTask will get an kReadEvent event
-    theSocket->Set(osSocket, &addr);
-    theSocket->InitNonBlocking(osSocket); // 因为 socket 是通过 Set 注入的，需要手动设置为 non-blocking
-    theTask->SetThreadPicker(Thread::Task::GetBlockingTaskThreadPicker()); // The Message Task processing threads
-    theSocket->SetTask(theTask); // 实际上是调用 EventContext::SetTask
+      // 监听可读事件，提供 TCP 服务
+      theSocket->RequestEvent(EV_REOS); // one shot
+    }
 
-    // 监听可读事件，提供 TCP 服务
-    theSocket->RequestEvent(EV_REOS); // one shot
+    // GetSessionTask tells us through SlowDown when we are over the limit
+    if (fSleepBetweenAccepts) break;
   }
 
   /* 如果 RTSPSession、HTTPSession 的连接数超过超过限制,则利用 IdleTaskThread 定时调用
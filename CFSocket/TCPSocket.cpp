@@ -31,11 +31,19 @@
 
 #include <CF/Net/Socket/TCPSocket.h>
 #include <CF/Net/Socket/SocketUtils.h>
+#include <CF/Core/Time.h>
 
 #if !__WinSock__
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
 #endif
 
 #ifdef USE_NETLOG
@@ -67,29 +75,41 @@ void TCPSocket::SnarfSocket(TCPSocket &fromSocket) {
  * TCPSocket::fLocalAddr，并设置 TCPSocket::fState |= kBound | kConnected。
  * 同时将 osSocket 保存为 TCPSocket::fFileDesc
  */
-void TCPSocket::Set(int inSocket, struct sockaddr_in *remoteaddr) {
+void TCPSocket::Set(int inSocket, struct sockaddr_in *remoteaddr,
+                    struct sockaddr_in *localaddr) {
   fRemoteAddr = *remoteaddr;
   fFileDesc = inSocket;
 
   if (inSocket != EventContext::kInvalidFileDesc) {
-    // make sure to find out what IP address this connection is actually
-    // occurring on. That way, we can report correct information to clients
-    // asking what the connection's IP is
+    if (localaddr != nullptr) {
+      fLocalAddr = *localaddr;
+    } else {
+      // make sure to find out what IP address this connection is actually
+      // occurring on. That way, we can report correct information to clients
+      // asking what the connection's IP is
 #if __Win32__ || __osf__ || __sgi__ || __hpux__
-    int len = sizeof(fLocalAddr);
+      int len = sizeof(fLocalAddr);
 #else
-    socklen_t len = sizeof(fLocalAddr);
+      socklen_t len = sizeof(fLocalAddr);
 #endif
-    int err = ::getsockname(fFileDesc, (struct sockaddr *) &fLocalAddr, &len);
-    AssertV(err == 0, Core::Thread::GetErrno());
+      int err = ::getsockname(fFileDesc, (struct sockaddr *) &fLocalAddr, &len);
+      AssertV(err == 0, Core::Thread::GetErrno());
+    }
     fState |= kBound;
     fState |= kConnected;
+
+    // accepted sockets don't go through Open
+    if (fState & kEdgeTriggeredSocketMode)
+      this->SetMode(true);
   } else {
     fState = 0;
   }
 }
 
 CF::StrPtrLen *TCPSocket::GetRemoteAddrStr() {
+  if (fState & kUnixDomainSocketType)
+    return &sUnixAddrStr;
+
   if (fRemoteStr.Len == kIPAddrBufSize)
     SocketUtils::ConvertAddrToString(fRemoteAddr.sin_addr, &fRemoteStr);
   return &fRemoteStr;
@@ -104,15 +124,203 @@ OS_Error TCPSocket::Connect(UInt32 inRemoteAddr, UInt16 inRemotePort) {
   /* don't forget to error check the connect()! */
   int err =
       ::connect(fFileDesc, (sockaddr *) &fRemoteAddr, sizeof(fRemoteAddr));
-  fState |= kConnected;
 
   if (err == -1) {
+    OS_Error theErr = (OS_Error) Core::Thread::GetErrno();
+    if (theErr == EINPROGRESS) {
+      // not connected until CheckAsyncConnect says so
+      fState |= kConnecting;
+      return theErr;
+    }
     fRemoteAddr.sin_port = 0;
     fRemoteAddr.sin_addr.s_addr = 0;
+    return theErr;
+  }
+
+  fState |= kConnected;
+  return OS_NoErr;
+
+}
+
+OS_Error TCPSocket::ConnectAsync(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                 SInt64 inTimeoutInMilSecs) {
+  OS_Error theErr = this->Connect(inRemoteAddr, inRemotePort);
+  if (theErr != EINPROGRESS)
+    return theErr;
+
+  fConnectDeadline = 0;
+  if (inTimeoutInMilSecs > 0)
+    fConnectDeadline = Core::Time::Milliseconds() + inTimeoutInMilSecs;
+
+  // the Socket turns writable when the handshake is done, or has failed
+  this->RequestEvent(EV_WR);
+  return theErr;
+}
+
+OS_Error TCPSocket::CheckAsyncConnect() {
+  if (fState & kConnected)
+    return OS_NoErr;
+  if (!(fState & kConnecting))
+    return (OS_Error) ENOTCONN;
+
+  int theErr = 0;
+#if __Win32__ || __osf__ || __sgi__ || __hpux__
+  int len = sizeof(theErr);
+#else
+  socklen_t len = sizeof(theErr);
+#endif
+  if (::getsockopt(fFileDesc, SOL_SOCKET, SO_ERROR, (char *) &theErr, &len) == -1)
+    theErr = Core::Thread::GetErrno();
+
+  if (theErr == 0) {
+    // no error yet, it is done once there is a peer
+    struct sockaddr_in thePeer;
+    len = sizeof(thePeer);
+    if (::getpeername(fFileDesc, (struct sockaddr *) &thePeer, &len) == 0) {
+      fState &= ~kConnecting;
+      fState |= kConnected;
+      fConnectDeadline = 0;
+
+      // the kernel picked the local address if we didn't bind
+      len = sizeof(fLocalAddr);
+      if (::getsockname(fFileDesc, (struct sockaddr *) &fLocalAddr, &len) == 0)
+        fState |= kBound;
+      return OS_NoErr;
+    }
+
+    if ((fConnectDeadline == 0) || (Core::Time::Milliseconds() < fConnectDeadline))
+      return (OS_Error) EINPROGRESS;
+    theErr = ETIMEDOUT;
+  }
+
+  fState &= ~kConnecting;
+  fConnectDeadline = 0;
+  fRemoteAddr.sin_port = 0;
+  fRemoteAddr.sin_addr.s_addr = 0;
+  return (OS_Error) theErr;
+}
+
+SInt64 TCPSocket::GetConnectTimeRemaining() {
+  if (!(fState & kConnecting) || (fConnectDeadline == 0))
+    return 0;
+  SInt64 theRemaining = fConnectDeadline - Core::Time::Milliseconds();
+  return (theRemaining > 0) ? theRemaining : 1;
+}
+
+OS_Error TCPSocket::Connect(char const *inPath) {
+#if __WinSock__
+  return (OS_Error) EAFNOSUPPORT;
+#else
+  Assert(fState & kUnixDomainSocketType);
+
+  struct sockaddr_un theAddr;
+  size_t pathLen = ::strlen(inPath);
+  if (pathLen == 0 || pathLen >= sizeof(theAddr.sun_path))
+    return (OS_Error) ENAMETOOLONG;
+
+  ::memset(&theAddr, 0, sizeof(theAddr));
+  theAddr.sun_family = AF_UNIX;
+  ::memcpy(theAddr.sun_path, inPath, pathLen);
+
+  // there is no peer ip address, keep fRemoteAddr zeroed
+  ::memset(&fRemoteAddr, 0, sizeof(fRemoteAddr));
+
+  // A unix domain connect completes at once or fails, EAGAIN when the
+  // listen queue is full: ClientSocket::Connect waits and tries again.
+  int err = ::connect(fFileDesc, (sockaddr *) &theAddr, sizeof(theAddr));
+  if (err == -1)
     return (OS_Error) Core::Thread::GetErrno();
+
+  fState |= kConnected;
+  return OS_NoErr;
+#endif
+}
+
+OS_Error TCPSocket::SendFile(int inFileDesc, UInt64 *ioOffset,
+                             UInt32 inLength, UInt32 *outLengthSent) {
+  Assert(ioOffset != nullptr);
+  Assert(outLengthSent != nullptr);
+  *outLengthSent = 0;
+
+  if (!(fState & kConnected))
+    return (OS_Error) ENOTCONN;
+
+#if __linux__
+  off_t theOffset = (off_t) *ioOffset;
+  ssize_t err;
+  do {
+    err = ::sendfile(fFileDesc, inFileDesc, &theOffset, inLength);
+  } while ((err == -1) && (Core::Thread::GetErrno() == EINTR));
+
+  if (err == -1) {
+    int theErr = Core::Thread::GetErrno();
+    // a read error on the file doesn't mean the peer is gone, but the
+    // response can't be completed either
+    if ((theErr != EAGAIN) && (this->IsConnected()))
+      fState ^= kConnected;//turn off connected state flag
+    return (OS_Error) theErr;
   }
 
+  *ioOffset = (UInt64) theOffset;
+  *outLengthSent = (UInt32) err;
   return OS_NoErr;
+#elif !__WinSock__
+  // no portable zero-copy, bounce through a small buffer. Only what the
+  // Socket accepted is consumed, the rest is read again next Time.
+  char theBuffer[16 * 1024];
+  if (inLength > sizeof(theBuffer))
+    inLength = sizeof(theBuffer);
+
+  ssize_t theLen;
+  do {
+    theLen = ::pread(inFileDesc, theBuffer, inLength, (off_t) *ioOffset);
+  } while ((theLen == -1) && (Core::Thread::GetErrno() == EINTR));
 
+  if (theLen == -1) {
+    if (this->IsConnected())
+      fState ^= kConnected;
+    return (OS_Error) Core::Thread::GetErrno();
+  }
+  if (theLen == 0)
+    return OS_NoErr;
+
+  OS_Error theErr = this->Send(theBuffer, (UInt32) theLen, outLengthSent);
+  if (theErr == OS_NoErr)
+    *ioOffset += *outLengthSent;
+  return theErr;
+#else
+  return (OS_Error) EOPNOTSUPP;
+#endif
 }
 
+OS_Error TCPSocket::Splice(int inPipeDesc, UInt32 inLength,
+                           UInt32 *outLengthSent) {
+  Assert(outLengthSent != nullptr);
+  *outLengthSent = 0;
+
+  if (!(fState & kConnected))
+    return (OS_Error) ENOTCONN;
+
+#if __linux__
+  ssize_t err;
+  do {
+    err = ::splice(inPipeDesc, nullptr, fFileDesc, nullptr, inLength,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+  } while ((err == -1) && (Core::Thread::GetErrno() == EINTR));
+
+  if (err == -1) {
+    int theErr = Core::Thread::GetErrno();
+    // EAGAIN is either side, an empty pipe or a full Socket
+    if ((theErr != EAGAIN) && (this->IsConnected()))
+      fState ^= kConnected;//turn off connected state flag
+    return (OS_Error) theErr;
+  }
+
+  *outLengthSent = (UInt32) err;
+  return OS_NoErr;
+#else
+  (void) inPipeDesc;
+  (void) inLength;
+  return (OS_Error) EOPNOTSUPP;
+#endif
+}
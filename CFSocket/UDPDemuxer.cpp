@@ -29,35 +29,170 @@
 
 */
 
+
 #include <CF/Net/Socket/UDPDemuxer.h>
+#include <CF/Net/Socket/UDPPacketBatch.h>
+#include <CF/Core/Time.h>
 
 using namespace CF::Net;
 
+// marks a bucket whose task was unregistered, probes walk past it
+static UDPDemuxerTask sTombstone;
+
+UDPDemuxer::UDPDemuxer(UInt32 inExpectedTasks)
+    : fNumTasks(0), fNumUsed(0), fMutex() {
+  // no need for a good random source, just one outsiders can't guess
+  fSeed = (UInt64) Core::Time::Microseconds() ^ ((UInt64) (PointerSizedInt) this << 16);
+
+  UInt32 theSize = kMinTableSize;
+  while (theSize < inExpectedTasks * 2 && theSize < 0x80000000U)
+    theSize <<= 1;
+  fTable.store(newTable(theSize));
+}
+
+UDPDemuxer::~UDPDemuxer() {
+  deleteTable(fTable.load());
+}
+
+UDPDemuxer::Table *UDPDemuxer::newTable(UInt32 inSize) {
+  auto *theTable = new Table;
+  theTable->fMask = inSize - 1;
+  theTable->fBuckets = new std::atomic<UDPDemuxerTask *>[inSize];
+  for (UInt32 i = 0; i < inSize; i++)
+    theTable->fBuckets[i].store(nullptr, std::memory_order_relaxed);
+  return theTable;
+}
+
+void UDPDemuxer::deleteTable(Table *inTable) {
+  delete[] inTable->fBuckets;
+  delete inTable;
+}
+
+void UDPDemuxer::insert(Table *inTable, UDPDemuxerTask *inTaskP) {
+  UInt32 thePos = inTaskP->fHashValue & inTable->fMask;
+  while (true) {
+    UDPDemuxerTask *theTask = inTable->fBuckets[thePos].load(std::memory_order_relaxed);
+    if (theTask == nullptr || theTask == &sTombstone) {
+      if (theTask == nullptr)
+        fNumUsed++;
+      // publishes the key fields set before
+      inTable->fBuckets[thePos].store(inTaskP, std::memory_order_release);
+      return;
+    }
+    thePos = (thePos + 1) & inTable->fMask;
+  }
+}
+
+void UDPDemuxer::rebuild(UInt32 inMinSize) {
+  Table *theOld = fTable.load(std::memory_order_relaxed);
+  Table *theNew = newTable(inMinSize);
+
+  fNumUsed = 0;
+  for (UInt32 i = 0; i <= theOld->fMask; i++) {
+    UDPDemuxerTask *theTask = theOld->fBuckets[i].load(std::memory_order_relaxed);
+    if (theTask != nullptr && theTask != &sTombstone)
+      this->insert(theNew, theTask);
+  }
+
+  fTable.store(theNew);
+
+  // readers may still probe the old array
+  fRCU.Synchronize();
+  deleteTable(theOld);
+}
+
 OS_Error UDPDemuxer::RegisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                   UDPDemuxerTask *inTaskP) {
   Assert(nullptr != inTaskP);
   Core::MutexLocker locker(&fMutex);
   if (this->GetTask(inRemoteAddr, inRemotePort) != nullptr)
     return (OS_Error) EPERM;
-  inTaskP->set(inRemoteAddr, inRemotePort);
-  fHashTable.Add(inTaskP);
+
+  inTaskP->fRemoteAddr = inRemoteAddr;
+  inTaskP->fRemotePort = inRemotePort;
+  inTaskP->fHashValue = UDPDemuxerUtils::ComputeHashValue(inRemoteAddr, inRemotePort, fSeed);
+
+  // keep at least a quarter of the buckets empty so probes stay short,
+  // tombstones are dropped on the way
+  Table *theTable = fTable.load(std::memory_order_relaxed);
+  UInt32 theSize = theTable->fMask + 1;
+  if ((fNumUsed + 1) * 4 > theSize * 3) {
+    while ((fNumTasks + 1) * 2 > theSize)
+      theSize <<= 1;
+    this->rebuild(theSize);
+    theTable = fTable.load(std::memory_order_relaxed);
+  }
+
+  this->insert(theTable, inTaskP);
+  fNumTasks++;
   return OS_NoErr;
 }
 
 OS_Error UDPDemuxer::UnregisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                     UDPDemuxerTask *inTaskP) {
-  Core::MutexLocker locker(&fMutex);
-  //remove by executing a lookup based on key information
-  UDPDemuxerTask *theTask = this->GetTask(inRemoteAddr, inRemotePort);
+  {
+    Core::MutexLocker locker(&fMutex);
+    Table *theTable = fTable.load(std::memory_order_relaxed);
+    UInt32 theHash = UDPDemuxerUtils::ComputeHashValue(inRemoteAddr, inRemotePort, fSeed);
+    UInt32 thePos = theHash & theTable->fMask;
+    while (true) {
+      UDPDemuxerTask *theTask = theTable->fBuckets[thePos].load(std::memory_order_relaxed);
+      if (theTask == nullptr)
+        return (OS_Error) EPERM;
+      if (theTask == inTaskP) {
+        if ((theTask->fRemoteAddr != inRemoteAddr) || (theTask->fRemotePort != inRemotePort))
+          return (OS_Error) EPERM;
+        theTable->fBuckets[thePos].store(&sTombstone, std::memory_order_release);
+        fNumTasks--;
+        break;
+      }
+      thePos = (thePos + 1) & theTable->fMask;
+    }
+  }
 
-  if ((nullptr != theTask) && (theTask == inTaskP)) {
-    fHashTable.Remove(theTask);
-    return OS_NoErr;
-  } else
-    return (OS_Error) EPERM;
+  // wait out lookups that found the task before it was removed
+  fRCU.Synchronize();
+  return OS_NoErr;
 }
 
 UDPDemuxerTask *UDPDemuxer::GetTask(UInt32 inRemoteAddr, UInt16 inRemotePort) {
-  UDPDemuxerKey theKey(inRemoteAddr, inRemotePort);
-  return fHashTable.Map(&theKey);
+  UInt32 theHash = UDPDemuxerUtils::ComputeHashValue(inRemoteAddr, inRemotePort, fSeed);
+
+  Core::RCUReadLocker locker(&fRCU);
+  Table *theTable = fTable.load(std::memory_order_acquire);
+  UInt32 thePos = theHash & theTable->fMask;
+  while (true) {
+    UDPDemuxerTask *theTask = theTable->fBuckets[thePos].load(std::memory_order_acquire);
+    if (theTask == nullptr)
+      return nullptr;
+    if ((theTask != &sTombstone) && (theTask->fHashValue == theHash)
+        && (theTask->fRemoteAddr == inRemoteAddr)
+        && (theTask->fRemotePort == inRemotePort))
+      return theTask;
+    thePos = (thePos + 1) & theTable->fMask;
+  }
+}
+
+UInt32 UDPDemuxer::RouteBatch(UDPPacketBatch *ioBatch) {
+  Assert(nullptr != ioBatch);
+  Core::RCUReadLocker locker(&fRCU);
+
+  UInt32 theNumRouted = 0;
+  UDPDemuxerTask *theLastTask = nullptr;
+  for (UInt32 i = 0; i < ioBatch->GetNumPackets(); i++) {
+    UDPPacket *thePacket = ioBatch->GetPacket(i);
+
+    // a batch usually holds runs of packets from the same peer
+    if ((theLastTask == nullptr)
+        || (theLastTask->fRemoteAddr != thePacket->fRemoteAddr)
+        || (theLastTask->fRemotePort != thePacket->fRemotePort))
+      theLastTask = this->GetTask(thePacket->fRemoteAddr, thePacket->fRemotePort);
+
+    thePacket->fTask = theLastTask;
+    if (theLastTask != nullptr) {
+      theLastTask->ProcessPacket(thePacket);
+      theNumRouted++;
+    }
+  }
+  return theNumRouted;
 }
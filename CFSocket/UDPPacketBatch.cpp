@@ -0,0 +1,96 @@
+/*
+    File:       UDPPacketBatch.cpp
+
+    Contains:   Implementation of UDPPacketBatch.
+
+*/
+
+#include <string.h>
+#include <CF/Net/Socket/UDPPacketBatch.h>
+
+using namespace CF::Net;
+
+UDPPacketBatch::UDPPacketBatch(UInt32 inNumPackets, UInt32 inPacketSize)
+    : fCapacity(inNumPackets > 0 ? inNumPackets : 1),
+      fPacketSize(inPacketSize > 0 ? inPacketSize : kDefaultPacketSize),
+      fNumPackets(0),
+      fCoalesced(nullptr),
+      fCoalescedOffset(0),
+      fCoalescedLength(0),
+      fSegmentSize(0),
+      fCoalescedAddr(0),
+      fCoalescedPort(0) {
+  fPackets = new UDPPacket[fCapacity];
+  fBuffers = new char[(size_t) fCapacity * fPacketSize];
+  fAddrs = new struct sockaddr_in[fCapacity];
+  ::memset(fAddrs, 0, sizeof(struct sockaddr_in) * fCapacity);
+
+#if __linux__
+  fIOVecs = new struct iovec[fCapacity];
+  fMsgs = new struct mmsghdr[fCapacity];
+  ::memset(fMsgs, 0, sizeof(struct mmsghdr) * fCapacity);
+#endif
+
+  for (UInt32 i = 0; i < fCapacity; i++) {
+    fPackets[i].fRemoteAddr = 0;
+    fPackets[i].fRemotePort = 0;
+    fPackets[i].fData = fBuffers + (size_t) i * fPacketSize;
+    fPackets[i].fLength = 0;
+    fPackets[i].fTask = nullptr;
+
+#if __linux__
+    fIOVecs[i].iov_base = fPackets[i].fData;
+    fIOVecs[i].iov_len = fPacketSize;
+    fMsgs[i].msg_hdr.msg_name = &fAddrs[i];
+    fMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    fMsgs[i].msg_hdr.msg_iov = &fIOVecs[i];
+    fMsgs[i].msg_hdr.msg_iovlen = 1;
+#endif
+  }
+}
+
+UDPPacketBatch::~UDPPacketBatch() {
+  delete[] fCoalesced;
+#if __linux__
+  delete[] fMsgs;
+  delete[] fIOVecs;
+#endif
+  delete[] fAddrs;
+  delete[] fBuffers;
+  delete[] fPackets;
+}
+
+void UDPPacketBatch::Clear() {
+  // packets added by reference point elsewhere
+  for (UInt32 i = 0; i < fNumPackets; i++)
+    fPackets[i].fData = fBuffers + (size_t) i * fPacketSize;
+  fNumPackets = 0;
+}
+
+bool UDPPacketBatch::AddReference(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                  char *inData, UInt32 inLength) {
+  if (fNumPackets >= fCapacity)
+    return false;
+
+  UDPPacket *thePacket = &fPackets[fNumPackets++];
+  thePacket->fRemoteAddr = inRemoteAddr;
+  thePacket->fRemotePort = inRemotePort;
+  thePacket->fTask = nullptr;
+  thePacket->fData = inData;
+  thePacket->fLength = inLength;
+  return true;
+}
+
+bool UDPPacketBatch::Add(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                         void const *inData, UInt32 inLength) {
+  if (fNumPackets >= fCapacity || inLength > fPacketSize)
+    return false;
+
+  UDPPacket *thePacket = &fPackets[fNumPackets++];
+  thePacket->fRemoteAddr = inRemoteAddr;
+  thePacket->fRemotePort = inRemotePort;
+  thePacket->fTask = nullptr;
+  ::memcpy(thePacket->fData, inData, inLength);
+  thePacket->fLength = inLength;
+  return true;
+}
@@ -0,0 +1,234 @@
+/*
+    File:       UDPRelay.cpp
+
+    Contains:   Implementation of UDPRelay and its subscribers.
+
+*/
+
+#include <string.h>
+#include <new>
+#include <CF/Net/Socket/UDPRelay.h>
+
+using namespace CF::Net;
+
+UDPRelayPacket *UDPRelayPacket::create(BufferPool *inPool, char *inData,
+                                       UInt32 inLength) {
+  auto *thePacket = new(inPool->Get()) UDPRelayPacket;
+  thePacket->fRefCount.store(1, std::memory_order_relaxed);
+  thePacket->fLength = inLength;
+  thePacket->fPool = inPool;
+  ::memcpy(thePacket->GetData(), inData, inLength);
+  return thePacket;
+}
+
+UDPRelaySubscriber::UDPRelaySubscriber(UInt32 inRemoteAddr,
+                                       UInt16 inRemotePort,
+                                       UInt32 inQueueLength,
+                                       DropPolicy inPolicy)
+    : fRemoteAddr(inRemoteAddr),
+      fRemotePort(inRemotePort),
+      fPolicy(inPolicy),
+      fCapacity(inQueueLength > 0 ? inQueueLength : 1),
+      fHead(0),
+      fCount(0),
+      fNumBatched(0),
+      fNumSent(0),
+      fNumDropped(0),
+      fElem(this) {
+  fQueue = new UDPRelayPacket *[fCapacity];
+}
+
+UDPRelaySubscriber::~UDPRelaySubscriber() {
+  while (fCount > 0)
+    this->pop();
+  delete[] fQueue;
+}
+
+void UDPRelaySubscriber::enqueue(UDPRelayPacket *inPacket) {
+  if (fCount == fCapacity) {
+    fNumDropped++;
+    if (fPolicy == kDropNewest)
+      return;
+    this->pop();
+  }
+
+  inPacket->Retain();
+  fQueue[(fHead + fCount) % fCapacity] = inPacket;
+  fCount++;
+}
+
+void UDPRelaySubscriber::pop() {
+  Assert(fCount > 0);
+  fQueue[fHead]->Release();
+  fHead = (fHead + 1) % fCapacity;
+  fCount--;
+}
+
+UDPRelay::UDPRelay(UInt32 inMaxPacketSize)
+    : Task(),
+      fSocket(this, Socket::kNonBlockingSocketType),
+      fPool(sizeof(UDPRelayPacket) + inMaxPacketSize),
+      fRecvBatch(UDPPacketBatch::kDefaultNumPackets, inMaxPacketSize),
+      // packets are added by reference, the batch's own buffers stay unused
+      fSendBatch(UDPPacketBatch::kDefaultNumPackets * 2, 1),
+      fSourceAddr(0),
+      fSourcePort(0),
+      fNumReceived(0) {
+  this->SetTaskName("UDPRelay");
+  fSendOwners = new UDPRelaySubscriber *[fSendBatch.GetCapacity()];
+}
+
+UDPRelay::~UDPRelay() {
+  // every queued packet goes back to fPool before it is destroyed
+  while (fSubscribers.GetLength() > 0)
+    delete (UDPRelaySubscriber *) fSubscribers.DeQueue()->GetEnclosingObject();
+  delete[] fSendOwners;
+}
+
+OS_Error UDPRelay::Bind(UInt32 inLocalAddr, UInt16 inLocalPort) {
+  OS_Error theErr = fSocket.Open();
+  if (theErr != OS_NoErr)
+    return theErr;
+  return fSocket.Bind(inLocalAddr, inLocalPort);
+}
+
+void UDPRelay::SetSource(UInt32 inRemoteAddr, UInt16 inRemotePort) {
+  Core::MutexLocker locker(&fMutex);
+  fSourceAddr = inRemoteAddr;
+  fSourcePort = inRemotePort;
+}
+
+UDPRelaySubscriber *UDPRelay::findSubscriber(UInt32 inRemoteAddr,
+                                             UInt16 inRemotePort) {
+  for (QueueIter theIter(&fSubscribers); !theIter.IsDone(); theIter.Next()) {
+    auto *theSubscriber = (UDPRelaySubscriber *) theIter.GetCurrent()->GetEnclosingObject();
+    if ((theSubscriber->fRemoteAddr == inRemoteAddr)
+        && (theSubscriber->fRemotePort == inRemotePort))
+      return theSubscriber;
+  }
+  return nullptr;
+}
+
+OS_Error UDPRelay::AddSubscriber(UDPRelaySubscriber *inSubscriber) {
+  Assert(inSubscriber != nullptr);
+  Core::MutexLocker locker(&fMutex);
+  if (this->findSubscriber(inSubscriber->fRemoteAddr, inSubscriber->fRemotePort) != nullptr)
+    return (OS_Error) EPERM;
+  fSubscribers.EnQueue(&inSubscriber->fElem);
+  return OS_NoErr;
+}
+
+OS_Error UDPRelay::RemoveSubscriber(UInt32 inRemoteAddr, UInt16 inRemotePort) {
+  Core::MutexLocker locker(&fMutex);
+  UDPRelaySubscriber *theSubscriber = this->findSubscriber(inRemoteAddr, inRemotePort);
+  if (theSubscriber == nullptr)
+    return (OS_Error) EPERM;
+  fSubscribers.Remove(&theSubscriber->fElem);
+  delete theSubscriber;
+  return OS_NoErr;
+}
+
+void UDPRelay::fanOut() {
+  for (UInt32 i = 0; i < fRecvBatch.GetNumPackets(); i++) {
+    UDPPacket *theRecvPacket = fRecvBatch.GetPacket(i);
+    if ((fSourceAddr != 0 && theRecvPacket->fRemoteAddr != fSourceAddr)
+        || (fSourcePort != 0 && theRecvPacket->fRemotePort != fSourcePort))
+      continue;
+    fNumReceived++;
+
+    if (fSubscribers.GetLength() == 0)
+      continue;
+
+    // the only copy of the payload, the queues share it
+    UDPRelayPacket *thePacket = UDPRelayPacket::create(
+        &fPool, theRecvPacket->fData, theRecvPacket->fLength);
+    for (QueueIter theIter(&fSubscribers); !theIter.IsDone(); theIter.Next())
+      ((UDPRelaySubscriber *) theIter.GetCurrent()->GetEnclosingObject())->enqueue(thePacket);
+    thePacket->Release();
+  }
+}
+
+OS_Error UDPRelay::flush() {
+  while (true) {
+    // take up to kSendQuota packets from each queue per round, so a deep
+    // queue can't crowd the others out of the batch
+    fSendBatch.Clear();
+    for (QueueIter theIter(&fSubscribers); !theIter.IsDone(); theIter.Next())
+      ((UDPRelaySubscriber *) theIter.GetCurrent()->GetEnclosingObject())->fNumBatched = 0;
+
+    bool theMore = true;
+    while (theMore && fSendBatch.GetNumPackets() < fSendBatch.GetCapacity()) {
+      theMore = false;
+      for (QueueIter theIter(&fSubscribers); !theIter.IsDone(); theIter.Next()) {
+        auto *theSubscriber = (UDPRelaySubscriber *) theIter.GetCurrent()->GetEnclosingObject();
+        for (UInt32 j = 0; j < kSendQuota && theSubscriber->fNumBatched < theSubscriber->fCount; j++) {
+          UDPRelayPacket *thePacket = theSubscriber->peek(theSubscriber->fNumBatched);
+          fSendOwners[fSendBatch.GetNumPackets()] = theSubscriber;
+          if (!fSendBatch.AddReference(theSubscriber->fRemoteAddr, theSubscriber->fRemotePort,
+                                       thePacket->GetData(), thePacket->GetLength()))
+            break;
+          theSubscriber->fNumBatched++;
+        }
+        if (theSubscriber->fNumBatched < theSubscriber->fCount)
+          theMore = true;
+      }
+    }
+
+    if (fSendBatch.GetNumPackets() == 0)
+      break;
+
+    UInt32 theNumSent = 0;
+    OS_Error theErr = fSocket.SendBatch(&fSendBatch, &theNumSent);
+
+    // batch order keeps each subscriber's packets in queue order, so what
+    // went out is always at the front of its queue
+    for (UInt32 i = 0; i < theNumSent; i++) {
+      fSendOwners[i]->pop();
+      fSendOwners[i]->fNumSent++;
+    }
+
+    if (theErr == OS_NoErr)
+      continue;
+    if ((theErr == EAGAIN) || (theErr == ENOBUFS))
+      return (OS_Error) EAGAIN;
+
+    // the failure belongs to this one destination (unreachable, refused),
+    // only its subscriber loses the packet
+    fSendOwners[theNumSent]->pop();
+    fSendOwners[theNumSent]->fNumDropped++;
+  }
+
+  fSendBatch.Clear();
+
+  // the next flush starts with another subscriber
+  if (fSubscribers.GetLength() > 1)
+    fSubscribers.EnQueue(fSubscribers.DeQueue());
+  return OS_NoErr;
+}
+
+SInt64 UDPRelay::Run() {
+  EventFlags events = this->GetEvents();
+  if (events & Thread::Task::kKillEvent)
+    return -1;
+
+  Core::MutexLocker locker(&fMutex);
+
+  // keep reading while the Socket is flow controlled, the drop policies
+  // decide what the queues hold until it drains
+  bool theBlocked = false;
+  if (events & Thread::Task::kReadEvent) {
+    for (UInt32 i = 0; i < kMaxBatchesPerRun; i++) {
+      if (fSocket.RecvBatch(&fRecvBatch) != OS_NoErr)
+        break;
+      this->fanOut();
+      if (!theBlocked)
+        theBlocked = (this->flush() == EAGAIN);
+    }
+  }
+
+  if (theBlocked || this->flush() == EAGAIN)
+    fSocket.RequestEvent(EV_RE | EV_WR);
+  else
+    fSocket.RequestEvent(EV_RE);
+  return 0;
+}
@@ -39,6 +39,21 @@
 #include <CF/Net/Socket/SocketUtils.h>
 #endif
 
+#if __linux__
+#include <netinet/udp.h>
+
+// older headers don't know about segmentation offload yet
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
 #if NEED_SOCKETBITS
 #if __GLIBC__ >= 2
 #include <bits/socket.h>
@@ -122,6 +137,291 @@ UDPSocket::RecvFrom(UInt32 *outRemoteAddr, UInt16 *outRemotePort,
   return OS_NoErr;
 }
 
+OS_Error UDPSocket::RecvBatch(UDPPacketBatch *ioBatch) {
+  Assert(ioBatch != nullptr);
+  ioBatch->Clear();
+
+  if ((fState & kGROEnabled) || ioBatch->fCoalescedOffset < ioBatch->fCoalescedLength)
+    return this->recvCoalesced(ioBatch);
+
+#if __linux__
+  // the kernel overwrites the name and flags fields, put them back
+  for (UInt32 i = 0; i < ioBatch->fCapacity; i++) {
+    ioBatch->fMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    ioBatch->fMsgs[i].msg_hdr.msg_flags = 0;
+  }
+
+  int theNumMsgs;
+  do {
+    theNumMsgs = ::recvmmsg(fFileDesc, ioBatch->fMsgs, ioBatch->fCapacity,
+                            MSG_DONTWAIT, nullptr);
+  } while ((theNumMsgs == -1) && (Core::Thread::GetErrno() == EINTR));
+
+  if (theNumMsgs == -1)
+    return (OS_Error) Core::Thread::GetErrno();
+
+  for (int i = 0; i < theNumMsgs; i++) {
+    UDPPacket *thePacket = &ioBatch->fPackets[i];
+    thePacket->fRemoteAddr = ntohl(ioBatch->fAddrs[i].sin_addr.s_addr);
+    thePacket->fRemotePort = ntohs(ioBatch->fAddrs[i].sin_port);
+    thePacket->fLength = ioBatch->fMsgs[i].msg_len;
+    thePacket->fTask = nullptr;
+  }
+  ioBatch->fNumPackets = (UInt32) theNumMsgs;
+  return OS_NoErr;
+#else
+  OS_Error theErr = OS_NoErr;
+  while (ioBatch->fNumPackets < ioBatch->fCapacity) {
+    UDPPacket *thePacket = &ioBatch->fPackets[ioBatch->fNumPackets];
+    theErr = this->RecvFrom(&thePacket->fRemoteAddr, &thePacket->fRemotePort,
+                            thePacket->fData, ioBatch->fPacketSize,
+                            &thePacket->fLength);
+    if (theErr != OS_NoErr)
+      break;
+    thePacket->fTask = nullptr;
+    ioBatch->fNumPackets++;
+  }
+  return ioBatch->fNumPackets > 0 ? OS_NoErr : theErr;
+#endif
+}
+
+OS_Error UDPSocket::SendBatch(UDPPacketBatch *inBatch, UInt32 *outNumSent) {
+  Assert(inBatch != nullptr);
+  Assert(outNumSent != nullptr);
+  *outNumSent = 0;
+
+#if __linux__
+  for (UInt32 i = 0; i < inBatch->fNumPackets; i++) {
+    UDPPacket *thePacket = &inBatch->fPackets[i];
+    struct sockaddr_in *theAddr = &inBatch->fAddrs[i];
+    theAddr->sin_family = AF_INET;
+    theAddr->sin_port = htons(thePacket->fRemotePort);
+    theAddr->sin_addr.s_addr = htonl(thePacket->fRemoteAddr);
+    inBatch->fIOVecs[i].iov_base = thePacket->fData;
+    inBatch->fIOVecs[i].iov_len = thePacket->fLength;
+    inBatch->fMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+  }
+
+  // sendmmsg returns early on the first failing datagram, retry the rest
+  // once to pick up its error
+  while (*outNumSent < inBatch->fNumPackets) {
+    int theNumMsgs = ::sendmmsg(fFileDesc, inBatch->fMsgs + *outNumSent,
+                                inBatch->fNumPackets - *outNumSent, 0);
+    if (theNumMsgs == -1) {
+      if (Core::Thread::GetErrno() == EINTR)
+        continue;
+      break;
+    }
+    *outNumSent += theNumMsgs;
+  }
+
+  // the receive path expects the batch's own, full sized buffers
+  for (UInt32 i = 0; i < inBatch->fNumPackets; i++) {
+    inBatch->fIOVecs[i].iov_base = inBatch->fBuffers + (size_t) i * inBatch->fPacketSize;
+    inBatch->fIOVecs[i].iov_len = inBatch->fPacketSize;
+  }
+
+  if (*outNumSent < inBatch->fNumPackets)
+    return (OS_Error) Core::Thread::GetErrno();
+  return OS_NoErr;
+#else
+  for (UInt32 i = 0; i < inBatch->fNumPackets; i++) {
+    UDPPacket *thePacket = &inBatch->fPackets[i];
+    OS_Error theErr = this->SendTo(thePacket->fRemoteAddr, thePacket->fRemotePort,
+                                   thePacket->fData, thePacket->fLength);
+    if (theErr != OS_NoErr)
+      return theErr;
+    (*outNumSent)++;
+  }
+  return OS_NoErr;
+#endif
+}
+
+OS_Error UDPSocket::recvCoalesced(UDPPacketBatch *ioBatch) {
+#if __linux__
+  if (ioBatch->fCoalesced == nullptr)
+    ioBatch->fCoalesced = new char[UDPPacketBatch::kMaxCoalescedSize];
+
+  OS_Error theErr = OS_NoErr;
+  while (ioBatch->fNumPackets < ioBatch->fCapacity) {
+    if (ioBatch->fCoalescedOffset >= ioBatch->fCoalescedLength) {
+      if (!(fState & kGROEnabled))
+        break;
+
+      // one read may hold many datagrams of one peer, all of the same size
+      // but the last
+      struct sockaddr_in theAddr;
+      struct iovec theVec = {ioBatch->fCoalesced, UDPPacketBatch::kMaxCoalescedSize};
+      char theControl[CMSG_SPACE(sizeof(int))];
+      struct msghdr theMsg;
+      ::memset(&theMsg, 0, sizeof(theMsg));
+      theMsg.msg_name = &theAddr;
+      theMsg.msg_namelen = sizeof(theAddr);
+      theMsg.msg_iov = &theVec;
+      theMsg.msg_iovlen = 1;
+      theMsg.msg_control = theControl;
+      theMsg.msg_controllen = sizeof(theControl);
+
+      ssize_t theRecvLen;
+      do {
+        theRecvLen = ::recvmsg(fFileDesc, &theMsg, MSG_DONTWAIT);
+      } while ((theRecvLen == -1) && (Core::Thread::GetErrno() == EINTR));
+
+      if (theRecvLen == -1) {
+        theErr = (OS_Error) Core::Thread::GetErrno();
+        break;
+      }
+
+      UInt32 theSegmentSize = (UInt32) theRecvLen;
+      for (struct cmsghdr *theCmsg = CMSG_FIRSTHDR(&theMsg); theCmsg != nullptr;
+           theCmsg = CMSG_NXTHDR(&theMsg, theCmsg)) {
+        if (theCmsg->cmsg_level == SOL_UDP && theCmsg->cmsg_type == UDP_GRO) {
+          int theGSOSize;
+          ::memcpy(&theGSOSize, CMSG_DATA(theCmsg), sizeof(theGSOSize));
+          if (theGSOSize > 0)
+            theSegmentSize = (UInt32) theGSOSize;
+        }
+      }
+
+      ioBatch->fCoalescedOffset = 0;
+      ioBatch->fCoalescedLength = (UInt32) theRecvLen;
+      ioBatch->fSegmentSize = theSegmentSize > 0 ? theSegmentSize : 1;
+      ioBatch->fCoalescedAddr = ntohl(theAddr.sin_addr.s_addr);
+      ioBatch->fCoalescedPort = ntohs(theAddr.sin_port);
+
+      if (theRecvLen == 0) {
+        // an empty datagram is still a datagram
+        UDPPacket *thePacket = &ioBatch->fPackets[ioBatch->fNumPackets++];
+        thePacket->fRemoteAddr = ioBatch->fCoalescedAddr;
+        thePacket->fRemotePort = ioBatch->fCoalescedPort;
+        thePacket->fLength = 0;
+        thePacket->fTask = nullptr;
+        continue;
+      }
+    }
+
+    // copy the next segment out, longer ones than the batch allows are cut
+    UInt32 theLength = ioBatch->fCoalescedLength - ioBatch->fCoalescedOffset;
+    if (theLength > ioBatch->fSegmentSize)
+      theLength = ioBatch->fSegmentSize;
+
+    UDPPacket *thePacket = &ioBatch->fPackets[ioBatch->fNumPackets++];
+    thePacket->fRemoteAddr = ioBatch->fCoalescedAddr;
+    thePacket->fRemotePort = ioBatch->fCoalescedPort;
+    thePacket->fLength = theLength < ioBatch->fPacketSize ? theLength : ioBatch->fPacketSize;
+    thePacket->fTask = nullptr;
+    ::memcpy(thePacket->fData, ioBatch->fCoalesced + ioBatch->fCoalescedOffset,
+             thePacket->fLength);
+    ioBatch->fCoalescedOffset += theLength;
+  }
+
+  return ioBatch->fNumPackets > 0 ? OS_NoErr : theErr;
+#else
+  return (OS_Error) EOPNOTSUPP;
+#endif
+}
+
+OS_Error UDPSocket::SendSegmented(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                  void *inBuffer, UInt32 inLength,
+                                  UInt16 inSegmentSize) {
+  Assert(inBuffer != nullptr);
+  Assert(inSegmentSize > 0);
+  if (inSegmentSize == 0)
+    return (OS_Error) EINVAL;
+
+  char *theData = (char *) inBuffer;
+  UInt32 theSent = 0;
+
+#if __linux__
+  struct sockaddr_in theRemoteAddr;
+  ::memset(&theRemoteAddr, 0, sizeof(theRemoteAddr));
+  theRemoteAddr.sin_family = AF_INET;
+  theRemoteAddr.sin_port = htons(inRemotePort);
+  theRemoteAddr.sin_addr.s_addr = htonl(inRemoteAddr);
+
+  // the kernel takes up to 64 segments and 64KB of payload per send
+  static const UInt32 kMaxSegments = 64;
+  static const UInt32 kMaxPayload = 65507;
+  UInt32 theSegmentsPerSend = kMaxPayload / inSegmentSize;
+  if (theSegmentsPerSend > kMaxSegments)
+    theSegmentsPerSend = kMaxSegments;
+
+  while (!(fState & kGSOUnsupported) && theSegmentsPerSend > 1
+      && inLength - theSent > inSegmentSize) {
+    UInt32 theChunk = inLength - theSent;
+    if (theChunk > theSegmentsPerSend * inSegmentSize)
+      theChunk = theSegmentsPerSend * inSegmentSize;
+
+    struct iovec theVec = {theData + theSent, theChunk};
+    char theControl[CMSG_SPACE(sizeof(UInt16))];
+    ::memset(theControl, 0, sizeof(theControl));
+    struct msghdr theMsg;
+    ::memset(&theMsg, 0, sizeof(theMsg));
+    theMsg.msg_name = &theRemoteAddr;
+    theMsg.msg_namelen = sizeof(theRemoteAddr);
+    theMsg.msg_iov = &theVec;
+    theMsg.msg_iovlen = 1;
+    theMsg.msg_control = theControl;
+    theMsg.msg_controllen = sizeof(theControl);
+
+    struct cmsghdr *theCmsg = CMSG_FIRSTHDR(&theMsg);
+    theCmsg->cmsg_level = SOL_UDP;
+    theCmsg->cmsg_type = UDP_SEGMENT;
+    theCmsg->cmsg_len = CMSG_LEN(sizeof(UInt16));
+    ::memcpy(CMSG_DATA(theCmsg), &inSegmentSize, sizeof(UInt16));
+
+    ssize_t theErr;
+    do {
+      theErr = ::sendmsg(fFileDesc, &theMsg, 0);
+    } while ((theErr == -1) && (Core::Thread::GetErrno() == EINTR));
+
+    if (theErr == -1) {
+      int theErrno = Core::Thread::GetErrno();
+      // No GSO in this kernel, or no checksum offload on the route. EINVAL
+      // also comes back for one bad send, a segment over the MTU say, so it
+      // only rules GSO out if none ever went through; otherwise just this
+      // call falls back.
+      if (theErrno == ENOPROTOOPT || theErrno == EIO
+          || (theErrno == EINVAL && !(fState & kGSOSupported))) {
+        fState |= kGSOUnsupported;
+        break;
+      }
+      if (theErrno == EINVAL)
+        break;
+      return (OS_Error) theErrno;
+    }
+    fState |= kGSOSupported;
+    theSent += theChunk;
+  }
+#endif
+
+  // software segmentation
+  while (theSent < inLength) {
+    UInt32 theChunk = inLength - theSent;
+    if (theChunk > inSegmentSize)
+      theChunk = inSegmentSize;
+    OS_Error theErr = this->SendTo(inRemoteAddr, inRemotePort, theData + theSent, theChunk);
+    if (theErr != OS_NoErr)
+      return theErr;
+    theSent += theChunk;
+  }
+  return OS_NoErr;
+}
+
+OS_Error UDPSocket::EnableGRO() {
+#if __linux__
+  int one = 1;
+  int err = ::setsockopt(fFileDesc, SOL_UDP, UDP_GRO, (char *) &one, sizeof(int));
+  if (err == -1)
+    return (OS_Error) Core::Thread::GetErrno();
+
+  fState |= kGROEnabled;
+  return OS_NoErr;
+#else
+  return (OS_Error) EOPNOTSUPP;
+#endif
+}
+
 OS_Error UDPSocket::JoinMulticast(UInt32 inRemoteAddr) {
   struct ip_mreq theMulti;
   UInt32 localAddr = fLocalAddr.sin_addr.s_addr; // Already in network byte order
@@ -34,6 +34,125 @@
 
 using namespace CF::Net;
 
+UDPPortPairAllocator::UDPPortPairAllocator(UInt16 inLowestPort, UInt16 inHighestPort)
+    : fLowestPort(inLowestPort),
+      fNumPairs(inHighestPort > inLowestPort ? (inHighestPort - inLowestPort) / 2 : 0) {
+  fNumWords = (fNumPairs + kBitsPerWord - 1) / kBitsPerWord;
+  fWordsPerShard = (fNumWords + kNumShards - 1) / kNumShards;
+  fBits = new std::atomic<UInt64>[fNumWords];
+  for (UInt32 i = 0; i < fNumWords; i++)
+    fBits[i].store(0, std::memory_order_relaxed);
+
+  // the bits past the last pair are never free
+  if (fNumPairs % kBitsPerWord != 0)
+    fBits[fNumWords - 1].store(~(((UInt64) 1 << (fNumPairs % kBitsPerWord)) - 1),
+                               std::memory_order_relaxed);
+
+  for (UInt32 i = 0; i < kNumShards; i++)
+    fShards[i].fCursor.store(i * fWordsPerShard * kBitsPerWord, std::memory_order_relaxed);
+}
+
+UDPPortPairAllocator::~UDPPortPairAllocator() {
+  delete[] fBits;
+}
+
+static inline UInt32 lowestBit(UInt64 inBits) {
+#if __GNUC__
+  return (UInt32) __builtin_ctzll(inBits);
+#else
+  UInt32 theBit = 0;
+  while ((inBits & 1) == 0) {
+    inBits >>= 1;
+    theBit++;
+  }
+  return theBit;
+#endif
+}
+
+UInt32 UDPPortPairAllocator::getShard() {
+  // threads are spread round robin, once each
+  static std::atomic<UInt32> sNextShard(0);
+  static thread_local UInt32 sShard = sNextShard.fetch_add(1) & (kNumShards - 1);
+  return sShard;
+}
+
+bool UDPPortPairAllocator::tryWord(UInt32 inWord, UInt64 inMask, UInt32 *outIndex) {
+  UInt64 theBits = fBits[inWord].load(std::memory_order_relaxed);
+  while ((~theBits & inMask) != 0) {
+    UInt32 theBit = lowestBit(~theBits & inMask);
+    if (fBits[inWord].compare_exchange_weak(theBits, theBits | ((UInt64) 1 << theBit))) {
+      *outIndex = inWord * kBitsPerWord + theBit;
+      return true;
+    }
+  }
+  return false;
+}
+
+UInt32 UDPPortPairAllocator::allocateInShard(UInt32 inShard) {
+  UInt32 theFirstWord = inShard * fWordsPerShard;
+  if (theFirstWord >= fNumWords)
+    return kInvalidIndex;
+  UInt32 theNumWords = fWordsPerShard;
+  if (theFirstWord + theNumWords > fNumWords)
+    theNumWords = fNumWords - theFirstWord;
+
+  // start where the last allocation in this shard left off, so a pair that
+  // failed to bind (another process has it) isn't retried right away
+  UInt32 theCursor = fShards[inShard].fCursor.load(std::memory_order_relaxed);
+  UInt32 theStartWord = theCursor / kBitsPerWord;
+  if ((theStartWord < theFirstWord) || (theStartWord >= theFirstWord + theNumWords)) {
+    theStartWord = theFirstWord;
+    theCursor = theFirstWord * kBitsPerWord;
+  }
+  UInt64 theHighMask = ~(((UInt64) 1 << (theCursor % kBitsPerWord)) - 1);
+
+  UInt32 theIndex = kInvalidIndex;
+  for (UInt32 i = 0; i <= theNumWords; i++) {
+    UInt32 theWord = theFirstWord + (theStartWord - theFirstWord + i) % theNumWords;
+    UInt64 theMask = ~(UInt64) 0;
+    if (i == 0)
+      theMask = theHighMask;
+    else if (i == theNumWords)
+      theMask = ~theHighMask;  // back around to the start word
+
+    if (this->tryWord(theWord, theMask, &theIndex)) {
+      fShards[inShard].fCursor.store(theIndex + 1, std::memory_order_relaxed);
+      return theIndex;
+    }
+  }
+  return kInvalidIndex;
+}
+
+UInt32 UDPPortPairAllocator::Allocate() {
+  UInt32 theShard = getShard();
+  for (UInt32 i = 0; i < kNumShards; i++) {
+    UInt32 theIndex = this->allocateInShard((theShard + i) & (kNumShards - 1));
+    if (theIndex != kInvalidIndex)
+      return theIndex;
+  }
+  return kInvalidIndex;
+}
+
+UInt32 UDPPortPairAllocator::Allocate(UInt16 inPort) {
+  if ((inPort < fLowestPort) || ((inPort - fLowestPort) % 2 != 0))
+    return kInvalidIndex;
+  UInt32 theIndex = (UInt32) (inPort - fLowestPort) / 2;
+  if (theIndex >= fNumPairs)
+    return kInvalidIndex;
+
+  UInt64 theBit = (UInt64) 1 << (theIndex % kBitsPerWord);
+  if (fBits[theIndex / kBitsPerWord].fetch_or(theBit) & theBit)
+    return kInvalidIndex;
+  return theIndex;
+}
+
+void UDPPortPairAllocator::Release(UInt32 inIndex) {
+  Assert(inIndex < fNumPairs);
+  UInt64 theBit = (UInt64) 1 << (inIndex % kBitsPerWord);
+  UInt64 theOld = fBits[inIndex / kBitsPerWord].fetch_and(~theBit);
+  Assert(theOld & theBit);
+}
+
 /**
  * 获取 UDPSocket Pair
  * @param inIPAddr  local ip
@@ -42,8 +161,8 @@ using namespace CF::Net;
  * @param inSrcPort    remote port
  */
 UDPSocketPair *UDPSocketPool::GetUDPSocketPair(UInt32 inIPAddr, UInt16 inPort, UInt32 inSrcIPAddr, UInt16 inSrcPort) {
-  Core::MutexLocker locker(&fMutex);
   if ((inSrcIPAddr != 0) || (inSrcPort != 0)) {
+    Core::MutexLocker locker(&fMutex);
     /* If we find a pair that is:
      *   a) on the right IP address,
      *   b) doesn't have this source IP & port in the demuxer already,
@@ -75,67 +194,93 @@ UDPSocketPair *UDPSocketPool::GetUDPSocketPair(UInt32 inIPAddr, UInt16 inPort, U
 }
 
 void UDPSocketPool::ReleaseUDPSocketPair(UDPSocketPair *inPair) {
-  Core::MutexLocker locker(&fMutex);
-  inPair->fRefCount--;
-  if (inPair->fRefCount == 0) {
+  {
+    Core::MutexLocker locker(&fMutex);
+    inPair->fRefCount--;
+    if (inPair->fRefCount > 0)
+      return;
     fUDPQueue.Remove(&inPair->fElem);
-    this->DestructUDPSocketPair(inPair);
   }
+
+  // nobody can find the pair any more
+  UInt32 thePortIndex = inPair->fPortIndex;
+  this->DestructUDPSocketPair(inPair);
+  if (thePortIndex != UDPPortPairAllocator::kInvalidIndex)
+    fPorts.Release(thePortIndex);
 }
 
-UDPSocketPair *UDPSocketPool::CreateUDPSocketPair(UInt32 inAddr, UInt16 inPort) {
-  // try to find an open pair of ports to bind these suckers tooo
-  Core::MutexLocker locker(&fMutex);
-  UDPSocketPair *thePair = nullptr;
-  UInt16 socketAPort = kLowestUDPPort;
-  UInt16 socketBPort;
+OS_Error UDPSocketPool::bindUDPSocketPair(UDPSocketPair *inPair, UInt32 inAddr, UInt16 inPort) {
+  // 创建数据报 Socket 端口
+  OS_Error theErr = inPair->fSocketA->Open();
+  if (theErr == OS_NoErr)
+    theErr = inPair->fSocketB->Open();
+  if (theErr != OS_NoErr)
+    return theErr;
+
+  // Set Socket options on these new sockets. 主要是设置 Socket buf size
+  this->SetUDPSocketOptions(inPair);
 
-  // If port is 0, then the caller doesn't care what port # we bind this Socket to.
-  // Otherwise, ONLY attempt to bind this Socket to the specified port
-  if (inPort != 0) socketAPort = inPort;
+  // 在两个 Socket 端口上执行 bind 操作,两个 port 相差 1.
+  theErr = inPair->fSocketA->Bind(inAddr, inPort);
+  if (theErr == OS_NoErr)
+    theErr = inPair->fSocketB->Bind(inAddr, static_cast<UInt16>(inPort + 1));
+  return theErr;
+}
+
+UDPSocketPair *UDPSocketPool::CreateUDPSocketPair(UInt32 inAddr, UInt16 inPort) {
+  // Ports are shared by all local addresses in fPorts, a pair taken on one
+  // address is not offered on another. The pool mutex is only taken to add
+  // the new pair to the queue.
+  for (UInt32 theTries = 0; theTries < fPorts.GetNumPairs(); theTries++) {
+    UInt32 thePortIndex;
+    UInt16 socketAPort;
 
-  while (socketAPort < kHighestUDPPort) {
-    socketBPort = static_cast<UInt16>(socketAPort + 1);  // make Socket pairs adjacent to one another
+    // If port is 0, then the caller doesn't care what port # we bind this Socket to.
+    // Otherwise, ONLY attempt to bind this Socket to the specified port
+    if (inPort != 0) {
+      // a port outside of fPorts is simply tried, as before
+      thePortIndex = fPorts.Allocate(inPort);
+      if ((thePortIndex == UDPPortPairAllocator::kInvalidIndex)
+          && (inPort >= kLowestUDPPort) && ((inPort - kLowestUDPPort) % 2 == 0))
+        return nullptr;  // one of our pairs has it
+      socketAPort = inPort;
+    } else {
+      thePortIndex = fPorts.Allocate();
+      if (thePortIndex == UDPPortPairAllocator::kInvalidIndex)
+        return nullptr;
+      socketAPort = fPorts.GetPort(thePortIndex);
+    }
 
-    thePair = ConstructUDPSocketPair();  // 创建一个 udp Socket pair
+    UDPSocketPair *thePair = ConstructUDPSocketPair();  // 创建一个 udp Socket pair
     Assert(thePair != nullptr);
 
     // check construct udp socket pair fail
-    if (thePair == nullptr) return nullptr;
-
-    // 创建数据报 Socket 端口
-    if (thePair->fSocketA->Open() != OS_NoErr || thePair->fSocketB->Open() != OS_NoErr) break;
-
-    // Set Socket options on these new sockets. 主要是设置 Socket buf size
-    this->SetUDPSocketOptions(thePair);
+    if (thePair == nullptr) {
+      if (thePortIndex != UDPPortPairAllocator::kInvalidIndex)
+        fPorts.Release(thePortIndex);
+      return nullptr;
+    }
 
-    // 在两个 Socket 端口上执行 bind 操作,两个 port 相差 1.
-    OS_Error theErr = thePair->fSocketA->Bind(inAddr, socketAPort);
+    OS_Error theErr = this->bindUDPSocketPair(thePair, inAddr, socketAPort);
     if (theErr == OS_NoErr) {
-      //s_printf("fSocketA->Bind ok on port%u\n", socketAPort);
-      theErr = thePair->fSocketB->Bind(inAddr, socketBPort);
-      if (theErr == OS_NoErr) {
-        //s_printf("fSocketB->Bind ok on port%u\n", socketBPort);
-        fUDPQueue.EnQueue(&thePair->fElem);
-        thePair->fRefCount++;
-
-        return thePair;
-      }
-      //else s_printf("fSocketB->Bind failed on port%u\n", socketBPort);
-    }
-    //else s_printf("fSocketA->Bind failed on port%u\n", socketAPort);
+      thePair->fPortIndex = thePortIndex;
+      thePair->fRefCount++;
 
-    // If we are looking to bind to a specific port set, and we couldn't then just break here.
-    if (inPort != 0) break;
+      Core::MutexLocker locker(&fMutex);
+      fUDPQueue.EnQueue(&thePair->fElem);
+      return thePair;
+    }
 
-    socketAPort += 2; //try a higher port pair
+    this->DestructUDPSocketPair(thePair);
+    if (thePortIndex != UDPPortPairAllocator::kInvalidIndex)
+      fPorts.Release(thePortIndex);
 
-    this->DestructUDPSocketPair(thePair); //a bind failure
-    thePair = nullptr;
+    // If we are looking to bind to a specific port set, or couldn't even open
+    // the sockets, just give up here. Otherwise another process has one of the
+    // ports, try another pair, the allocator moves past this one.
+    if ((inPort != 0) || (theErr != EADDRINUSE && theErr != EACCES))
+      return nullptr;
   }
 
-  // if we couldn't find a pair of sockets, make sure to clean up our mess
-  if (thePair != nullptr) this->DestructUDPSocketPair(thePair);
-
   return nullptr;
 }
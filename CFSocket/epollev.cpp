@@ -1,5 +1,6 @@
 #include <sys/errno.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <map>
 
@@ -15,6 +16,7 @@
 using namespace CF::Core;
 
 static int gEpollFD = -1;                // epoll 描述符
+static int gWakeupFD = -1;               // eventfd，select_wakeup 写入，唤醒 epoll_wait
 static epoll_event *gEpollEvents = NULL; // epoll 事件接收数组
 static int gCurEventReadPos = 0;         // 当前读事件位置，在epoll事件数组中的位置
 static int gCurTotalEvents = 0;          // 总的事件个数，每次epoll_wait之后更新
@@ -30,6 +32,7 @@ static SpinLock sArrayLock;              // _events 自旋锁
  * EPOLLPRI：表示对应的文件描述符有紧急的数据可读（这里应该表示有带外数据到来）；
  * EPOLLERR：表示对应的文件描述符发生错误；
  * EPOLLHUP：表示对应的文件描述符被挂断；
+ * EPOLLRDHUP：表示对端关闭了连接，或者关闭了写端；
  * EPOLLET： 将EPOLL设为边缘触发（Edge Triggered）模式，这是相对于水平触发
  *           （Level Triggered）来说的。
  * EPOLLONESHOT：只监听一次事件，当监听完这次事件之后，如果还需要继续监听这个
@@ -53,11 +56,33 @@ void select_startevents() {
     }
   }
 
+  if (gWakeupFD == -1) {
+    gWakeupFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (gWakeupFD == -1) {
+      perror("create gWakeupFD error: ");
+      exit(-1);
+    }
+
+    // level triggered, stays readable until select_waitevent drains it
+    struct epoll_event ev;
+    ev.data.fd = gWakeupFD;
+    ev.events = EPOLLIN;
+    if (epoll_ctl(gEpollFD, EPOLL_CTL_ADD, gWakeupFD, &ev) == -1) {
+      perror("watch gWakeupFD error: ");
+      exit(-1);
+    }
+  }
+
   gCurEventReadPos = 0;
   gCurTotalEvents = 0;
 }
 
 void select_stopevents() {
+  if (gWakeupFD != -1) {
+    ::close(gWakeupFD);
+    gWakeupFD = -1;
+  }
+
   if (gEpollFD != -1) {
     ::close(gEpollFD); /* 关闭文件描述符 */
     gEpollFD = -1;
@@ -83,8 +108,9 @@ int select_modwatch0(struct eventreq *req, int which, bool isAdd) {
   if (which & EV_OS)
     ev.events |= EPOLLONESHOT;  // one shot
 
+  // EPOLLHUP and EPOLLERR are always reported by the kernel
   if (which & EV_RE)
-    ev.events |= EPOLLIN | EPOLLHUP | EPOLLERR;
+    ev.events |= EPOLLIN | EPOLLRDHUP;
 
   if (which & EV_WR)
     ev.events |= EPOLLOUT;
@@ -98,6 +124,13 @@ int select_modwatch0(struct eventreq *req, int which, bool isAdd) {
     do {
       ret = epoll_ctl(gEpollFD, EPOLL_CTL_MOD, req->er_handle, &ev);
     } while (ret == -1 && Thread::GetErrno() == EINTR);
+
+    // the fd was taken out by select_removeevent (EV_RM), add it back.
+    if (ret == -1 && Thread::GetErrno() == ENOENT) {
+      do {
+        ret = epoll_ctl(gEpollFD, EPOLL_CTL_ADD, req->er_handle, &ev);
+      } while (ret == -1 && Thread::GetErrno() == EINTR);
+    }
   }
 
   if (ret == 0) {
@@ -115,6 +148,18 @@ int select_watchevent(struct eventreq *req, int which) {
   return select_modwatch0(req, which, true);
 }
 
+/**
+ * 唤醒阻塞在 select_waitevent 中的 EventThread，使其立即返回 EINTR
+ *
+ * @note 用于退出流程：EventThread 只在 select_waitevent 返回后检查
+ *       CFState 和 IsStopRequested，否则要等 epoll_wait 超时
+ */
+void select_wakeup() {
+  if (gWakeupFD == -1) return;
+  UInt64 theOne = 1;
+  (void) ::write(gWakeupFD, &theOne, sizeof(theOne));
+}
+
 int select_removeevent(int which) {
   SpinLocker locker(&sMapLock);
   int ret = epoll_ctl(gEpollFD, EPOLL_CTL_DEL, which, NULL); // remove all this fd events
@@ -137,7 +182,7 @@ int epoll_waitevent() {
 
   if (gCurTotalEvents > 0) { // 从事件数组中每次取一个，取的位置通过m_curEventReadPos设置
     curreadPos = gCurEventReadPos++;
-    if (gCurEventReadPos >= gCurTotalEvents - 1) {
+    if (gCurEventReadPos >= gCurTotalEvents) {
       gCurEventReadPos = 0;
       gCurTotalEvents = 0;
     }
@@ -154,15 +199,26 @@ int epoll_waitevent() {
 int select_waitevent(struct eventreq *req, void *onlyForMOSX) {
   SpinLocker locker(&sArrayLock);
   int eventPos = epoll_waitevent();
+  if (eventPos >= 0 && gEpollEvents[eventPos].data.fd == gWakeupFD) {
+    UInt64 theCount;
+    (void) ::read(gWakeupFD, &theCount, sizeof(theCount));
+    return EINTR;
+  }
   if (eventPos >= 0) {
     req->er_handle = gEpollEvents[eventPos].data.fd;
-    if (gEpollEvents[eventPos].events == EPOLLIN ||
-        gEpollEvents[eventPos].events == EPOLLHUP ||
-        gEpollEvents[eventPos].events == EPOLLERR) {
-      req->er_eventbits = EV_RE;  // we only support read event
-    } else if (gEpollEvents[eventPos].events == EPOLLOUT) {
-      req->er_eventbits = EV_WR;
-    }
+
+    // several conditions may be reported together, keep all of them.
+    UInt32 theEvents = gEpollEvents[eventPos].events;
+    req->er_eventbits = 0;
+    if (theEvents & (EPOLLIN | EPOLLPRI))
+      req->er_eventbits |= EV_RE;
+    if (theEvents & EPOLLOUT)
+      req->er_eventbits |= EV_WR;
+    if (theEvents & (EPOLLHUP | EPOLLRDHUP))
+      req->er_eventbits |= EV_HU;
+    if (theEvents & EPOLLERR)
+      req->er_eventbits |= EV_ER;
+
     SpinLocker locker1(&sMapLock);
     req->er_data = gDataMap[req->er_handle];
     return 0;
@@ -55,6 +55,17 @@ class ClientSocket {
     fHostPort = hostPort;
   }
 
+  // For sockets created with Socket::kUnixDomainSocketType, the server
+  // is the listener at hostPath.
+  void Set(char const *hostPath);
+
+  // A connect still in progress after this many ms fails with ETIMEDOUT.
+  // The caller's task has to wake up to notice, see
+  // TCPSocket::GetConnectTimeRemaining. 0 (the default) waits for the kernel.
+  void SetConnectTimeout(SInt64 inTimeoutInMilSecs) {
+    fConnectTimeoutInMilSecs = inTimeoutInMilSecs;
+  }
+
   //
   // Sends data to the server. If this returns EAGAIN or EINPROGRESS, call again
   // until it returns OS_NoErr or another error. On subsequent calls, you need not
@@ -100,6 +111,8 @@ class ClientSocket {
 
   UInt32 fHostAddr;
   UInt16 fHostPort;
+  char fHostPath[Socket::kMaxUnixPathLen];
+  SInt64 fConnectTimeoutInMilSecs;
 
   UInt32 fEventMask;
   Socket *fSocketP;
@@ -46,7 +46,7 @@
 
 #endif
 
-#include <CF/Ref.h>
+#include <CF/HandleTable.h>
 #include <CF/Thread/Task.h>
 
 //enable to trace event context execution and the task associated with the context
@@ -87,12 +87,34 @@ class EventContext {
    */
   void InitNonBlocking(SOCKET inFileDesc);
 
-  void SetMode(bool useET) { this->fUseETMode = useET; }
+  /**
+   * @brief select edge triggered mode
+   *
+   * In edge triggered mode the fd is registered once and interests are only
+   * ever added, so repeated RequestEvent calls cost no syscall. The owner
+   * must read and write until EAGAIN, because readiness is reported once.
+   * Only the epoll implementation supports it, elsewhere this is a no-op.
+   */
+  void SetMode(bool useET) {
+#if __linux__ && !MACOSXEVENTQUEUE
+    this->fUseETMode = useET;
+#else
+    this->fUseETMode = false;
+#endif
+  }
+
+  bool IsETMode() { return fUseETMode; }
 
   //
   // Arms this EventContext. Pass in the events you would like to receive
   virtual void RequestEvent(UInt32 theMask);
 
+  //
+  // Edge triggered mode only: stops watching theMask, EV_WR once all is
+  // written say, which RequestEvent never does by itself. Costs a syscall
+  // only when something in theMask is armed.
+  void DropEvent(UInt32 theMask);
+
   //
   // Provide the task you would like to be notified
   void SetTask(Thread::Task *inTask) {
@@ -129,9 +151,12 @@ class EventContext {
    * will get called. Default behavior is to Signal the associated
    * task, but that behavior may be altered / overridden.
    *
-   * Currently, we always generate a Task::kReadEvent
+   * The event bits reported by the backend are translated into task events:
+   * EV_RE -> kReadEvent, EV_WR -> kWriteEvent, EV_HU -> kHangupEvent and
+   * EV_ER -> kErrorEvent. Hangup and error are delivered together with a
+   * kReadEvent, so the task finds the EOF or the error on its next read.
    */
-  virtual void ProcessEvent(int /*eventBits*/) {
+  virtual void ProcessEvent(int eventBits) {
     if (DEBUG_EVENT_CONTEXT) {
       if (fTask == nullptr)
         s_printf("EventContext::ProcessEvent context=%p task=NULL\n",
@@ -142,18 +167,18 @@ class EventContext {
     }
 
     if (fTask != nullptr)
-      fTask->Signal(Thread::Task::kReadEvent);
+      fTask->Signal(TaskEvents(eventBits));
   }
 
+  static Thread::Task::EventFlags TaskEvents(int eventBits);
+
   SOCKET fFileDesc;
 
  private:
   struct eventreq fEventReq;
   bool fUseETMode; // Edge Triggered Mode
 
-  Ref fRef; /* 引用记录，用于 event 调度 */
-  PointerSizedInt fUniqueID;
-  StrPtrLen fUniqueIDStr;
+  HandleTable::Handle fUniqueID; /* 句柄，用于 event 调度 */
   EventThread *fEventThread;
   bool fWatchEventCalled;
   int fEventBits;
@@ -164,8 +189,6 @@ class EventContext {
   bool fModwatched;
 #endif
 
-  static std::atomic<unsigned int> sUniqueID; // id 分配器
-
   friend class EventThread;
 };
 
@@ -177,14 +200,14 @@ class EventContext {
 class EventThread : public Core::Thread {
  public:
 
-  EventThread() : Thread() {}
+  EventThread();
   ~EventThread() override = default;
 
  private:
 
   void Entry() override;
 
-  RefTable fRefTable;
+  HandleTable fHandleTable;
 
   friend class EventContext;
 };
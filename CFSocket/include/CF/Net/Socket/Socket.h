@@ -85,6 +85,10 @@ class Socket : public EventContext {
 
   static void Release() {
     if (sEventThread != nullptr) {
+      sEventThread->SendStopRequest();
+#if !MACOSXEVENTQUEUE
+      ::select_wakeup(); // 不等 select_waitevent 超时
+#endif
       sEventThread->StopAndWaitForThread();
       delete sEventThread;
       sEventThread = nullptr;
@@ -103,6 +107,12 @@ class Socket : public EventContext {
    */
   OS_Error Bind(UInt32 addr, UInt16 port, bool test = false);
 
+  /**
+   * Bind - binds a kUnixDomainSocketType socket to a filesystem path.
+   * @return CF_FileNotOpen, CF_NoErr, or POSIX error code.
+   */
+  OS_Error Bind(char const *inPath);
+
   /**
    * Unbind - unbinds the socket.
    */
@@ -114,6 +124,12 @@ class Socket : public EventContext {
 
   void KeepAlive();
 
+  /**
+   * ShutdownWrite - sends a FIN after what is queued, the peer reads the
+   * end of the data before any RST a later close may cause. Best effort.
+   */
+  void ShutdownWrite();
+
   void SetSocketBufSize(UInt32 inNewSize);
 
   /**
@@ -139,12 +155,41 @@ class Socket : public EventContext {
    */
   OS_Error WriteV(const struct iovec *iov, UInt32 numVecs, UInt32 *outLengthSent);
 
+  /**
+   * EnableZeroCopy - opts the Socket in to SO_ZEROCOPY (Linux 4.14+).
+   * @return CF_NoErr, EOPNOTSUPP on platforms without it, or POSIX error code.
+   */
+  OS_Error EnableZeroCopy();
+
+  /**
+   * SendZeroCopy - same as Send, but with MSG_ZEROCOPY the kernel transmits
+   * straight out of inData. Every call that sends something takes the next
+   * sequence number, and inData must stay untouched until ReapZeroCopy
+   * reports that sequence as completed.
+   * @return CF_FileNotOpen, CF_NoErr, or POSIX error code.
+   */
+  OS_Error SendZeroCopy(char const *inData, UInt32 inLength, UInt32 *outLengthSent);
+
+  /**
+   * ReapZeroCopy - reads the completion notifications off the error queue.
+   * @return number of zero copy sends completed so far, all sequence numbers
+   * below it may be reused.
+   */
+  UInt32 ReapZeroCopy();
+
+  // the sequence number the next SendZeroCopy will take
+  UInt32 GetZeroCopySequence() { return fZeroCopySequence; }
+
+  bool IsZeroCopy() { return (bool) (fState & kZeroCopy); }
+
   // You can query for the Socket's state
 
   bool IsConnected() { return (bool) (fState & kConnected); }
 
   bool IsBound() { return (bool) (fState & kBound); }
 
+  bool IsUnixDomain() { return (bool) (fState & kUnixDomainSocketType); }
+
   //If the Socket is bound, you may find out to which addr it is bound
   UInt32 GetLocalAddr() { return ntohl(fLocalAddr.sin_addr.s_addr); }
 
@@ -165,6 +210,12 @@ class Socket : public EventContext {
     // Socket should be non-blocking or blocking
     kNonBlockingSocketType = 0x0001U,
     kEdgeTriggeredSocketMode = 0x0002U,
+    // AF_UNIX instead of AF_INET, addresses are file system paths
+    kUnixDomainSocketType = 0x0010U,
+  };
+
+  enum {
+    kMaxUnixPathLen = 108 //UInt32, sizeof(sockaddr_un::sun_path) on Linux
   };
 
  protected:
@@ -204,11 +255,19 @@ class Socket : public EventContext {
   // their own
   enum {
     kBound = 0x0004,
-    kConnected = 0x0008
+    kConnected = 0x0008,
+    kZeroCopy = 0x0020
   };
 
+  // MSG_ZEROCOPY sends issued / completed by the kernel
+  UInt32 fZeroCopySequence;
+  UInt32 fZeroCopyCompleted;
+
   static EventThread *sEventThread;
 
+  // reported as the ip address of unix domain sockets
+  static StrPtrLen sUnixAddrStr;
+
 };
 
 } // namespace Net
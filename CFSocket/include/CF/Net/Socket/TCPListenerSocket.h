@@ -53,8 +53,11 @@ class TCPListenerSocket : public TCPSocket, public Thread::IdleTask {
         fOutOfDescriptors(false),
         fSleepBetweenAccepts(false) {
     this->SetTaskName("TCPListenerSocket");
+    fUnixPath[0] = '\0';
   }
-  ~TCPListenerSocket() override = default;
+
+  // removes the Socket file of a unix domain listener
+  ~TCPListenerSocket() override;
 
   //
   // Send a TCPListenerObject a Kill event to delete it.
@@ -67,6 +70,14 @@ class TCPListenerSocket : public TCPSocket, public Thread::IdleTask {
    */
   OS_Error Initialize(UInt32 addr, UInt16 port);
 
+  /**
+   * starts listening on a unix domain stream Socket. Accepted sockets are
+   * flagged kUnixDomainSocketType and run through GetSessionTask like TCP.
+   * @param path - Socket file, a stale file from a previous run is removed.
+   * @return
+   */
+  OS_Error Initialize(char const *path);
+
   //You can query the listener to see if it is failing to accept
   //connections because the OS is out of descriptors.
   bool IsOutOfDescriptors() { return fOutOfDescriptors; }
@@ -74,6 +85,21 @@ class TCPListenerSocket : public TCPSocket, public Thread::IdleTask {
   void SlowDown() { fSleepBetweenAccepts = true; }
   void RunNormal() { fSleepBetweenAccepts = false; }
 
+  /**
+   * @brief set the accept profile shared by all listeners
+   *
+   * Must be called before Initialize, CFMain fills it from CFConfigure.
+   *
+   * @param listenQueueLength  - backlog passed to listen()
+   * @param maxAcceptsPerEvent - connections drained for one read event
+   * @param noDelay            - disable nagle on accepted sockets
+   * @param keepAlive          - enable SO_KEEPALIVE on accepted sockets
+   * @param sndBufSize         - SO_SNDBUF of accepted sockets, 0 means
+   *                             keep the kernel default
+   */
+  static void Configure(UInt32 listenQueueLength, UInt32 maxAcceptsPerEvent,
+                        bool noDelay, bool keepAlive, UInt32 sndBufSize);
+
   //derived object must implement a way of getting tasks & sockets to this object
   virtual Thread::Task *GetSessionTask(TCPSocket **outSocket) = 0;
 
@@ -83,17 +109,33 @@ class TCPListenerSocket : public TCPSocket, public Thread::IdleTask {
 
   enum {
     kTimeBetweenAcceptsInMsec = 1000,   //UInt32
-    kListenQueueLength = 128            //UInt32
+    kListenQueueLength = 128,           //UInt32
+    kMaxAcceptsPerEvent = 32,           //UInt32
+    kSendBufSizeInBytes = 96 * 1024     //UInt32
   };
 
   void ProcessEvent(int eventBits) override;
   OS_Error listen(UInt32 queueLength);
 
+  // Applies the accept profile to osSocket, or to the listening Socket
+  // itself where accepted sockets inherit the options from it.
+  void setSocketProfile(int osSocket);
+
+  // Returns the new Socket, or kInvalidFileDesc with the error in outErr.
+  int accept(struct sockaddr_in *outAddr, int *outErr);
+
   UInt32 fAddr;
   UInt16 fPort;
+  char fUnixPath[kMaxUnixPathLen];
 
   bool fOutOfDescriptors;
   bool fSleepBetweenAccepts;
+
+  static UInt32 sListenQueueLength;
+  static UInt32 sMaxAcceptsPerEvent;
+  static bool sNoDelay;
+  static bool sKeepAlive;
+  static UInt32 sSendBufSize;
 };
 
 } // namespace Net
@@ -62,7 +62,8 @@ class TCPSocket : public Socket {
    */
   TCPSocket(Thread::Task *notifytask, UInt32 inSocketType)
       : Socket(notifytask, inSocketType),
-        fRemoteStr(fRemoteBuffer, kIPAddrBufSize) {}
+        fRemoteStr(fRemoteBuffer, kIPAddrBufSize),
+        fConnectDeadline(0) {}
 
   ~TCPSocket() override = default;
 
@@ -76,7 +77,38 @@ class TCPSocket : public Socket {
   // has completed, EINPROGRESS if it is still in progress, or an appropriate error
   // if the connect failed.
   OS_Error Connect(UInt32 inRemoteAddr, UInt16 inRemotePort);
-  //OS_Error  CheckAsyncConnect();
+  OS_Error CheckAsyncConnect();
+
+  // ConnectAsync. Connect for a non-blocking Socket driven by its task: when
+  // it returns EINPROGRESS the task gets a kWriteEvent once the connect has
+  // completed or failed, and then calls CheckAsyncConnect. With a timeout,
+  // CheckAsyncConnect returns ETIMEDOUT after that many ms; the task should
+  // return GetConnectTimeRemaining() from Run to be woken up for it. After
+  // any error the Socket has to be cleaned up before it can be used again.
+  OS_Error ConnectAsync(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                        SInt64 inTimeoutInMilSecs = 0);
+
+  // ms until a pending connect times out, at least 1. 0 if there is no
+  // pending connect or it has no timeout.
+  SInt64 GetConnectTimeRemaining();
+
+  bool IsConnecting() { return (bool) (fState & kConnecting); }
+
+  // Connect a kUnixDomainSocketType Socket to the listener at inPath.
+  // A non-blocking Socket returns EAGAIN when the listen Queue is full.
+  OS_Error Connect(char const *inPath);
+
+  // SendFile. Sends up to inLength bytes of the file inFileDesc, starting at
+  // *ioOffset, without copying them through user space (sendfile on Linux,
+  // pread + send elsewhere). *ioOffset advances by *outLengthSent. Returns
+  // EAGAIN when the Socket is flow-controlled; 0 bytes sent with OS_NoErr
+  // means the file ended.
+  OS_Error SendFile(int inFileDesc, UInt64 *ioOffset, UInt32 inLength,
+                    UInt32 *outLengthSent);
+
+  // Splice. Same as SendFile for a pipe, which has no offset. Linux only,
+  // elsewhere it returns EOPNOTSUPP.
+  OS_Error Splice(int inPipeDesc, UInt32 inLength, UInt32 *outLengthSent);
 
   // Basically a copy constructor for this object, also NULLs out the data
   // in tcpSocket.
@@ -94,16 +126,27 @@ class TCPSocket : public Socket {
 
  protected:
 
-  void Set(int inSocket, struct sockaddr_in *remoteaddr);
+  /**
+   * @param localaddr - known local address of inSocket, saves the
+   *                    getsockname call when the listener has a fixed addr.
+   */
+  void Set(int inSocket, struct sockaddr_in *remoteaddr,
+           struct sockaddr_in *localaddr = nullptr);
 
   enum {
     kIPAddrBufSize = 20 //UInt32
   };
 
+  enum {
+    kConnecting = 0x0100U // UInt32, fState: connect in progress
+  };
+
   struct sockaddr_in fRemoteAddr;
   char fRemoteBuffer[kIPAddrBufSize];
   StrPtrLen fRemoteStr;
 
+  SInt64 fConnectDeadline;  // of a pending connect, 0 means none
+
   friend class TCPListenerSocket;
 };
 
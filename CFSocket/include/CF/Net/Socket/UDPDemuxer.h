@@ -28,54 +28,70 @@
     Contains:   Provides a "Listener" Socket for UDP. Blocks on a local IP & port,
                 waiting for data. When it gets data, it passes it off to a UDPDemuxerTask
                 object depending on where it came from.
+                object depending on where it came from.
 
-
+                Lookups are lock free: the table is an open addressing array
+                of task pointers that writers replace under RCU, so routing a
+                packet costs a hash and a short probe however many peers are
+                registered.
 */
 
 #ifndef __UDPDEMUXER_H__
 #define __UDPDEMUXER_H__
 
+#include <atomic>
 #include <CF/StrPtrLen.h>
-#include <CF/HashTable.h>
 #include <CF/Core/Mutex.h>
+#include <CF/Core/RCU.h>
 
 namespace CF {
 namespace Net {
 
 class Task;
-class UDPDemuxerKey;
+class UDPPacketBatch;
+struct UDPPacket;
 
 //IMPLEMENTATION ONLY:
-//HASH TABLE CLASSES USED ONLY IN IMPLEMENTATION
 
 class UDPDemuxerUtils {
  private:
 
-  static UInt32 ComputeHashValue(UInt32 inRemoteAddr, UInt16 inRemotePort) {
-    return ((inRemoteAddr << 16) + inRemotePort);
+  // Local address and port are the same for every task of a demuxer, so
+  // the remote pair identifies the 4-tuple. All 48 bits go through a
+  // 64-bit finalizer together with a per demuxer seed, peers behind one
+  // NAT or in one subnet spread over the whole table and the bucket of a
+  // peer can't be predicted from outside.
+  static UInt32 ComputeHashValue(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                 UInt64 inSeed) {
+    UInt64 theKey = (((UInt64) inRemoteAddr << 16) | inRemotePort) ^ inSeed;
+    theKey ^= theKey >> 33;
+    theKey *= 0xff51afd7ed558ccdULL;
+    theKey ^= theKey >> 33;
+    theKey *= 0xc4ceb9fe1a85ec53ULL;
+    theKey ^= theKey >> 33;
+    return (UInt32) theKey;
   }
 
   friend class UDPDemuxerTask;
-  friend class UDPDemuxerKey;
+  friend class UDPDemuxer;
 };
 
 class UDPDemuxerTask {
  public:
 
   UDPDemuxerTask()
-      : fRemoteAddr(0), fRemotePort(0),
-        fHashValue(0), fNextHashEntry(nullptr) {}
+      : fRemoteAddr(0), fRemotePort(0), fHashValue(0) {}
   virtual ~UDPDemuxerTask() = default;
 
   UInt32 GetRemoteAddr() { return fRemoteAddr; }
 
- private:
+  // Called by UDPDemuxer::RouteBatch for every packet from this task's
+  // address, inside the demuxer's RCU read section. inPacket->fData is
+  // only valid during the call, and the task must not unregister itself
+  // from here.
+  virtual void ProcessPacket(UDPPacket *inPacket) {}
 
-  void set(UInt32 inRemoteAddr, UInt16 inRemotePort) {
-    fRemoteAddr = inRemoteAddr;
-    fRemotePort = inRemotePort;
-    fHashValue = UDPDemuxerUtils::ComputeHashValue(fRemoteAddr, fRemotePort);
-  }
+ private:
 
   //key values
   UInt32 fRemoteAddr;
@@ -84,87 +100,69 @@ class UDPDemuxerTask {
   //precomputed for performance
   UInt32 fHashValue;
 
-  UDPDemuxerTask *fNextHashEntry;
-
-  friend class UDPDemuxerKey;
   friend class UDPDemuxer;
-  friend class HashTable<UDPDemuxerTask, UDPDemuxerKey>;
 };
 
-class UDPDemuxerKey {
- private:
-
-  //CONSTRUCTOR / DESTRUCTOR:
-  UDPDemuxerKey(UInt32 inRemoteAddr, UInt16 inRemotePort)
-      : fRemoteAddr(inRemoteAddr), fRemotePort(inRemotePort) {
-    fHashValue = UDPDemuxerUtils::ComputeHashValue(inRemoteAddr, inRemotePort);
-  }
-
-  ~UDPDemuxerKey() {}
-
- private:
-
-  //PRIVATE ACCESSORS:
-  UInt32 GetHashKey() { return fHashValue; }
-
-  //these functions are only used by the hash table itself. This constructor
-  //will break the "Set" functions.
-  UDPDemuxerKey(UDPDemuxerTask *elem) : fRemoteAddr(elem->fRemoteAddr),
-                                        fRemotePort(elem->fRemotePort),
-                                        fHashValue(elem->fHashValue) {}
-
-  friend int operator==(const UDPDemuxerKey &key1, const UDPDemuxerKey &key2) {
-    if ((key1.fRemoteAddr == key2.fRemoteAddr) &&
-        (key1.fRemotePort == key2.fRemotePort))
-      return true;
-    return false;
-  }
-
-  //data:
-  UInt32 fRemoteAddr;
-  UInt16 fRemotePort;
-  UInt32 fHashValue;
-
-  friend class HashTable<UDPDemuxerTask, UDPDemuxerKey>;
-  friend class UDPDemuxer;
-};
-
-//CLASSES USED ONLY IN IMPLEMENTATION
-typedef HashTable<UDPDemuxerTask, UDPDemuxerKey> UDPDemuxerHashTable;
-
 class UDPDemuxer {
  public:
 
-  UDPDemuxer() : fHashTable(kMaxHashTableSize), fMutex() {}
-  ~UDPDemuxer() = default;
+  explicit UDPDemuxer(UInt32 inExpectedTasks = kMinTableSize);
+  ~UDPDemuxer();
 
-  //These functions grab the Mutex and are therefore premptive safe
+  // Register and Unregister grab the Mutex and are therefore premptive safe.
 
   // Return values: OS_NoErr, or EPERM if there is already a task registered
   // with this address combination
   OS_Error RegisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort, UDPDemuxerTask *inTaskP);
 
   // Return values: OS_NoErr, or EPERM if this task / address combination
-  // is not registered
+  // is not registered. Once it returns no lookup can still see the task,
+  // the caller may delete it. Don't call it with the Mutex held.
   OS_Error UnregisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort, UDPDemuxerTask *inTaskP);
 
-  //Assumes that parent has grabbed the Mutex!
+  // Lock free. The task stays valid while the caller holds the Mutex or
+  // is inside a read section of GetRCU().
   UDPDemuxerTask *GetTask(UInt32 inRemoteAddr, UInt16 inRemotePort);
 
+  // Looks up the task of every packet in ioBatch in one read section,
+  // stores it in UDPPacket::fTask and hands the packet to
+  // UDPDemuxerTask::ProcessPacket. Packets nobody registered for are left
+  // with a nullptr fTask. Returns the number of packets routed.
+  UInt32 RouteBatch(UDPPacketBatch *ioBatch);
+
   bool AddrInMap(UInt32 inRemoteAddr, UInt16 inRemotePort) {
     return (this->GetTask(inRemoteAddr, inRemotePort) != nullptr);
   }
 
+  UInt32 GetNumTasks() { return fNumTasks; }
+
   Core::Mutex *GetMutex() { return &fMutex; }
-  UDPDemuxerHashTable *GetHashTable() { return &fHashTable; }
+  Core::RCU *GetRCU() { return &fRCU; }
 
  private:
 
   enum {
-    kMaxHashTableSize = 2747//is this prime? it should be... //UInt32
+    kMinTableSize = 64  //UInt32, power of 2
+  };
+
+  struct Table {
+    UInt32 fMask;
+    std::atomic<UDPDemuxerTask *> *fBuckets;
   };
-  UDPDemuxerHashTable fHashTable;
-  Core::Mutex fMutex;//this data structure is shared!
+
+  static Table *newTable(UInt32 inSize);
+  static void deleteTable(Table *inTable);
+
+  // writers only, with fMutex held
+  void insert(Table *inTable, UDPDemuxerTask *inTaskP);
+  void rebuild(UInt32 inMinSize);
+
+  UInt64 fSeed;
+  std::atomic<Table *> fTable;
+  UInt32 fNumTasks;
+  UInt32 fNumUsed;      // tasks + tombstones, probes stop at empty buckets
+  Core::Mutex fMutex;   // serializes writers
+  Core::RCU fRCU;       // readers of fTable and of the tasks in it
 };
 
 } // namespace Net
@@ -0,0 +1,120 @@
+/*
+    File:       UDPPacketBatch.h
+
+    Contains:   A reusable array of datagram buffers and peer addresses, the
+                unit of work of UDPSocket::RecvBatch / SendBatch and
+                UDPDemuxer::RouteBatch.
+
+                All memory is allocated once by the constructor. The kernel
+                message headers point into it, so a batch can be handed to
+                recvmmsg / sendmmsg again and again without any setup.
+*/
+
+#ifndef __UDP_PACKET_BATCH_H__
+#define __UDP_PACKET_BATCH_H__
+
+#include <CF/Types.h>
+
+#if !__WinSock__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#endif
+
+namespace CF {
+namespace Net {
+
+class UDPDemuxerTask;
+
+struct UDPPacket {
+  UInt32 fRemoteAddr;       // host order
+  UInt16 fRemotePort;       // host order
+  char *fData;              // points into the batch, GetPacketSize() bytes
+  UInt32 fLength;           // bytes received, or bytes to send
+  UDPDemuxerTask *fTask;    // set by UDPDemuxer::RouteBatch
+};
+
+class UDPPacketBatch {
+ public:
+
+  enum {
+    kDefaultNumPackets = 32,    // UInt32
+    kDefaultPacketSize = 2048,  // UInt32, a full ethernet frame fits
+    kMaxCoalescedSize = 65536   // UInt32, largest GRO read
+  };
+
+  explicit UDPPacketBatch(UInt32 inNumPackets = kDefaultNumPackets,
+                          UInt32 inPacketSize = kDefaultPacketSize);
+
+  ~UDPPacketBatch();
+
+  UInt32 GetCapacity() { return fCapacity; }
+
+  UInt32 GetPacketSize() { return fPacketSize; }
+
+  // number of packets in the batch, received ones or ones to be sent
+  UInt32 GetNumPackets() { return fNumPackets; }
+
+  UDPPacket *GetPacket(UInt32 inIndex) {
+    Assert(inIndex < fCapacity);
+    return &fPackets[inIndex];
+  }
+
+  void Clear();
+
+  /**
+   * Add - copies a datagram into the next free buffer of the batch.
+   * @return false if the batch is full or inLength exceeds GetPacketSize().
+   */
+  bool Add(UInt32 inRemoteAddr, UInt16 inRemotePort,
+           void const *inData, UInt32 inLength);
+
+  /**
+   * AddReference - like Add, but the packet points at inData instead of
+   * copying it, for sending the same data to many peers. inData must stay
+   * valid until the batch is sent; Clear points the packet back at its
+   * own buffer.
+   * @return false if the batch is full.
+   */
+  bool AddReference(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                    char *inData, UInt32 inLength);
+
+  /**
+   * SetNumPackets - for callers that wrote straight into GetPacket(i)->fData.
+   */
+  void SetNumPackets(UInt32 inNumPackets) {
+    Assert(inNumPackets <= fCapacity);
+    fNumPackets = inNumPackets;
+  }
+
+ private:
+
+  UInt32 fCapacity;
+  UInt32 fPacketSize;
+  UInt32 fNumPackets;
+
+  UDPPacket *fPackets;
+  char *fBuffers;
+  struct sockaddr_in *fAddrs;
+#if __linux__
+  struct iovec *fIOVecs;
+  struct mmsghdr *fMsgs;
+#endif
+
+  // a GRO read, split into packets over one or more RecvBatch calls
+  char *fCoalesced;             // kMaxCoalescedSize, allocated on first use
+  UInt32 fCoalescedOffset;      // next segment
+  UInt32 fCoalescedLength;
+  UInt32 fSegmentSize;
+  UInt32 fCoalescedAddr;
+  UInt16 fCoalescedPort;
+
+  friend class UDPSocket;
+};
+
+} // namespace Net
+} // namespace CF
+
+#endif // __UDP_PACKET_BATCH_H__
@@ -0,0 +1,194 @@
+/*
+    File:       UDPRelay.h
+
+    Contains:   Fans every datagram received on one UDP Socket (unicast, or a
+                joined multicast group) out to any number of subscribers.
+
+                A received packet is copied once, into a reference counted
+                buffer from a BufferPool, and every subscriber queue holds a
+                reference to it. Sending gathers the heads of the queues,
+                round robin, into batches for UDPSocket::SendBatch, so the
+                payload is never copied again.
+
+                Each subscriber has a bounded queue with its own drop
+                policy. A subscriber whose sends fail only loses its own
+                packets, and while the Socket is flow controlled the queues
+                keep the newest (or oldest) packets instead of growing.
+*/
+
+#ifndef __UDP_RELAY_H__
+#define __UDP_RELAY_H__
+
+#include <atomic>
+#include <CF/BufferPool.h>
+#include <CF/Queue.h>
+#include <CF/Core/Mutex.h>
+#include <CF/Thread/Task.h>
+#include <CF/Net/Socket/UDPSocket.h>
+
+namespace CF {
+namespace Net {
+
+/**
+ * @brief 引用计数的报文缓冲区，来自 BufferPool，最后一个 Release 时归还
+ */
+class UDPRelayPacket {
+ public:
+
+  char *GetData() { return (char *) (this + 1); }
+
+  UInt32 GetLength() { return fLength; }
+
+  void Retain() { fRefCount.fetch_add(1, std::memory_order_relaxed); }
+
+  void Release() {
+    if (fRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      fPool->Put(this);
+  }
+
+ private:
+
+  // copies inData into a buffer of inPool, with one reference
+  static UDPRelayPacket *create(BufferPool *inPool, char *inData, UInt32 inLength);
+
+  std::atomic<UInt32> fRefCount;
+  UInt32 fLength;
+  BufferPool *fPool;
+  // the payload follows
+
+  friend class UDPRelay;
+};
+
+class UDPRelaySubscriber {
+ public:
+
+  enum DropPolicy {
+    kDropOldest = 0,  // live media: keep the freshest packets
+    kDropNewest = 1   // keep what is queued, refuse what comes later
+  };
+
+  enum {
+    kDefaultQueueLength = 256  // UInt32
+  };
+
+  UDPRelaySubscriber(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                     UInt32 inQueueLength = kDefaultQueueLength,
+                     DropPolicy inPolicy = kDropOldest);
+
+  ~UDPRelaySubscriber();
+
+  UInt32 GetRemoteAddr() { return fRemoteAddr; }
+
+  UInt16 GetRemotePort() { return fRemotePort; }
+
+  UInt32 GetQueueLength() { return fCount; }
+
+  UInt64 GetNumSent() { return fNumSent; }
+
+  // dropped by the policy, plus packets whose send failed
+  UInt64 GetNumDropped() { return fNumDropped; }
+
+ private:
+
+  void enqueue(UDPRelayPacket *inPacket);
+
+  UDPRelayPacket *peek(UInt32 inIndex) {
+    return fQueue[(fHead + inIndex) % fCapacity];
+  }
+
+  void pop();
+
+  UInt32 fRemoteAddr;
+  UInt16 fRemotePort;
+  DropPolicy fPolicy;
+
+  UDPRelayPacket **fQueue;  // ring of fCapacity
+  UInt32 fCapacity;
+  UInt32 fHead;
+  UInt32 fCount;
+  UInt32 fNumBatched;       // queued packets in the send batch being built
+
+  UInt64 fNumSent;
+  UInt64 fNumDropped;
+
+  QueueElem fElem;
+
+  friend class UDPRelay;
+};
+
+class UDPRelay : public Thread::Task {
+ public:
+
+  enum {
+    kDefaultMaxPacketSize = 2048,  // UInt32
+    kSendQuota = 8,                // UInt32, packets per subscriber per round
+    kMaxBatchesPerRun = 16         // UInt32, then let other tasks run
+  };
+
+  explicit UDPRelay(UInt32 inMaxPacketSize = kDefaultMaxPacketSize);
+
+  // send a kKillEvent rather than deleting a started relay
+  ~UDPRelay() override;
+
+  /**
+   * Bind - opens the relay Socket, subscribers are sent to from it too.
+   * @return OS_NoErr, or POSIX error code.
+   */
+  OS_Error Bind(UInt32 inLocalAddr, UInt16 inLocalPort);
+
+  // multicast to unicast bridging, call after Bind
+  OS_Error JoinMulticast(UInt32 inGroupAddr) { return fSocket.JoinMulticast(inGroupAddr); }
+
+  OS_Error LeaveMulticast(UInt32 inGroupAddr) { return fSocket.LeaveMulticast(inGroupAddr); }
+
+  // only relay packets from this source, 0 / 0 (the default) takes any
+  void SetSource(UInt32 inRemoteAddr, UInt16 inRemotePort);
+
+  // starts listening, after Bind
+  void Start() { fSocket.RequestEvent(EV_RE); }
+
+  // The relay owns the subscriber from here on. EPERM if one with the same
+  // address is already there.
+  OS_Error AddSubscriber(UDPRelaySubscriber *inSubscriber);
+
+  // deletes the subscriber, EPERM if there is none with this address
+  OS_Error RemoveSubscriber(UInt32 inRemoteAddr, UInt16 inRemotePort);
+
+  UInt32 GetNumSubscribers() { return fSubscribers.GetLength(); }
+
+  UInt64 GetNumReceived() { return fNumReceived; }
+
+  UDPSocket *GetSocket() { return &fSocket; }
+
+  SInt64 Run() override;
+
+ private:
+
+  // queues every packet of fRecvBatch to every subscriber
+  void fanOut();
+
+  // sends queued packets until the queues are empty or the Socket is
+  // flow controlled, then returns EAGAIN
+  OS_Error flush();
+
+  UDPRelaySubscriber *findSubscriber(UInt32 inRemoteAddr, UInt16 inRemotePort);
+
+  UDPSocket fSocket;
+  BufferPool fPool;
+  UDPPacketBatch fRecvBatch;
+  UDPPacketBatch fSendBatch;
+  UDPRelaySubscriber **fSendOwners;   // subscriber of each fSendBatch packet
+
+  UInt32 fSourceAddr;
+  UInt16 fSourcePort;
+
+  Queue fSubscribers;
+  Core::Mutex fMutex;   // guards fSubscribers against Add / Remove
+
+  UInt64 fNumReceived;
+};
+
+} // namespace Net
+} // namespace CF
+
+#endif // __UDP_RELAY_H__
@@ -37,6 +37,7 @@
 
 #include <CF/Net/Socket/Socket.h>
 #include <CF/Net/Socket/UDPDemuxer.h>
+#include <CF/Net/Socket/UDPPacketBatch.h>
 
 #if !__WinSock__
 
@@ -83,6 +84,46 @@ class UDPSocket : public Socket {
   OS_Error RecvFrom(UInt32 *outRemoteAddr, UInt16 *outRemotePort,
                     void *ioBuffer, UInt32 inBufLen, UInt32 *outRecvLen);
 
+  // Batched SendTo / RecvFrom, one recvmmsg / sendmmsg per call on Linux
+  // and a loop of the single datagram calls elsewhere.
+
+  /**
+   * RecvBatch - fills ioBatch with as many waiting datagrams as it holds.
+   * Datagrams longer than the batch's packet size are truncated.
+   * @return OS_NoErr if at least one datagram was read, EAGAIN if none was
+   * waiting, or POSIX error code.
+   */
+  OS_Error RecvBatch(UDPPacketBatch *ioBatch);
+
+  /**
+   * SendBatch - sends the packets of inBatch in order.
+   * @param outNumSent how many went out, it stops at the first error.
+   * @return OS_NoErr if all were sent, or the error of the first unsent one.
+   */
+  OS_Error SendBatch(UDPPacketBatch *inBatch, UInt32 *outNumSent);
+
+  // Segmentation offload (Linux 4.18+ for GSO, 5.0+ for GRO)
+
+  /**
+   * SendSegmented - sends inBuffer to one peer as inSegmentSize byte
+   * datagrams, the last one may be shorter. With UDP_SEGMENT the kernel
+   * (or NIC) cuts it up, up to 64 datagrams per syscall; without it every
+   * datagram is sent on its own.
+   * @return OS_NoErr, or POSIX error code of the first failing send.
+   */
+  OS_Error SendSegmented(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                         void *inBuffer, UInt32 inLength, UInt16 inSegmentSize);
+
+  /**
+   * EnableGRO - lets the kernel coalesce datagrams of one peer into a single
+   * read. RecvBatch then splits them up again, callers see no difference.
+   * @return OS_NoErr, or EOPNOTSUPP / POSIX error code if the kernel can't,
+   * in which case RecvBatch keeps reading datagram by datagram.
+   */
+  OS_Error EnableGRO();
+
+  bool IsGRO() { return (bool) (fState & kGROEnabled); }
+
   //A UDP Socket may or may not have a demuxer associated with it. The demuxer
   //is a data structure so the Socket can associate incoming data with the proper
   //task to process that data (based on source IP addr & port)
@@ -90,6 +131,15 @@ class UDPSocket : public Socket {
 
  private:
 
+  // more state flags, see Socket.h
+  enum {
+    kGSOUnsupported = 0x0200U,
+    kGROEnabled = 0x0400U,
+    kGSOSupported = 0x0800U   // a segmented send went through
+  };
+
+  OS_Error recvCoalesced(UDPPacketBatch *ioBatch);
+
   UDPDemuxer *fDemuxer;
   struct sockaddr_in fMsgAddr;
 };
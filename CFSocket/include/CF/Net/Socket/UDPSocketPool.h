@@ -27,11 +27,16 @@
 
     Contains:   Object that creates & maintains UDP Socket pairs in a pool.
 
+                Free port pairs are tracked in memory by UDPPortPairAllocator,
+                so creating a pair normally costs one bind per Socket, and
+                the pool mutex is only held to touch the queue of pairs.
+
 */
 
 #ifndef __UDPSOCKETPOOL_H__
 #define __UDPSOCKETPOOL_H__
 
+#include <atomic>
 #include <CF/Net/Socket/UDPDemuxer.h>
 #include <CF/Net/Socket/UDPSocket.h>
 #include <CF/Core/Mutex.h>
@@ -42,10 +47,75 @@ namespace Net {
 
 class UDPSocketPair;
 
+/**
+ * @brief 端口对分配器，每个 bit 对应一个相邻端口对 (even, even + 1)
+ *
+ * The bitmap is split into shards, each thread starts looking in its own
+ * shard, so concurrent allocations rarely touch the same words. Bits are
+ * set and cleared with atomic operations, no lock is taken.
+ *
+ * A set bit only means the pair was handed out by this allocator; ports
+ * bound by other processes are found by the bind failing, the caller then
+ * releases that pair and allocates again.
+ */
+class UDPPortPairAllocator {
+ public:
+
+  enum {
+    kInvalidIndex = 0xFFFFFFFF  // UInt32
+  };
+
+  // pairs (inLowestPort + 2i, inLowestPort + 2i + 1) up to inHighestPort
+  UDPPortPairAllocator(UInt16 inLowestPort, UInt16 inHighestPort);
+
+  ~UDPPortPairAllocator();
+
+  // returns kInvalidIndex when every pair is taken
+  UInt32 Allocate();
+
+  // claims the pair starting at inPort, kInvalidIndex if inPort isn't the
+  // first port of a pair or the pair is taken
+  UInt32 Allocate(UInt16 inPort);
+
+  void Release(UInt32 inIndex);
+
+  UInt16 GetPort(UInt32 inIndex) {
+    return static_cast<UInt16>(fLowestPort + 2 * inIndex);
+  }
+
+  UInt32 GetNumPairs() { return fNumPairs; }
+
+ private:
+
+  enum {
+    kNumShards = 8,      // UInt32, power of 2
+    kBitsPerWord = 64,   // UInt32
+    kCacheLineSize = 64  // UInt32
+  };
+
+  struct alignas(kCacheLineSize) Shard {
+    std::atomic<UInt32> fCursor;  // next pair to try, handed out next fit
+  };
+
+  static UInt32 getShard();
+
+  // claims a clear bit of inWord that is also set in inMask
+  bool tryWord(UInt32 inWord, UInt64 inMask, UInt32 *outIndex);
+
+  UInt32 allocateInShard(UInt32 inShard);
+
+  UInt16 fLowestPort;
+  UInt32 fNumPairs;
+  UInt32 fNumWords;
+  UInt32 fWordsPerShard;
+  std::atomic<UInt64> *fBits;
+  Shard fShards[kNumShards];
+};
+
 class UDPSocketPool {
  public:
 
-  UDPSocketPool() : fMutex() {}
+  UDPSocketPool() : fPorts(kLowestUDPPort, kHighestUDPPort), fMutex() {}
   virtual ~UDPSocketPool() = default;
 
   //Skanky access to member data
@@ -66,6 +136,8 @@ class UDPSocketPool {
   //keeping the number of UDP sockets allocated at a minimum.
   void ReleaseUDPSocketPair(UDPSocketPair *inPair);
 
+  //Binds a new pair and adds it to the pool. Ports come from fPorts, the
+  //pool mutex is not held while binding.
   UDPSocketPair *CreateUDPSocketPair(UInt32 inAddr, UInt16 inPort);
 
  protected:
@@ -85,6 +157,10 @@ class UDPSocketPool {
     kHighestUDPPort = 65535 //UInt16
   };
 
+  // opens and binds inPair on inPort and inPort + 1
+  OS_Error bindUDPSocketPair(UDPSocketPair *inPair, UInt32 inAddr, UInt16 inPort);
+
+  UDPPortPairAllocator fPorts;
   Queue fUDPQueue;
   Core::Mutex fMutex;
 };
@@ -93,7 +169,8 @@ class UDPSocketPair {
  public:
 
   UDPSocketPair(UDPSocket *inSocketA, UDPSocket *inSocketB)
-      : fSocketA(inSocketA), fSocketB(inSocketB), fRefCount(0), fElem() {
+      : fSocketA(inSocketA), fSocketB(inSocketB), fRefCount(0),
+        fPortIndex(UDPPortPairAllocator::kInvalidIndex), fElem() {
     fElem.SetEnclosingObject(this);
   }
   ~UDPSocketPair() = default;
@@ -106,6 +183,7 @@ class UDPSocketPair {
   UDPSocket *fSocketA;
   UDPSocket *fSocketB;
   UInt32 fRefCount;
+  UInt32 fPortIndex;  // in UDPSocketPool::fPorts, if the ports came from there
   QueueElem fElem;
 
   friend class UDPSocketPool;
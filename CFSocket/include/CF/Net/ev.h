@@ -54,6 +54,10 @@ enum EREQ_EVENTS {
 #define EV_OS  EV_OS  /* one shot */
   EV_ET = 0x0020U,
 #define EV_ET  EV_ET  /* Edge Triggered */
+  EV_HU = 0x0040U,
+#define EV_HU  EV_HU  /* hang up, only reported */
+  EV_ER = 0x0080U,
+#define EV_ER  EV_ER  /* error, only reported */
 };
 #define EV_REOS  (EV_RE | EV_OS)
 #define EV_WROS  (EV_WR | EV_OS)
@@ -102,6 +106,7 @@ int select_watchevent(struct eventreq *req, int which);
 int select_modwatch(struct eventreq *req, int which);
 int select_waitevent(struct eventreq *req, void *onlyForMOSX);
 int select_removeevent(int which);
+void select_wakeup();
 
 #endif /* !MACOSXEVENTQUEUE */
 
@@ -74,6 +74,12 @@ void select_stopevents() {
 //  ::PostMessage(sMsgWindow, WM_TIMER, 0, 0);
 }
 
+void select_wakeup() {
+  // select_waitevent takes WM_TIMER for a timeout
+  if (sMsgWindow != NULL)
+    ::PostMessage(sMsgWindow, WM_TIMER, 0, 0);
+}
+
 int select_removeevent(int /*which*/) {
   //
   // Not needed for WSA.
@@ -178,9 +184,15 @@ int select_waitevent(struct eventreq *req, void * /*onlyForMacOSX*/) {
     UInt32 theEvent = WSAGETSELECTEVENT(theMessage.lParam);
 
     req->er_handle = theMessage.wParam; // the wParam is the FD
-    req->er_eventbits = EV_RE;          // WSA events & Socket events don't map...
-    // but the server state machines never care
-    // what the event is anyway.
+    req->er_eventbits = 0;
+    if (theEvent & (FD_READ | FD_ACCEPT | FD_OOB))
+      req->er_eventbits |= EV_RE;
+    if (theEvent & (FD_WRITE | FD_CONNECT))
+      req->er_eventbits |= EV_WR;
+    if (theEvent & FD_CLOSE)
+      req->er_eventbits |= EV_HU;
+    if (theSelectErr != 0)
+      req->er_eventbits |= EV_ER;
 
     // we use the message # as our way of passing around the user data.
     req->er_data = (void *) (theMessage.message);
@@ -44,6 +44,7 @@ Task::Task()
       fUseThisThread(nullptr),
       fDefaultThread(nullptr),
       fWriteLock(false),
+      fSignalTime(0),
       fTimerHeapElem(),
       fTaskQueueElem(),
       pickerToUse(&Task::sShortTaskThreadPicker) {
@@ -109,6 +110,7 @@ void Task::Signal(EventFlags events) {
                    fTaskName);
       }
 
+      fSignalTime = Core::Time::Milliseconds();
       fUseThisThread->fTaskQueue.EnQueue(&fTaskQueueElem);
     } else {
       // find a Thread to put this task on
@@ -168,6 +170,7 @@ void Task::Signal(EventFlags events) {
                  (void *) &fTaskQueueElem, (void *) this);
 
       // 将任务压入 TaskThread 的就绪队列
+      fSignalTime = Core::Time::Milliseconds();
       TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.EnQueue(&fTaskQueueElem);
 
       if (DEBUG_TASK)
@@ -224,6 +227,12 @@ void Task::ForceSameThread() {
              (void *) &fTaskQueueElem, (void *) this);
 }
 
+SInt64 Task::GetQueueDelay() {
+  auto *theThread = (TaskThread *) Core::Thread::GetCurrent();
+  Assert(theThread != nullptr);
+  return theThread->fQueueDelay >> 3;
+}
+
 /**
  * Task::Run 执行期间必须调用 GetEvents 获取已触发事件，同时清除已获得的事件标志。
  * 但同样因为 GetEvents 会清除旧事件，返回的事件必须被同时处理，否则就会丢失
@@ -338,8 +347,8 @@ void TaskThread::Entry() {
         // that if an event sneaks in right as the task is returning from Run()
         // (via Signal) that the Run function will be invoked again.
         /* check point!!! Task 处理期间未激活新的 event，则撤销 alive 状态 */
-        static unsigned int val = Task::kAlive;
-        doneProcessingEvent = theTask->fEvents.compare_exchange_weak(val, 0);
+        Task::EventFlags val = Task::kAlive;
+        doneProcessingEvent = theTask->fEvents.compare_exchange_strong(val, 0);
         /* 虽然该任务目前没有事件处理，但是并不表示要销毁，所以没有 delete。 */
       } else {
         /* 如果 theTimeout > 0,
@@ -432,6 +441,10 @@ Task *TaskThread::WaitForTask() {
     /* TaskThread 类有一个 OSQueue_Blocking 类的私有成员 fTaskQueue。
      * 等待队列里有任务插入并将其取出返回。
      * 如果返回非空,则返回该队列项所对应的任务对象。 */
+    // the backlog is gone, whatever the last tasks waited is history
+    if (fTaskQueue.GetQueue()->GetLength() == 0)
+      fQueueDelay = 0;
+
     QueueElem *theElem = fTaskQueue.DeQueueBlocking(this, (SInt32) theTimeout);
     if (theElem != nullptr) {
       if (DEBUG_TASK)
@@ -441,7 +454,11 @@ Task *TaskThread::WaitForTask() {
                  ((Task *) theElem->GetEnclosingObject())->fTaskName,
                  (void *) this, fTaskQueue.GetQueue()->GetLength(),
                  (void *) theElem, theElem->GetEnclosingObject());
-      return (Task *) theElem->GetEnclosingObject();
+
+      auto *theTask = (Task *) theElem->GetEnclosingObject();
+      SInt64 theDelay = Core::Time::Milliseconds() - theTask->fSignalTime;
+      fQueueDelay += theDelay - (fQueueDelay >> 3);
+      return theTask;
     }
 
     // If we are supposed to stop, return nullptr, which signals the caller to stop
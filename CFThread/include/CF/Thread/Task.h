@@ -84,6 +84,8 @@ class Task {
     /* Socket events */
     kReadEvent    = 0x01U << 4U,
     kWriteEvent   = 0x01U << 5U,
+    kHangupEvent  = 0x01U << 7U,  // always comes with kReadEvent
+    kErrorEvent   = 0x01U << 8U,  // always comes with kReadEvent
 
     /* update event */
     kUpdateEvent  = 0x01U << 6U,
@@ -143,6 +145,13 @@ class Task {
    */
   void ForceSameThread();
 
+  /**
+   * Smoothed time, in milliseconds, that the tasks of the TaskThread this
+   * task is running on wait in its queue before they run. A measure of how
+   * far behind the thread is, for load shedding. Only call it from Run.
+   */
+  SInt64 GetQueueDelay();
+
   SInt64 CallLocked() {
     ForceSameThread();
     fWriteLock = true;
@@ -168,6 +177,7 @@ class Task {
   TaskThread *fUseThisThread; /* 强制执行线程 */
   TaskThread *fDefaultThread; /* 默认执行线程 */
   bool fWriteLock;
+  SInt64 fSignalTime;         /* 进入调度队列的时间 */
 
 #if DEBUG_TASK
   // The whole premise of a task is that the Run function cannot be re-entered.
@@ -197,7 +207,7 @@ class TaskThread : public Core::Thread {
 
   // Implementation detail: all tasks get run on TaskThreads.
 
-  TaskThread() : Thread(), fTaskThreadPoolElem() {
+  TaskThread() : Thread(), fTaskThreadPoolElem(), fQueueDelay(0) {
     fTaskThreadPoolElem.SetEnclosingObject(this);
   }
 
@@ -219,6 +229,10 @@ class TaskThread : public Core::Thread {
   Heap fHeap;               /* 时序-优先队列 */
   BlockingQueue fTaskQueue; /* 事件-触发队列 */
 
+  // queueing delay of fTaskQueue in ms, times 8, smoothed like TCP's srtt.
+  // Only written by this thread.
+  SInt64 fQueueDelay;
+
   friend class Task;
   friend class TaskThreadPool;
 };
@@ -47,6 +47,17 @@ class CFConfigure {
 
   virtual UInt32 GetShortTaskThreads() { return 1; }
   virtual UInt32 GetBlockingThreads() { return 1; }
+
+  //
+  // TCPListenerSocket Settings
+
+  virtual UInt32 GetListenQueueLength() { return 128; }
+  virtual UInt32 GetMaxAcceptsPerEvent() { return 32; }
+
+  // options of accepted sockets, a zero buffer size keeps the kernel default
+  virtual bool IsTCPNoDelay() { return true; }
+  virtual bool IsTCPKeepAlive() { return true; }
+  virtual UInt32 GetTCPSendBufSize() { return 96 * 1024; }
 };
 
 }
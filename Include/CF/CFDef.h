@@ -71,6 +71,7 @@ enum {
   CF_AttrNameExists = -19,
   CF_InstanceAttrsNotAllowed = -20,
   CF_UnknownAudioCoder = -21,
+  CF_RequestPending = -22,
 
   // server state error
   CF_UnknownError = -255,
@@ -23,8 +23,11 @@ class CFState {
 
   static void WaitProcessState(UInt32 state) {
     sState |= state;
+#if !MACOSXEVENTQUEUE
+    ::select_wakeup(); // EventThread 在 select_waitevent 返回后才处理 state
+#endif
     while (sState & state) {
-      Core::Thread::Sleep(1000);
+      Core::Thread::Sleep(10);
     }
   }
 
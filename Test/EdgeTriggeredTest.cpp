@@ -0,0 +1,383 @@
+/*
+    File:       EdgeTriggeredTest.cpp
+
+    Contains:   HTTP sessions on edge triggered sockets, with a client that
+                writes the request and reads the response a little at a
+                time. Also counts the epoll_ctl calls the server makes:
+                none per keep-alive request, and EV_WR is dropped once a
+                response that filled the Socket is out. A session waiting
+                for an asynchronous handler gives up when the client hangs
+                up, and a shed request's 503 survives the body that keeps
+                coming after it.
+*/
+
+#include <dlfcn.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <CF/CF.h>
+#include <CF/Net/Http/HTTPCompletion.h>
+#include <CF/Net/Http/HTTPConfigure.hpp>
+#include <CF/Net/Http/HTTPSession.h>
+
+using namespace CF;
+
+static const UInt16 kPort = 18081;
+static const UInt32 kBigBodySize = 4 * 1024 * 1024;
+static const UInt32 kNumKeepAliveRequests = 1000;
+
+static std::atomic<UInt32> sNumFailures(0);
+static std::atomic<bool> sClientDone(false);
+
+// the token of the request /pending is holding
+static std::atomic<Net::HTTPCompletion *> sPending(nullptr);
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if (!(cond)) {                                                         \
+      s_printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);    \
+      sNumFailures++;                                                      \
+    }                                                                      \
+  } while (0)
+
+//
+// epoll_ctl of the framework lands here first
+
+static std::mutex sCtlMutex;
+static UInt32 sNumCtls = 0;
+static std::map<int, UInt32> sCtlEvents;   // last events set, per fd
+static int sLastWriteFD = -1;             // last fd EPOLLOUT was set on
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+  typedef int (*CtlFunc)(int, int, int, struct epoll_event *);
+  static CtlFunc sRealCtl = (CtlFunc) ::dlsym(RTLD_NEXT, "epoll_ctl");
+  {
+    std::lock_guard<std::mutex> locker(sCtlMutex);
+    sNumCtls++;
+    if (op == EPOLL_CTL_DEL) {
+      sCtlEvents.erase(fd);
+    } else {
+      sCtlEvents[fd] = event->events;
+      if (event->events & EPOLLOUT)
+        sLastWriteFD = fd;
+    }
+  }
+  return sRealCtl(epfd, op, fd, event);
+}
+
+static UInt32 getNumCtls() {
+  std::lock_guard<std::mutex> locker(sCtlMutex);
+  return sNumCtls;
+}
+
+//
+// client side
+
+static int connectToServer() {
+  struct sockaddr_in theAddr;
+  ::memset(&theAddr, 0, sizeof(theAddr));
+  theAddr.sin_family = AF_INET;
+  theAddr.sin_port = htons(kPort);
+  theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (int i = 0; i < 50; i++) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int theOne = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &theOne, sizeof(theOne));
+    if (::connect(fd, (struct sockaddr *) &theAddr, sizeof(theAddr)) == 0)
+      return fd;
+    ::close(fd);
+    ::usleep(100 * 1000);
+  }
+  return -1;
+}
+
+// inChunk bytes per send, with a pause in between so each one is an edge
+static bool sendSlowly(int fd, std::string const &inData, size_t inChunk) {
+  for (size_t i = 0; i < inData.size(); i += inChunk) {
+    size_t theLen = std::min(inChunk, inData.size() - i);
+    if (::send(fd, inData.data() + i, theLen, MSG_NOSIGNAL) != (ssize_t) theLen)
+      return false;
+    if (inChunk < inData.size())
+      ::usleep(1000);
+  }
+  return true;
+}
+
+// Reads one response with a Content-Length, inChunk bytes per recv and
+// inPauseInUs between them. The body, or an empty string on error.
+static std::string readResponse(int fd, size_t inChunk, useconds_t inPauseInUs,
+                                int *outStatus) {
+  std::string theData;
+  size_t theHeaderLen = std::string::npos;
+  size_t theBodyLen = 0;
+  std::vector<char> theBuffer(inChunk);
+  *outStatus = 0;
+
+  while (theHeaderLen == std::string::npos
+      || theData.size() < theHeaderLen + theBodyLen) {
+    ssize_t theLen = ::recv(fd, theBuffer.data(), inChunk, 0);
+    if (theLen <= 0)
+      return std::string();
+    theData.append(theBuffer.data(), (size_t) theLen);
+    if (inPauseInUs > 0)
+      ::usleep(inPauseInUs);
+
+    if (theHeaderLen == std::string::npos) {
+      size_t theEnd = theData.find("\r\n\r\n");
+      if (theEnd == std::string::npos)
+        continue;
+      theHeaderLen = theEnd + 4;
+      *outStatus = ::atoi(theData.c_str() + 9);
+      size_t theField = theData.find("Content-Length: ");
+      if (theField == std::string::npos || theField > theHeaderLen)
+        return std::string();
+      theBodyLen = (size_t) ::atol(theData.c_str() + theField + 16);
+    }
+  }
+  return theData.substr(theHeaderLen, theBodyLen);
+}
+
+static std::string makeBigBody() {
+  std::string theBody(kBigBodySize, '\0');
+  for (UInt32 i = 0; i < kBigBodySize; i++)
+    theBody[i] = (char) ('a' + i % 26);
+  return theBody;
+}
+
+// the request line and headers trickle in, then the body
+static void testPartialRead() {
+  int fd = connectToServer();
+  CHECK(fd != -1);
+  if (fd == -1) return;
+
+  std::string theBody(100 * 1000, 'x');
+  std::string theRequest = "POST /echo HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n"
+      "Content-Length: " + std::to_string(theBody.size()) + "\r\n\r\n";
+  CHECK(sendSlowly(fd, theRequest, 1));
+  CHECK(sendSlowly(fd, theBody, 1000));
+
+  int theStatus;
+  std::string theResponse = readResponse(fd, 4096, 0, &theStatus);
+  CHECK(theStatus == 200);
+  CHECK(theResponse == theBody);
+  ::close(fd);
+}
+
+// a response far bigger than the Socket buffers, read slowly
+static void testPartialWrite() {
+  int fd = connectToServer();
+  CHECK(fd != -1);
+  if (fd == -1) return;
+  int theSize = 16 * 1024;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &theSize, sizeof(theSize));
+
+  std::string theRequest = "GET /big HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+  CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+
+  int theStatus;
+  std::string theResponse = readResponse(fd, 64 * 1024, 200, &theStatus);
+  CHECK(theStatus == 200);
+  CHECK(theResponse == makeBigBody());
+
+  // once all is sent the session stops watching for writable
+  ::usleep(200 * 1000);
+  {
+    std::lock_guard<std::mutex> locker(sCtlMutex);
+    CHECK(sLastWriteFD != -1);
+    CHECK(sCtlEvents.count(sLastWriteFD) == 1);
+    CHECK((sCtlEvents[sLastWriteFD] & EPOLLOUT) == 0);
+    CHECK((sCtlEvents[sLastWriteFD] & EPOLLIN) != 0);
+  }
+
+  // and the connection still serves requests
+  theRequest = "GET /small HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+  CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+  theResponse = readResponse(fd, 4096, 0, &theStatus);
+  CHECK(theStatus == 200);
+  CHECK(theResponse == "small\n");
+  ::close(fd);
+}
+
+// keep-alive requests that fit the Socket buffers cost no epoll_ctl
+static void testNumSyscalls() {
+  int fd = connectToServer();
+  CHECK(fd != -1);
+  if (fd == -1) return;
+
+  std::string theRequest = "GET /small HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+  int theStatus;
+  CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+  CHECK(readResponse(fd, 4096, 0, &theStatus) == "small\n");
+
+  UInt32 theNumCtls = getNumCtls();
+  for (UInt32 i = 0; i < kNumKeepAliveRequests; i++) {
+    CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+    CHECK(readResponse(fd, 4096, 0, &theStatus) == "small\n");
+  }
+  theNumCtls = getNumCtls() - theNumCtls;
+  s_printf("epoll_ctl calls for %" _U32BITARG_ " keep-alive requests: %" _U32BITARG_ "\n",
+           kNumKeepAliveRequests, theNumCtls);
+  CHECK(theNumCtls == 0);
+  ::close(fd);
+}
+
+// the client goes away while the handler hasn't answered yet
+static void testHangupWhilePending() {
+  int fd = connectToServer();
+  CHECK(fd != -1);
+  if (fd == -1) return;
+
+  std::string theRequest = "GET /pending HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+  CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+  for (int i = 0; i < 500 && sPending.load() == nullptr; i++)
+    ::usleep(10 * 1000);
+  Net::HTTPCompletion *theCompletion = sPending.exchange(nullptr);
+  CHECK(theCompletion != nullptr);
+  if (theCompletion == nullptr) return;
+
+  ::close(fd);
+  ::usleep(200 * 1000);
+
+  // the session has let go of the request
+  CHECK(!theCompletion->Lock());
+  theCompletion->Unlock();
+  theCompletion->Complete(CF_NoErr);
+}
+
+// over the connection limit the request is answered 503 right after its
+// header, while its body is still being sent
+static void testShedWithBody() {
+  int theFirst = connectToServer();
+  CHECK(theFirst != -1);
+  if (theFirst == -1) return;
+  std::string theRequest = "GET /small HTTP/1.1\r\nHost: test\r\nConnection: keep-alive\r\n\r\n";
+  int theStatus;
+  CHECK(sendSlowly(theFirst, theRequest, theRequest.size()));
+  CHECK(readResponse(theFirst, 4096, 0, &theStatus) == "small\n");
+
+  Net::HTTPSession::SetAdmissionLimits(Net::HTTPSession::GetNumSessions(), 0);
+  UInt64 theNumShed = Net::HTTPSession::GetNumShedRequests();
+
+  int fd = connectToServer();
+  CHECK(fd != -1);
+  if (fd != -1) {
+    std::string theBody(1024 * 1024, 'x');
+    theRequest = "POST /echo HTTP/1.1\r\nHost: test\r\n"
+        "Content-Length: " + std::to_string(theBody.size()) + "\r\n\r\n";
+    // some of the body comes with the header, unread when the 503 is sent;
+    // the rest follows it, the session reads it all instead of resetting
+    theRequest += theBody.substr(0, 64 * 1024);
+    CHECK(sendSlowly(fd, theRequest, theRequest.size()));
+    ::usleep(50 * 1000);
+    CHECK(sendSlowly(fd, theBody.substr(64 * 1024), 64 * 1024));
+
+    readResponse(fd, 4096, 0, &theStatus);
+    CHECK(theStatus == 503);
+    char theByte;
+    CHECK(::recv(fd, &theByte, 1, 0) == 0);   // a FIN, not a RST
+    ::close(fd);
+  }
+  CHECK(Net::HTTPSession::GetNumShedRequests() == theNumShed + 1);
+
+  Net::HTTPSession::SetAdmissionLimits(0, 0);
+  ::close(theFirst);
+}
+
+static void runClient() {
+  testPartialRead();
+  testPartialWrite();
+  testNumSyscalls();
+  testHangupWhilePending();
+  testShedWithBody();
+  s_printf("%" _U32BITARG_ " failures\n", sNumFailures.load());
+
+  // the server shuts down as after /exit, CFExit picks the result
+  sClientDone = true;
+  CFEnv::Exit(1);
+}
+
+//
+// server side
+
+class TestConfig : public CFConfigure, public Net::HTTPConfigure {
+ public:
+  CF_Error StartupCustomServices() override {
+    CF_Error theErr = Net::HTTPConfigure::StartupHTTPService(this);
+    if (theErr == CF_NoErr)
+      std::thread(runClient).detach();
+    return theErr;
+  }
+
+  HTTPMapping *GetHttpMapping() override {
+    static HTTPMapping sMapping[] = {
+        {"/echo", (CF_CGIFunction) EchoCGI},
+        {"/big", (CF_CGIFunction) BigCGI},
+        {"/small", (CF_CGIFunction) SmallCGI},
+        {"/pending", (CF_CGIFunction) PendingCGI},
+        {NULL, NULL}
+    };
+    return sMapping;
+  }
+
+  CF_NetAddr *GetHttpListenAddr(UInt32 *outNum) override {
+    static CF_NetAddr sAddrs[] = {
+        {"127.0.0.1", kPort}
+    };
+    *outNum = 1;
+    return sAddrs;
+  }
+
+ private:
+  static CF_Error EchoCGI(Net::HTTPPacket &request, Net::HTTPPacket &response) {
+    StrPtrLen *theBody = request.GetBody();
+    UInt32 theLen = theBody != nullptr ? theBody->Len : 0;
+    StrPtrLen *content = response.NewBody(theLen);
+    if (theLen > 0)
+      ::memcpy(content->Ptr, theBody->Ptr, theLen);
+    return CF_NoErr;
+  }
+
+  static CF_Error BigCGI(Net::HTTPPacket &request, Net::HTTPPacket &response) {
+    static std::string const sBody = makeBigBody();
+    StrPtrLen *content = response.NewBody((UInt32) sBody.size());
+    ::memcpy(content->Ptr, sBody.data(), sBody.size());
+    return CF_NoErr;
+  }
+
+  static CF_Error SmallCGI(Net::HTTPPacket &request, Net::HTTPPacket &response) {
+    static char const sContent[] = "small\n";
+    StrPtrLen *content = response.NewBody(sizeof(sContent) - 1);
+    ::memcpy(content->Ptr, sContent, content->Len);
+    return CF_NoErr;
+  }
+
+  // never answers, the client completes it
+  static CF_Error PendingCGI(Net::HTTPPacket &request, Net::HTTPPacket &response) {
+    Net::HTTPCompletion *theCompletion = request.Defer(60 * 1000);
+    if (theCompletion == nullptr)
+      return CF_Unimplemented;
+    sPending = theCompletion;
+    return CF_RequestPending;
+  }
+};
+
+CF_Error CFInit(int argc, char **argv) {
+  CFEnv::Register(new TestConfig());
+  return CF_NoErr;
+}
+
+CF_Error CFExit(CF_Error exitCode) {
+  // the server may have failed to start, then the client never ran
+  return sClientDone && sNumFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
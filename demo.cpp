@@ -25,11 +25,9 @@ class MyConfig : public CFConfigure, public Net::HTTPConfigure {
  private:
   static CF_Error DefaultCGI(CF::Net::HTTPPacket &request,
                              CF::Net::HTTPPacket &response) {
-    ResizeableStringFormatter formatter(nullptr, 0);
-    formatter.Put("test content\n");
-    StrPtrLen *content = new StrPtrLen(formatter.GetAsCString(),
-                                       formatter.GetCurrentOffset());
-    response.SetBody(content);
+    static char const sContent[] = "test content\n";
+    StrPtrLen *content = response.NewBody(sizeof(sContent) - 1);
+    ::memcpy(content->Ptr, sContent, content->Len);
     return CF_NoErr;
   }
 };